@@ -45,6 +45,10 @@
 /* define if return values need to be extended explicitely
    at caller side (for interfacing with non-TCC compilers) */
 #define PROMOTE_RET
+
+#define TCC_TARGET_NATIVE_STRUCT_COPY
+ST_FUNC int gen_struct_copy(int size, int align);
+ST_FUNC int gen_struct_clear(int size, int align);
 /******************************************************/
 #else /* ! TARGET_DEFS_ONLY */
 /******************************************************/
@@ -92,8 +96,8 @@ ST_DATA const int reg_classes[NB_REGS] = {
 };
 
 #if defined(CONFIG_TCC_BCHECK)
-static addr_t func_bound_offset;
-static unsigned long func_bound_ind;
+static ST_TLS addr_t func_bound_offset;
+static ST_TLS unsigned long func_bound_ind;
 ST_DATA int func_bound_add_epilog;
 #endif
 
@@ -1170,10 +1174,10 @@ ST_FUNC void gfunc_call(int nb_args)
     tcc_free(t);
 }
 
-static unsigned long arm64_func_va_list_stack;
-static int arm64_func_va_list_gr_offs;
-static int arm64_func_va_list_vr_offs;
-static int arm64_func_sub_sp_offset;
+static ST_TLS unsigned long arm64_func_va_list_stack;
+static ST_TLS int arm64_func_va_list_gr_offs;
+static ST_TLS int arm64_func_va_list_vr_offs;
+static ST_TLS int arm64_func_sub_sp_offset;
 
 ST_FUNC void gfunc_prolog(Sym *func_sym)
 {
@@ -2166,6 +2170,113 @@ ST_FUNC void gen_vla_alloc(CType *type, int align) {
 #endif
 }
 
+static int is_local_addr(SValue *sv)
+{
+    return (sv->r & (VT_VALMASK | VT_LVAL | VT_SYM)) == VT_LOCAL;
+}
+
+// Base register and offset of the address 'sv': x29 for a local.
+static uint32_t struct_base(SValue *sv, uint64_t *off)
+{
+    if (is_local_addr(sv)) {
+        *off = sv->c.i;
+        return 29;
+    }
+    *off = 0;
+    return intr(sv->r & VT_VALMASK);
+}
+
+// ldp/stp q(r),q(r+1),[x(bas),#(off)], or two ldr/str
+static void arm64_ldstp_q(int st, int r, int bas, uint64_t off)
+{
+    if (!(off & 15) && off + 1024 < 2048)
+        o((st ? 0xad000000 : 0xad400000) | r | (r + 1) << 10 | bas << 5 |
+          (off >> 4 & 0x7f) << 15);
+    else if (st)
+        arm64_strv(4, r, bas, off), arm64_strv(4, r + 1, bas, off + 16);
+    else
+        arm64_ldrv(4, r, bas, off), arm64_ldrv(4, r + 1, bas, off + 16);
+}
+
+// Copy through v16 and v17, which are never allocated.  Tails are
+// done by moves overlapping the previous ones.
+ST_FUNC int gen_struct_copy(int size, int align)
+{
+    uint32_t d, s;
+    uint64_t dc, sc, c;
+    int n;
+
+    if (size > 128)
+        return 0;
+    if (!is_local_addr(vtop - 1) && !is_local_addr(vtop))
+        gv2(RC_INT, RC_INT);
+    else if (!is_local_addr(vtop - 1)) {
+        vswap();
+        gv(RC_INT);
+        vswap();
+    } else if (!is_local_addr(vtop))
+        gv(RC_INT);
+    d = struct_base(vtop - 1, &dc);
+    s = struct_base(vtop, &sc);
+    if (size >= 16) {
+        for (c = 0; c + 32 <= size; c += 32) {
+            arm64_ldstp_q(0, 16, s, sc + c);
+            arm64_ldstp_q(1, 16, d, dc + c);
+        }
+        if (size - c > 16) {
+            arm64_ldrv(4, 16, s, sc + c);
+            arm64_ldrv(4, 17, s, sc + size - 16);
+            arm64_strv(4, 16, d, dc + c);
+            arm64_strv(4, 17, d, dc + size - 16);
+        } else if (c < size) {
+            arm64_ldrv(4, 16, s, sc + size - 16);
+            arm64_strv(4, 16, d, dc + size - 16);
+        }
+    } else if (size) {
+        for (n = 3; 1 << n > size; n--)
+            ;
+        arm64_ldrv(n, 16, s, sc);
+        arm64_ldrv(n, 17, s, sc + size - (1 << n));
+        arm64_strv(n, 16, d, dc);
+        arm64_strv(n, 17, d, dc + size - (1 << n));
+    }
+    vpop();
+    vpop();
+    return 1;
+}
+
+ST_FUNC int gen_struct_clear(int size, int align)
+{
+    uint32_t d;
+    uint64_t dc, c;
+    int n;
+
+    if (size > 128)
+        return 0;
+    if (!is_local_addr(vtop))
+        gv(RC_INT);
+    d = struct_base(vtop, &dc);
+    if (size >= 16) {
+        o(0x6f00e410); // movi v16.2d,#0
+        o(0x6f00e411); // movi v17.2d,#0
+        for (c = 0; c + 32 <= size; c += 32)
+            arm64_ldstp_q(1, 16, d, dc + c);
+        if (c < size) {
+            if (size - c > 16)
+                arm64_strv(4, 16, d, dc + c);
+            arm64_strv(4, 16, d, dc + size - 16);
+        }
+    } else if (size) {
+        for (n = 3; 1 << n > size; n--)
+            ;
+        arm64_strx(n, 31, d, dc); // str(*) zr
+        if (1 << n != size)
+            arm64_strx(n, 31, d, dc + size - (1 << n));
+    }
+    vpop();
+    return 1;
+}
+
 /* end of A64 code generator */
 /*************************************************************/
 #endif
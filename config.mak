@@ -0,0 +1,25 @@
+# Automatically generated by configure - do not modify
+prefix=/usr/local
+bindir=$(DESTDIR)/usr/local/bin
+tccdir=$(DESTDIR)/usr/local/lib/tcc
+libdir=$(DESTDIR)/usr/local/lib
+includedir=$(DESTDIR)/usr/local/include
+mandir=$(DESTDIR)/usr/local/share/man
+infodir=$(DESTDIR)/usr/local/share/info
+docdir=$(DESTDIR)/usr/local/share/doc
+CC=gcc
+CC_NAME=gcc
+GCC_MAJOR=12
+GCC_MINOR=2
+AR=ar
+CFLAGS=-Wall -O2 -Wdeclaration-after-statement -fno-strict-aliasing -Wno-pointer-sign -Wno-sign-compare -Wno-unused-result -Wno-format-truncation -Wno-stringop-truncation
+LDFLAGS=
+LIBSUF=.a
+EXESUF=
+DLLSUF=.so
+NATIVE_DEFINES+=-DCONFIG_TRIPLET="\"x86_64-linux-gnu\""
+ARCH=x86_64
+TARGETOS=Linux
+BUILDOS=Linux
+VERSION = 0.9.28rc
+TOPSRC=$(TOP)
@@ -75,6 +75,10 @@ enum {
    at caller side (for interfacing with non-TCC compilers) */
 #define PROMOTE_RET
 
+#define TCC_TARGET_NATIVE_STRUCT_COPY
+ST_FUNC int gen_struct_copy(int size, int align);
+ST_FUNC int gen_struct_clear(int size, int align);
+
 /******************************************************/
 #else /* ! TARGET_DEFS_ONLY */
 /******************************************************/
@@ -97,11 +101,11 @@ ST_DATA const int reg_classes[NB_REGS] = {
     /* st0 */ RC_FLOAT | RC_ST0,
 };
 
-static unsigned long func_sub_sp_offset;
-static int func_ret_sub;
+static ST_TLS unsigned long func_sub_sp_offset;
+static ST_TLS int func_ret_sub;
 #ifdef CONFIG_TCC_BCHECK
-static addr_t func_bound_offset;
-static unsigned long func_bound_ind;
+static ST_TLS addr_t func_bound_offset;
+static ST_TLS unsigned long func_bound_ind;
 ST_DATA int func_bound_add_epilog;
 static void gen_bounds_prolog(void);
 static void gen_bounds_epilog(void);
@@ -1033,16 +1037,64 @@ ST_FUNC void gen_cvt_csti(int t)
 /* increment tcov counter */
 ST_FUNC void gen_increment_tcov (SValue *sv)
 {
+   int lock = tcc_state->test_coverage & TCOV_ATOMIC;
+   if (lock)
+       g(0xf0);
    o(0x0583); /* addl $1, xxx */
    greloc(cur_text_section, sv->sym, ind, R_386_32);
    gen_le32(0);
    o(1);
+   if (lock)
+       g(0xf0);
    o(0x1583); /* addcl $0, xxx */
    greloc(cur_text_section, sv->sym, ind, R_386_32);
    gen_le32(4);
    g(0);
 }
 
+/* -ftest-coverage=thread: store the offset of the counters of this
+   thread, from a hash of the thread pointer, at loc(%ebp) */
+ST_FUNC void gen_tcov_shard(int loc)
+{
+#ifdef TCC_TARGET_PE
+   o(0xa164); /* mov %fs:0x18, %eax */
+   gen_le32(0x18);
+#else
+   o(0xa165); /* mov %gs:0, %eax */
+   gen_le32(0);
+#endif
+   o(0x0ce8c1); /* shr $12, %eax */
+   o(0xc069); /* imul $0x9e3779b1, %eax, %eax */
+   gen_le32(0x9e3779b1);
+   o(0x16e8c1); /* shr $22, %eax */
+   o(0x25); /* and $(TCOV_SHARDS - 1) * 64, %eax */
+   gen_le32((TCOV_SHARDS - 1) * 64);
+   o(0x89);
+   gen_modrm(TREG_EAX, VT_LOCAL, NULL, loc);
+}
+
+/* increment the copy at loc(%ebp) of tcov counter */
+ST_FUNC void gen_increment_tcov_shard (SValue *sv, int loc)
+{
+   int lock = tcc_state->test_coverage & TCOV_ATOMIC;
+   g(0x50); /* push %eax */
+   o(0x8b);
+   gen_modrm(TREG_EAX, VT_LOCAL, NULL, loc);
+   if (lock)
+       g(0xf0);
+   o(0x8083); /* addl $1, xxx(%eax) */
+   greloc(cur_text_section, sv->sym, ind, R_386_32);
+   gen_le32(0);
+   o(1);
+   if (lock)
+       g(0xf0);
+   o(0x9083); /* addcl $0, xxx(%eax) */
+   greloc(cur_text_section, sv->sym, ind, R_386_32);
+   gen_le32(4);
+   g(0);
+   g(0x58); /* pop %eax */
+}
+
 /* computed goto support */
 ST_FUNC void ggoto(void)
 {
@@ -1141,6 +1193,83 @@ ST_FUNC void gen_vla_alloc(CType *type, int align) {
     }
 }
 
+static int is_local_addr(SValue *sv)
+{
+    return (sv->r & (VT_VALMASK | VT_LVAL | VT_SYM)) == VT_LOCAL;
+}
+
+/* modrm for 'c' bytes after the address 'sv', a local or a register */
+static void gen_modrm_addr(int op_reg, SValue *sv, int c)
+{
+    int r = sv->r & VT_VALMASK;
+    if (r == VT_LOCAL) {
+        gen_modrm(op_reg, VT_LOCAL, NULL, sv->c.i + c);
+    } else if (c == (char)c) {
+        g(0x40 | op_reg << 3 | r);
+        g(c);
+    } else {
+        g(0x80 | op_reg << 3 | r);
+        gen_le32(c);
+    }
+}
+
+/* copy 'size' bytes from the address on top of the stack to the one
+   below and pop both, or return 0 if memmove() is better */
+ST_FUNC int gen_struct_copy(int size, int align)
+{
+    int c, r;
+
+    if (size < 4 || size > 64)
+        return 0;
+    if (!is_local_addr(vtop - 1) && !is_local_addr(vtop))
+        gv2(RC_INT, RC_INT);
+    else if (!is_local_addr(vtop - 1)) {
+        vswap();
+        gv(RC_INT);
+        vswap();
+    } else if (!is_local_addr(vtop))
+        gv(RC_INT);
+    r = get_reg(RC_INT);
+    for (c = 0; c < size; c += 4) {
+        if (c + 4 > size)
+            c = size - 4; /* overlaps the previous one */
+        o(0x8b); /* mov c(src), r */
+        gen_modrm_addr(r, vtop, c);
+        o(0x89); /* mov r, c(dst) */
+        gen_modrm_addr(r, vtop - 1, c);
+    }
+    vpop();
+    vpop();
+    return 1;
+}
+
+/* zero 'size' bytes at the address on top of the stack and pop it,
+   or return 0 if memset() is better */
+ST_FUNC int gen_struct_clear(int size, int align)
+{
+    int c, n;
+
+    if (size > 64)
+        return 0;
+    if (!is_local_addr(vtop))
+        gv(RC_INT);
+    for (c = 0; c < size; c += n) {
+        n = size - c >= 4 ? 4 : size - c >= 2 ? 2 : 1;
+        if (n == 2)
+            o(0x66);
+        o(n == 1 ? 0xc6 : 0xc7); /* mov $0, c(dst) */
+        gen_modrm_addr(0, vtop, c);
+        if (n == 4)
+            gen_le32(0);
+        else if (n == 2)
+            gen_le16(0);
+        else
+            g(0);
+    }
+    vpop();
+    return 1;
+}
+
 /* end of X86 code generator */
 /*************************************************************/
 #endif
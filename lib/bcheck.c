@@ -71,6 +71,11 @@
 #define WAIT_SEM()
 #define POST_SEM()
 #define TRY_SEM()
+#define SHARD_LOCK_TYPE        int
+#define INIT_SHARD(s)
+#define EXIT_SHARD(s)
+#define WAIT_SHARD(s)
+#define POST_SHARD(s)
 #define HAVE_MEMALIGN          (0)
 #define MALLOC_REDIR           (0)
 #define HAVE_PTHREAD_CREATE    (0)
@@ -92,6 +97,11 @@ static CRITICAL_SECTION bounds_sem;
 #define WAIT_SEM()             EnterCriticalSection(&bounds_sem)
 #define POST_SEM()             LeaveCriticalSection(&bounds_sem)
 #define TRY_SEM()              TryEnterCriticalSection(&bounds_sem)
+#define SHARD_LOCK_TYPE        CRITICAL_SECTION
+#define INIT_SHARD(s)          InitializeCriticalSection(&(s)->lock)
+#define EXIT_SHARD(s)          DeleteCriticalSection(&(s)->lock)
+#define WAIT_SHARD(s)          EnterCriticalSection(&(s)->lock)
+#define POST_SHARD(s)          LeaveCriticalSection(&(s)->lock)
 #define HAVE_MEMALIGN          (0)
 #define MALLOC_REDIR           (0)
 #define HAVE_PTHREAD_CREATE    (0)
@@ -120,6 +130,11 @@ static dispatch_semaphore_t bounds_sem;
 #define WAIT_SEM()             if (use_sem) dispatch_semaphore_wait(bounds_sem, DISPATCH_TIME_FOREVER)
 #define POST_SEM()             if (use_sem) dispatch_semaphore_signal(bounds_sem)
 #define TRY_SEM()              if (use_sem) dispatch_semaphore_wait(bounds_sem, DISPATCH_TIME_NOW)
+#define SHARD_LOCK_TYPE        dispatch_semaphore_t
+#define INIT_SHARD(s)          (s)->lock = dispatch_semaphore_create(1)
+#define EXIT_SHARD(s)          dispatch_release(*(dispatch_object_t*)&(s)->lock)
+#define WAIT_SHARD(s)          if (use_sem) dispatch_semaphore_wait((s)->lock, DISPATCH_TIME_FOREVER)
+#define POST_SHARD(s)          if (use_sem) dispatch_semaphore_signal((s)->lock)
 #elif 0
 #include <semaphore.h>
 static sem_t bounds_sem;
@@ -130,6 +145,12 @@ static sem_t bounds_sem;
 #define POST_SEM()             if (use_sem) sem_post (&bounds_sem)
 #define TRY_SEM()              if (use_sem) while (sem_trywait (&bounds_sem) < 0 \
                                                    && errno == EINTR)
+#define SHARD_LOCK_TYPE        sem_t
+#define INIT_SHARD(s)          sem_init (&(s)->lock, 0, 1)
+#define EXIT_SHARD(s)          sem_destroy (&(s)->lock)
+#define WAIT_SHARD(s)          if (use_sem) while (sem_wait (&(s)->lock) < 0 \
+                                                   && errno == EINTR)
+#define POST_SHARD(s)          if (use_sem) sem_post (&(s)->lock)
 #elif 0
 static pthread_mutex_t bounds_mtx;
 #define INIT_SEM()             pthread_mutex_init (&bounds_mtx, NULL)
@@ -137,6 +158,11 @@ static pthread_mutex_t bounds_mtx;
 #define WAIT_SEM()             if (use_sem) pthread_mutex_lock (&bounds_mtx)
 #define POST_SEM()             if (use_sem) pthread_mutex_unlock (&bounds_mtx)
 #define TRY_SEM()              if (use_sem) pthread_mutex_trylock (&bounds_mtx)
+#define SHARD_LOCK_TYPE        pthread_mutex_t
+#define INIT_SHARD(s)          pthread_mutex_init (&(s)->lock, NULL)
+#define EXIT_SHARD(s)          pthread_mutex_destroy (&(s)->lock)
+#define WAIT_SHARD(s)          if (use_sem) pthread_mutex_lock (&(s)->lock)
+#define POST_SHARD(s)          if (use_sem) pthread_mutex_unlock (&(s)->lock)
 #else
 static pthread_spinlock_t bounds_spin;
 /* about 25% faster then semaphore. */
@@ -145,6 +171,11 @@ static pthread_spinlock_t bounds_spin;
 #define WAIT_SEM()             if (use_sem) pthread_spin_lock (&bounds_spin)
 #define POST_SEM()             if (use_sem) pthread_spin_unlock (&bounds_spin)
 #define TRY_SEM()              if (use_sem) pthread_spin_trylock (&bounds_spin)
+#define SHARD_LOCK_TYPE        pthread_spinlock_t
+#define INIT_SHARD(s)          pthread_spin_init (&(s)->lock, 0)
+#define EXIT_SHARD(s)          pthread_spin_destroy (&(s)->lock)
+#define WAIT_SHARD(s)          if (use_sem) pthread_spin_lock (&(s)->lock)
+#define POST_SHARD(s)          if (use_sem) pthread_spin_unlock (&(s)->lock)
 #endif
 #define HAVE_MEMALIGN          (1)
 #define MALLOC_REDIR           (1)
@@ -211,8 +242,22 @@ struct tree_node {
     size_t size;
     unsigned char type;
     unsigned char is_invalid; /* true if pointers outside region are invalid */
+    unsigned int version;     /* changed when deleted or invalidated */
 };
 
+/* The regions are spread over BOUND_SHARDS splay trees, selected by a
+   hash of 2MB address chunks, each with its own lock. A region is put
+   in every shard its range [start, start + size] touches, so a lookup
+   only needs the shard of the address. */
+#define BOUND_SHARD_SHIFT       (21)
+#define BOUND_SHARDS            (64)
+
+typedef struct bound_shard {
+    Tree *tree;
+    Tree *free_list;
+    SHARD_LOCK_TYPE lock;
+} __attribute__((aligned(64))) bound_shard;
+
 typedef struct alloca_list_struct {
     size_t fp;
     void *p;
@@ -251,8 +296,8 @@ typedef struct jmp_list_struct {
 #define BOUND_STATISTIC_SPLAY   (0)
 static Tree * splay (size_t addr, Tree *t);
 static Tree * splay_end (size_t addr, Tree *t);
-static Tree * splay_insert(size_t addr, size_t size, Tree * t);
-static Tree * splay_delete(size_t addr, Tree *t);
+static Tree * splay_insert(size_t addr, size_t size, bound_shard *s);
+static Tree * splay_delete(size_t addr, bound_shard *s);
 void splay_printtree(Tree * t, int d);
 
 /* external interface */
@@ -333,11 +378,16 @@ DLL_EXPORT void *__bound_calloc(size_t nmemb, size_t size);
 static unsigned int free_reuse_index;
 static void *free_reuse_list[FREE_REUSE_SIZE];
 
-static Tree *tree = NULL;
+static bound_shard bound_shards[BOUND_SHARDS];
 #define TREE_REUSE      (1)
-#if TREE_REUSE
-static Tree *tree_free_list;
-#endif
+
+#define BOUND_SHARD_OF(c) \
+    (&bound_shards[((c) ^ ((c) >> 6) ^ ((c) >> 12)) & (BOUND_SHARDS - 1)])
+#define BOUND_SHARD(addr) BOUND_SHARD_OF((addr) >> BOUND_SHARD_SHIFT)
+
+/* for bound_update() */
+#define BOUND_DELETE    (-1)
+#define BOUND_INVALID   (-2)
 static alloca_list_type *alloca_list;
 static jmp_list_type *jmp_list;
 
@@ -389,11 +439,22 @@ static pthread_key_t no_checking_key;
 static __thread int no_checking = 0;
 #define NO_CHECKING_GET()  no_checking
 #define NO_CHECKING_SET(v) no_checking = v 
+/* last region found by this thread, checked without any lock */
+#define BOUND_CACHE        (1)
+static __thread struct {
+    Tree *node;
+    size_t start;
+    size_t size;
+    unsigned int version;
+} bound_cache;
 #else
 static int no_checking = 0;
 #define NO_CHECKING_GET()  no_checking
 #define NO_CHECKING_SET(v) no_checking = v 
 #endif
+#ifndef BOUND_CACHE
+#define BOUND_CACHE        (0)
+#endif
 static char exec[100];
 
 #if BOUND_STATISTIC
@@ -529,11 +590,108 @@ void __bound_never_fatal (int neverfatal)
     fetch_and_add (&never_fatal, neverfatal);
 }
 
+/* add (type >= 0), delete or invalidate the region 'addr' in all the
+   shards its range touches */
+static void bound_update(size_t addr, size_t size, int type)
+{
+    size_t c = addr >> BOUND_SHARD_SHIFT;
+    size_t e = (addr + size) >> BOUND_SHARD_SHIFT;
+    unsigned long long done = 0;
+    bound_shard *s;
+    Tree *t;
+
+    for (;;) {
+        s = BOUND_SHARD_OF(c);
+        if (!(done & (1ULL << (s - bound_shards)))) {
+            done |= 1ULL << (s - bound_shards);
+            WAIT_SHARD (s);
+            if (type >= 0) {
+                t = splay_insert(addr, size, s);
+                if (t->start == addr)
+                    t->type = type;
+            }
+            else if (type == BOUND_DELETE)
+                splay_delete(addr, s);
+            else if (s->tree
+                     && (t = s->tree = splay(addr, s->tree))->start == addr) {
+                t->is_invalid = 1;
+                t->version++;
+            }
+            POST_SHARD (s);
+        }
+        if (c == e || done == ~0ULL)
+            break;
+        c++;
+    }
+}
+
+#define bound_insert(addr, size, type) bound_update(addr, size, type)
+
+/* delete the region starting at 'addr', return its size or 0 */
+static size_t bound_delete(size_t addr)
+{
+    bound_shard *s = BOUND_SHARD(addr);
+    size_t size = 0;
+
+    WAIT_SHARD (s);
+    if (s->tree && (s->tree = splay(addr, s->tree))->start == addr) {
+        size = s->tree->size;
+        splay_delete(addr, s);
+    }
+    POST_SHARD (s);
+    if ((addr + size) >> BOUND_SHARD_SHIFT != addr >> BOUND_SHARD_SHIFT)
+        bound_update(addr, size, BOUND_DELETE);
+    return size;
+}
+
+/* find the region containing 'addr' or ending at 'addr'. Return -1 if
+   there is none, else set its bounds and return 'is_invalid' */
+static int bound_find(size_t addr, size_t *start, size_t *size)
+{
+    bound_shard *s;
+    Tree *t;
+    int ret = -1;
+
+#if BOUND_CACHE
+    if (addr - bound_cache.start < bound_cache.size
+        && bound_cache.node->version == bound_cache.version) {
+        *start = bound_cache.start;
+        *size = bound_cache.size;
+        return 0;
+    }
+#endif
+    s = BOUND_SHARD(addr);
+    WAIT_SHARD (s);
+    if ((t = s->tree)) {
+        if (addr - t->start >= t->size) {
+            t = s->tree = splay (addr, t);
+            if (addr - t->start >= t->size)
+                t = s->tree = splay_end (addr, t);
+        }
+        if (addr - t->start <= t->size) {
+            *start = t->start;
+            *size = t->size;
+            ret = t->is_invalid;
+#if BOUND_CACHE
+            if (ret == 0 && addr - t->start < t->size) {
+                bound_cache.node = t;
+                bound_cache.start = t->start;
+                bound_cache.size = t->size;
+                bound_cache.version = t->version;
+            }
+#endif
+        }
+    }
+    POST_SHARD (s);
+    return ret;
+}
+
 /* return '(p + offset)' for pointer arithmetic (a pointer can reach
    the end of a region in this case */
 void * __bound_ptr_add(void *p, size_t offset)
 {
-    size_t addr = (size_t)p;
+    size_t addr = (size_t)p, start, size;
+    int ret;
 
     if (NO_CHECKING_GET())
         return p + offset;
@@ -541,38 +699,20 @@ void * __bound_ptr_add(void *p, size_t offset)
     dprintf(stderr, "%s, %s(): %p 0x%lx\n",
             __FILE__, __FUNCTION__, p, (unsigned long)offset);
 
-    WAIT_SEM ();
     INCR_COUNT(bound_ptr_add_count);
-    if (tree) {
-        addr -= tree->start;
-        if (addr >= tree->size) {
-            addr = (size_t)p;
-            tree = splay (addr, tree);
-            addr -= tree->start;
-        }
-        if (addr >= tree->size) {
-            addr = (size_t)p;
-            tree = splay_end (addr, tree);
-            addr -= tree->start;
-        }
-        if (addr <= tree->size) {
-            if (tree->is_invalid || addr + offset > tree->size) {
-                POST_SEM ();
-                if (print_warn_ptr_add)
-                    bound_warning("%p is outside of the region", p + offset);
-                if (never_fatal <= 0)
-                    return INVALID_POINTER; /* return an invalid pointer */
-                return p + offset;
-            }
-        }
-        else if (p) { /* Allow NULL + offset. offsetoff is using it. */
+    ret = bound_find(addr, &start, &size);
+    if (ret < 0) {
+        if (p) { /* Allow NULL + offset. offsetoff is using it. */
             INCR_COUNT(bound_not_found);
-            POST_SEM ();
             bound_not_found_warning (__FILE__, __FUNCTION__, p);
-            return p + offset;
         }
     }
-    POST_SEM ();
+    else if (ret || addr - start + offset > size) {
+        if (print_warn_ptr_add)
+            bound_warning("%p is outside of the region", p + offset);
+        if (never_fatal <= 0)
+            return INVALID_POINTER; /* return an invalid pointer */
+    }
     return p + offset;
 }
 
@@ -581,44 +721,25 @@ void * __bound_ptr_add(void *p, size_t offset)
 #define BOUND_PTR_INDIR(dsize)                                                 \
 void * __bound_ptr_indir ## dsize (void *p, size_t offset)                     \
 {                                                                              \
-    size_t addr = (size_t)p;                                                   \
+    size_t addr = (size_t)p, start, size;                                      \
+    int ret;                                                                   \
                                                                                \
     if (NO_CHECKING_GET())                                                     \
         return p + offset;                                                     \
                                                                                \
     dprintf(stderr, "%s, %s(): %p 0x%lx\n",                                    \
             __FILE__, __FUNCTION__, p, (unsigned long)offset);                 \
-    WAIT_SEM ();                                                               \
     INCR_COUNT(bound_ptr_indir ## dsize ## _count);                            \
-    if (tree) {                                                                \
-        addr -= tree->start;                                                   \
-        if (addr >= tree->size) {                                              \
-            addr = (size_t)p;                                                  \
-            tree = splay (addr, tree);                                         \
-            addr -= tree->start;                                               \
-        }                                                                      \
-        if (addr >= tree->size) {                                              \
-            addr = (size_t)p;                                                  \
-            tree = splay_end (addr, tree);                                     \
-            addr -= tree->start;                                               \
-        }                                                                      \
-        if (addr <= tree->size) {                                              \
-            if (tree->is_invalid || addr + offset + dsize > tree->size) {      \
-                POST_SEM ();                                                   \
-                bound_warning("%p is outside of the region", p + offset); \
-                if (never_fatal <= 0)                                          \
-                    return INVALID_POINTER; /* return an invalid pointer */    \
-                return p + offset;                                             \
-            }                                                                  \
-        }                                                                      \
-        else {                                                                 \
-            INCR_COUNT(bound_not_found);                                       \
-            POST_SEM ();                                                       \
-            bound_not_found_warning (__FILE__, __FUNCTION__, p);               \
-            return p + offset;                                                 \
-        }                                                                      \
+    ret = bound_find(addr, &start, &size);                                     \
+    if (ret < 0) {                                                             \
+        INCR_COUNT(bound_not_found);                                           \
+        bound_not_found_warning (__FILE__, __FUNCTION__, p);                   \
+    }                                                                          \
+    else if (ret || addr - start + offset + dsize > size) {                    \
+        bound_warning("%p is outside of the region", p + offset);              \
+        if (never_fatal <= 0)                                                  \
+            return INVALID_POINTER; /* return an invalid pointer */            \
     }                                                                          \
-    POST_SEM ();                                                               \
     return p + offset;                                                         \
 }
 
@@ -655,13 +776,11 @@ void FASTCALL __bound_local_new(void *p1)
     GET_CALLER_FP(fp);
     dprintf(stderr, "%s, %s(): p1=%p fp=%p\n",
             __FILE__, __FUNCTION__, p, (void *)fp);
-    WAIT_SEM ();
     while ((addr = p[0])) {
         INCR_COUNT(bound_local_new_count);
-        tree = splay_insert(addr + fp, p[1], tree);
+        bound_insert(addr + fp, p[1], TCC_TYPE_NONE);
         p += 2;
     }
-    POST_SEM ();
 #if BOUND_DEBUG
     if (print_calls) {
         p = p1;
@@ -685,57 +804,60 @@ void FASTCALL __bound_local_delete(void *p1)
     GET_CALLER_FP(fp);
     dprintf(stderr, "%s, %s(): p1=%p fp=%p\n",
             __FILE__, __FUNCTION__, p, (void *)fp);
-    WAIT_SEM ();
     while ((addr = p[0])) {
         INCR_COUNT(bound_local_delete_count);
-        tree = splay_delete(addr + fp, tree);
+        bound_delete(addr + fp);
         p += 2;
     }
-    if (alloca_list) {
-        alloca_list_type *last = NULL;
-        alloca_list_type *cur = alloca_list;
-
-        do {
-            if (cur->fp == fp) {
-                if (last)
-                    last->next = cur->next;
-                else
-                    alloca_list = cur->next;
-                tree = splay_delete ((size_t) cur->p, tree);
-                dprintf(stderr, "%s, %s(): remove alloca/vla %p\n",
-                        __FILE__, __FUNCTION__, cur->p);
-                BOUND_FREE (cur);
-                cur = last ? last->next : alloca_list;
-             }
-             else {
-                 last = cur;
-                 cur = cur->next;
-             }
-        } while (cur);
-    }
-    if (jmp_list) {
-        jmp_list_type *last = NULL;
-        jmp_list_type *cur = jmp_list;
-
-        do {
-            if (cur->fp == fp) {
-                if (last)
-                    last->next = cur->next;
-                else
-                    jmp_list = cur->next;
-                dprintf(stderr, "%s, %s(): remove setjmp %p\n",
-                       __FILE__, __FUNCTION__, cur->penv);
-                BOUND_FREE (cur);
-                cur = last ? last->next : jmp_list;
-            }
-            else {
-                last = cur;
-                cur = cur->next;
-            }
-        } while (cur);
-    }
+    /* only this thread adds entries with its own fp */
+    if (alloca_list || jmp_list) {
+        WAIT_SEM ();
+        if (alloca_list) {
+            alloca_list_type *last = NULL;
+            alloca_list_type *cur = alloca_list;
+
+            do {
+                if (cur->fp == fp) {
+                    if (last)
+                        last->next = cur->next;
+                    else
+                        alloca_list = cur->next;
+                    bound_delete ((size_t) cur->p);
+                    dprintf(stderr, "%s, %s(): remove alloca/vla %p\n",
+                            __FILE__, __FUNCTION__, cur->p);
+                    BOUND_FREE (cur);
+                    cur = last ? last->next : alloca_list;
+                 }
+                 else {
+                     last = cur;
+                     cur = cur->next;
+                 }
+            } while (cur);
+        }
+        if (jmp_list) {
+            jmp_list_type *last = NULL;
+            jmp_list_type *cur = jmp_list;
+
+            do {
+                if (cur->fp == fp) {
+                    if (last)
+                        last->next = cur->next;
+                    else
+                        jmp_list = cur->next;
+                    dprintf(stderr, "%s, %s(): remove setjmp %p\n",
+                           __FILE__, __FUNCTION__, cur->penv);
+                    BOUND_FREE (cur);
+                    cur = last ? last->next : jmp_list;
+                }
+                else {
+                    last = cur;
+                    cur = cur->next;
+                }
+            } while (cur);
+        }
 
-    POST_SEM ();
+        POST_SEM ();
+    }
 #if BOUND_DEBUG
     if (print_calls) {
         p = p1;
@@ -786,13 +908,13 @@ void __bound_new_region(void *p, size_t size)
                 last->next = cur->next;
             else
                 alloca_list = cur->next;
-            tree = splay_delete((size_t)cur->p, tree);
+            bound_delete((size_t)cur->p);
             break;
         }
         last = cur;
         cur = cur->next;
     }
-    tree = splay_insert((size_t)p, size, tree);
+    bound_insert((size_t)p, size, TCC_TYPE_NONE);
     if (new) {
         new->fp = fp;
         new->p = p;
@@ -848,6 +970,7 @@ static void __bound_long_jump(jmp_buf env, int val, int sig, const char *func)
     jmp_list_type *jl;
     void *e;
     BOUND_TID_TYPE tid;
+    int i;
 
     if (NO_CHECKING_GET() == 0) {
         e = (void *)env;
@@ -879,22 +1002,28 @@ static void __bound_long_jump(jmp_buf env, int val, int sig, const char *func)
                         cur = cur->next;
                     }
                 }
-                for (;;) {
-                    Tree *t = tree;
+                for (i = 0; i < BOUND_SHARDS; i++) {
+                    bound_shard *s = &bound_shards[i];
                     alloca_list_type *last;
                     alloca_list_type *cur;
+                    Tree *t;
+                    size_t addr;
 
+                    WAIT_SHARD (s);
+                    t = s->tree;
                     while (t && (t->start < start_fp || t->start > end_fp))
                         if (t->start < start_fp)
                             t = t->right;
                         else
                             t = t->left;
+                    addr = t ? t->start : 0;
+                    POST_SHARD (s);
                     if (t == NULL)
-                        break;
+                        continue;
                     last = NULL;
                     cur = alloca_list;
                     while (cur) {
-                         if ((size_t) cur->p == t->start) {
+                         if ((size_t) cur->p == addr) {
                              dprintf(stderr, "%s, %s(): remove alloca/vla %p\n",
                                      __FILE__, func, cur->p);
                              if (last)
@@ -908,8 +1037,14 @@ static void __bound_long_jump(jmp_buf env, int val, int sig, const char *func)
                          cur = cur->next;
                     }
                     dprintf(stderr, "%s, %s(): delete %p\n",
-                            __FILE__, func, (void *) t->start);
-                    tree = splay_delete(t->start, tree);
+                            __FILE__, func, (void *) addr);
+                    if (bound_delete(addr) == 0) {
+                        /* only a part of a region spanning several shards */
+                        WAIT_SHARD (s);
+                        splay_delete(addr, s);
+                        POST_SHARD (s);
+                    }
+                    i--;
                 }
                 break;
             }
@@ -941,13 +1076,13 @@ void __bound_siglongjmp(jmp_buf env, int val)
 
 void __bound_init(size_t *p, int mode)
 {
+    int i;
+
     dprintf(stderr, "%s, %s(): start %s\n", __FILE__, __FUNCTION__,
             mode < 0 ? "lazy" : mode == 0 ? "normal use" : "for -run");
 
-    if (inited) {
-        WAIT_SEM();
+    if (inited)
         goto add_bounds;
-    }
     inited = 1;
 
 #if HAVE_TLS_FUNC
@@ -968,6 +1103,8 @@ void __bound_init(size_t *p, int mode)
     never_fatal = getenv ("TCC_BOUNDS_NEVER_FATAL") != NULL;
 
     INIT_SEM ();
+    for (i = 0; i < BOUND_SHARDS; i++)
+        INIT_SHARD (&bound_shards[i]);
 
 #if MALLOC_REDIR
     {
@@ -1071,30 +1208,28 @@ void __bound_init(size_t *p, int mode)
     }
 #endif
 
-    WAIT_SEM ();
-
 #if HAVE_CTYPE
 #ifdef __APPLE__
-    tree = splay_insert((size_t) &_DefaultRuneLocale,
-                        sizeof (_DefaultRuneLocale), tree);
+    bound_insert((size_t) &_DefaultRuneLocale,
+                 sizeof (_DefaultRuneLocale), TCC_TYPE_NONE);
 #else
     /* XXX: Does not work if locale is changed */
-    tree = splay_insert((size_t) __ctype_b_loc(),
-                        sizeof (unsigned short *), tree);
-    tree = splay_insert((size_t) (*__ctype_b_loc() - 128),
-                        384 * sizeof (unsigned short), tree);
-    tree = splay_insert((size_t) __ctype_tolower_loc(),
-                        sizeof (__int32_t *), tree);
-    tree = splay_insert((size_t) (*__ctype_tolower_loc() - 128),
-                        384 * sizeof (__int32_t), tree);
-    tree = splay_insert((size_t) __ctype_toupper_loc(),
-                        sizeof (__int32_t *), tree);
-    tree = splay_insert((size_t) (*__ctype_toupper_loc() - 128),
-                        384 * sizeof (__int32_t), tree);
+    bound_insert((size_t) __ctype_b_loc(),
+                 sizeof (unsigned short *), TCC_TYPE_NONE);
+    bound_insert((size_t) (*__ctype_b_loc() - 128),
+                 384 * sizeof (unsigned short), TCC_TYPE_NONE);
+    bound_insert((size_t) __ctype_tolower_loc(),
+                 sizeof (__int32_t *), TCC_TYPE_NONE);
+    bound_insert((size_t) (*__ctype_tolower_loc() - 128),
+                 384 * sizeof (__int32_t), TCC_TYPE_NONE);
+    bound_insert((size_t) __ctype_toupper_loc(),
+                 sizeof (__int32_t *), TCC_TYPE_NONE);
+    bound_insert((size_t) (*__ctype_toupper_loc() - 128),
+                 384 * sizeof (__int32_t), TCC_TYPE_NONE);
 #endif
 #endif
 #if HAVE_ERRNO
-    tree = splay_insert((size_t) (&errno), sizeof (int), tree);
+    bound_insert((size_t) (&errno), sizeof (int), TCC_TYPE_NONE);
 #endif
 
 add_bounds:
@@ -1103,7 +1238,7 @@ add_bounds:
 
     /* add all static bound check values */
     while (p[0] != 0) {
-        tree = splay_insert(p[0], p[1], tree);
+        bound_insert(p[0], p[1], TCC_TYPE_NONE);
 #if BOUND_DEBUG
         if (print_calls) {
             dprintf(stderr, "%s, %s(): static var %p 0x%lx\n",
@@ -1115,7 +1250,6 @@ add_bounds:
     }
 no_bounds:
 
-    POST_SEM ();
     NO_CHECKING_SET(0);
     dprintf(stderr, "%s, %s(): end\n\n", __FILE__, __FUNCTION__);
 }
@@ -1130,11 +1264,11 @@ __bound_main_arg(int argc, char **argv, char **envp)
     if (argc && argv) {
         int i;
 
-        WAIT_SEM ();
         for (i = 0; i < argc; i++)
-            tree = splay_insert((size_t) argv[i], strlen (argv[i]) + 1, tree);
-        tree = splay_insert((size_t) argv, (argc + 1) * sizeof(char *), tree);
-        POST_SEM ();
+            bound_insert((size_t) argv[i], strlen (argv[i]) + 1,
+                  TCC_TYPE_NONE);
+        bound_insert((size_t) argv, (argc + 1) * sizeof(char *),
+                     TCC_TYPE_NONE);
 #if BOUND_DEBUG
         if (print_calls) {
             for (i = 0; i < argc; i++)
@@ -1151,13 +1285,12 @@ __bound_main_arg(int argc, char **argv, char **envp)
     if (envp && *envp) {
         char **p = envp;
 
-        WAIT_SEM ();
         while (*p) {
-            tree = splay_insert((size_t) *p, strlen (*p) + 1, tree);
+            bound_insert((size_t) *p, strlen (*p) + 1, TCC_TYPE_NONE);
             ++p;
         }
-        tree = splay_insert((size_t) envp, (++p - envp) * sizeof(char *), tree);
-        POST_SEM ();
+        bound_insert((size_t) envp, (++p - envp) * sizeof(char *),
+                     TCC_TYPE_NONE);
 #if BOUND_DEBUG
         if (print_calls) {
             p = envp;
@@ -1200,7 +1333,7 @@ void __attribute__((destructor)) __bound_exit(void)
         while (alloca_list) {
             alloca_list_type *next = alloca_list->next;
 
-            tree = splay_delete ((size_t) alloca_list->p, tree);
+            bound_delete ((size_t) alloca_list->p);
             BOUND_FREE (alloca_list);
             alloca_list = next;
         }
@@ -1212,24 +1345,32 @@ void __attribute__((destructor)) __bound_exit(void)
         }
         for (i = 0; i < FREE_REUSE_SIZE; i++) {
             if (free_reuse_list[i]) {
-                tree = splay_delete ((size_t) free_reuse_list[i], tree);
+                bound_delete ((size_t) free_reuse_list[i]);
                 BOUND_FREE (free_reuse_list[i]);
              }
         }
-        while (tree) {
-            if (print_heap && tree->type != 0)
-                fprintf (stderr, "%s, %s(): %s found size %lu\n",
-                         __FILE__, __FUNCTION__, alloc_type[tree->type],
-                         (unsigned long) tree->size);
-            tree = splay_delete (tree->start, tree);
-        }
+        for (i = 0; i < BOUND_SHARDS; i++) {
+            bound_shard *s = &bound_shards[i];
+            Tree *t;
+
+            WAIT_SHARD (s);
+            while ((t = s->tree)) {
+                /* regions spanning several shards are printed once */
+                if (print_heap && t->type != 0 && BOUND_SHARD(t->start) == s)
+                    fprintf (stderr, "%s, %s(): %s found size %lu\n",
+                             __FILE__, __FUNCTION__, alloc_type[t->type],
+                             (unsigned long) t->size);
+                splay_delete (t->start, s);
+            }
 #if TREE_REUSE
-        while (tree_free_list) {
-            Tree *next = tree_free_list->left;
-            BOUND_FREE (tree_free_list);
-            tree_free_list = next;
-        }
+            while ((t = s->free_list)) {
+                s->free_list = t->left;
+                BOUND_FREE (t);
+            }
 #endif
+            POST_SHARD (s);
+            EXIT_SHARD (s);
+        }
         POST_SEM ();
         EXIT_SEM ();
 #if HAVE_TLS_FUNC
@@ -1292,9 +1433,8 @@ void __bound_exit_dll(size_t *p)
     dprintf(stderr, "%s, %s()\n", __FILE__, __FUNCTION__);
 
     if (p) {
-        WAIT_SEM ();
 	while (p[0] != 0) {
-	    tree = splay_delete(p[0], tree);
+	    bound_delete(p[0]);
 #if BOUND_DEBUG
             if (print_calls) {
                 dprintf(stderr, "%s, %s(): remove static var %p 0x%lx\n",
@@ -1304,7 +1444,6 @@ void __bound_exit_dll(size_t *p)
 #endif
 	    p += 2;
 	}
-        POST_SEM ();
     }
 }
 
@@ -1464,12 +1603,22 @@ pid_t fork(void)
 {
     pid_t retval;
 
+    int i;
+
     WAIT_SEM();
+    for (i = 0; i < BOUND_SHARDS; i++)
+        WAIT_SHARD (&bound_shards[i]);
     retval = (*fork_redir)();
-    if (retval == 0)
+    if (retval == 0) {
         INIT_SEM();
-    else
+        for (i = 0; i < BOUND_SHARDS; i++)
+            INIT_SHARD (&bound_shards[i]);
+    }
+    else {
+        for (i = 0; i < BOUND_SHARDS; i++)
+            POST_SHARD (&bound_shards[i]);
         POST_SEM();
+    }
     return retval;
 }
 #endif
@@ -1505,15 +1654,12 @@ void *__bound_malloc(size_t size, const void *caller)
             __FILE__, __FUNCTION__, ptr, (unsigned long)size);
     
     if (inited && NO_CHECKING_GET() == 0) {
-        WAIT_SEM ();
         INCR_COUNT(bound_malloc_count);
 
         if (ptr) {
-            tree = splay_insert ((size_t) ptr, size ? size : size + 1, tree);
-            if (tree && tree->start == (size_t) ptr)
-                tree->type = TCC_TYPE_MALLOC;
+            bound_insert((size_t) ptr, size ? size : size + 1,
+                  TCC_TYPE_MALLOC);
         }
-        POST_SEM ();
     }
     return ptr;
 }
@@ -1544,15 +1690,12 @@ void *__bound_memalign(size_t align, size_t size, const void *caller)
             __FILE__, __FUNCTION__, ptr, (unsigned long)size);
 
     if (NO_CHECKING_GET() == 0) {
-        WAIT_SEM ();
         INCR_COUNT(bound_memalign_count);
 
         if (ptr) {
-            tree = splay_insert((size_t) ptr, size ? size : size + 1, tree);
-            if (tree && tree->start == (size_t) ptr)
-                tree->type = TCC_TYPE_MEMALIGN;
+            bound_insert((size_t) ptr, size ? size : size + 1,
+                  TCC_TYPE_MEMALIGN);
         }
-        POST_SEM ();
     }
     return ptr;
 }
@@ -1563,10 +1706,12 @@ void free(void *ptr)
 void __bound_free(void *ptr, const void *caller)
 #endif
 {
-    size_t addr = (size_t) ptr;
+    size_t addr = (size_t) ptr, size = 0;
+    bound_shard *s;
     void *p;
+    int ret = -1;
 
-    if (ptr == NULL || tree == NULL
+    if (ptr == NULL || inited == 0
 #if MALLOC_REDIR
         || ((unsigned char *) ptr >= &initial_pool[0] &&
             (unsigned char *) ptr < &initial_pool[sizeof(initial_pool)])
@@ -1577,25 +1722,33 @@ void __bound_free(void *ptr, const void *caller)
     dprintf(stderr, "%s, %s(): %p\n", __FILE__, __FUNCTION__, ptr);
 
     if (inited && NO_CHECKING_GET() == 0) {
-        WAIT_SEM ();
         INCR_COUNT(bound_free_count);
-        tree = splay (addr, tree);
-        if (tree->start == addr) {
-            if (tree->is_invalid) {
-                POST_SEM ();
-                bound_error("freeing invalid region");
-                return;
-            }
-            tree->is_invalid = 1;
-            memset (ptr, 0x5a, tree->size);
+        s = BOUND_SHARD(addr);
+        WAIT_SHARD (s);
+        if (s->tree && (s->tree = splay (addr, s->tree))->start == addr) {
+            size = s->tree->size;
+            ret = s->tree->is_invalid;
+            s->tree->is_invalid = 1;
+            s->tree->version++;
+        }
+        POST_SHARD (s);
+        if (ret > 0) {
+            bound_error("freeing invalid region");
+            return;
+        }
+        if (ret == 0) {
+            if ((addr + size) >> BOUND_SHARD_SHIFT != addr >> BOUND_SHARD_SHIFT)
+                bound_update(addr, size, BOUND_INVALID);
+            memset (ptr, 0x5a, size);
+            WAIT_SEM ();
             p = free_reuse_list[free_reuse_index];
             free_reuse_list[free_reuse_index] = ptr;
             free_reuse_index = (free_reuse_index + 1) % FREE_REUSE_SIZE;
+            POST_SEM ();
             if (p)
-                tree = splay_delete((size_t)p, tree);
+                bound_delete((size_t)p);
             ptr = p;
         }
-        POST_SEM ();
     }
     BOUND_FREE (ptr);
 }
@@ -1622,17 +1775,14 @@ void *__bound_realloc(void *ptr, size_t size, const void *caller)
             __FILE__, __FUNCTION__, new_ptr, (unsigned long)size);
 
     if (NO_CHECKING_GET() == 0) {
-        WAIT_SEM ();
         INCR_COUNT(bound_realloc_count);
 
         if (ptr)
-            tree = splay_delete ((size_t) ptr, tree);
+            bound_delete ((size_t) ptr);
         if (new_ptr) {
-            tree = splay_insert ((size_t) new_ptr, size ? size : size + 1, tree);
-            if (tree && tree->start == (size_t) new_ptr)
-                tree->type = TCC_TYPE_REALLOC;
+            bound_insert((size_t) new_ptr, size ? size : size + 1,
+                  TCC_TYPE_REALLOC);
         }
-        POST_SEM ();
     }
     return new_ptr;
 }
@@ -1669,12 +1819,9 @@ void *__bound_calloc(size_t nmemb, size_t size)
     if (ptr) {
         memset (ptr, 0, size);
         if (NO_CHECKING_GET() == 0) {
-            WAIT_SEM ();
             INCR_COUNT(bound_calloc_count);
-            tree = splay_insert ((size_t) ptr, size ? size : size + 1, tree);
-            if (tree && tree->start == (size_t) ptr)
-                tree->type = TCC_TYPE_CALLOC;
-            POST_SEM ();
+            bound_insert((size_t) ptr, size ? size : size + 1,
+                  TCC_TYPE_CALLOC);
         }
     }
     return ptr;
@@ -1690,10 +1837,8 @@ void *__bound_mmap (void *start, size_t size, int prot,
             __FILE__, __FUNCTION__, start, (unsigned long)size);
     result = mmap (start, size, prot, flags, fd, offset);
     if (result && NO_CHECKING_GET() == 0) {
-        WAIT_SEM ();
         INCR_COUNT(bound_mmap_count);
-        tree = splay_insert((size_t)result, size, tree);
-        POST_SEM ();
+        bound_insert((size_t)result, size, TCC_TYPE_NONE);
     }
     return result;
 }
@@ -1705,10 +1850,8 @@ int __bound_munmap (void *start, size_t size)
     dprintf(stderr, "%s, %s(): %p, 0x%lx\n",
             __FILE__, __FUNCTION__, start, (unsigned long)size);
     if (start && NO_CHECKING_GET() == 0) {
-        WAIT_SEM ();
         INCR_COUNT(bound_munmap_count);
-        tree = splay_delete ((size_t) start, tree);
-        POST_SEM ();
+        bound_delete ((size_t) start);
     }
     result = munmap (start, size);
     return result;
@@ -2020,11 +2163,7 @@ char *__bound_strdup(const char *s)
             __FILE__, __FUNCTION__, new, (unsigned long)(p -s));
     if (new) {
         if (NO_CHECKING_GET() == 0 && no_strdup == 0) {
-            WAIT_SEM ();
-            tree = splay_insert((size_t)new, p - s, tree);
-            if (tree && tree->start == (size_t) new)
-                tree->type = TCC_TYPE_STRDUP;
-            POST_SEM ();
+            bound_insert((size_t)new, p - s, TCC_TYPE_STRDUP);
         }
         memcpy (new, s, p - s);
     }
@@ -2187,23 +2326,23 @@ static Tree * splay_end (size_t addr, Tree *t)
     return t;
 }
 
-static Tree * splay_insert(size_t addr, size_t size, Tree * t)
-/* Insert key start into the tree t, if it is not already there. */
-/* Return a pointer to the resulting tree.                       */
+static Tree * splay_insert(size_t addr, size_t size, bound_shard *s)
+/* Insert key start into the tree of s, if it is not already there. */
+/* Return a pointer to the resulting tree.                           */
 {
-    Tree * new;
+    Tree * new, * t = s->tree;
 
     INCR_COUNT_SPLAY(bound_splay_insert);
     if (t != NULL) {
         t = splay(addr,t);
         if (compare(addr, t->start, t->size)==0) {
-            return t;  /* it's already there */
+            return s->tree = t;  /* it's already there */
         }
     }
 #if TREE_REUSE
-    if (tree_free_list) {
-          new = tree_free_list;
-          tree_free_list = new->left;
+    if (s->free_list) {
+          new = s->free_list;
+          s->free_list = new->left;
     }
     else
 #endif
@@ -2230,17 +2369,17 @@ static Tree * splay_insert(size_t addr, size_t size, Tree * t)
         new->type = TCC_TYPE_NONE;
         new->is_invalid = 0;
     }
-    return new;
+    return s->tree = new;
 }
 
 #define compare_destroy(start,tstart) (start < tstart ? -1 : \
                                        start > tstart  ? 1 : 0)
 
-static Tree * splay_delete(size_t addr, Tree *t)
-/* Deletes addr from the tree if it's there.               */
+static Tree * splay_delete(size_t addr, bound_shard *s)
+/* Deletes addr from the tree of s if it's there.          */
 /* Return a pointer to the resulting tree.                 */
 {
-    Tree * x;
+    Tree * x, * t = s->tree;
 
     INCR_COUNT_SPLAY(bound_splay_delete);
     if (t==NULL) return NULL;
@@ -2252,15 +2391,16 @@ static Tree * splay_delete(size_t addr, Tree *t)
             x = splay(addr, t->left);
             x->right = t->right;
         }
+        t->version++;
 #if TREE_REUSE
-        t->left = tree_free_list;
-        tree_free_list = t;
+        t->left = s->free_list;
+        s->free_list = t;
 #else
         BOUND_FREE(t);
 #endif
-        return x;
+        return s->tree = x;
     } else {
-        return t;                                      /* It wasn't there */
+        return s->tree = t;                            /* It wasn't there */
     }
 }
 
@@ -22,8 +22,19 @@
      \0
    \0
    executable/so file name \0
+   64bit stamp of the code
+
+   With -ftest-coverage=thread the flag is 0xfe and the counter holds
+   the address of TCOV_SHARDS counters, 64 bytes apart, one for each
+   group of threads.  They are summed up before the data is stored.
+
+   A .tcovb file has the header "TCOVBIN\n", 32bit runs, 32bit size
+   and then the section up to the end of the stamp.  A file with another
+   stamp or layout is from a different build and is written anew.
  */
 
+#define TCOV_SHARDS 16
+
 typedef struct tcov_line {
     unsigned int fline;
     unsigned int lline;
@@ -46,6 +57,7 @@ typedef struct tcov_file {
     struct tcov_file *next;
 } tcov_file;
 
+#ifndef TCOV_TOOL
 static FILE *open_tcov_file (char *cov_filename)
 {
     int fd;
@@ -75,6 +87,7 @@ static FILE *open_tcov_file (char *cov_filename)
 
     return fdopen (fd, "r+");
 }
+#endif
 
 static unsigned long long get_value(unsigned char *p, int size)
 {
@@ -86,6 +99,34 @@ static unsigned long long get_value(unsigned char *p, int size)
     return value;
 }
 
+static void put_value(unsigned char *p, unsigned long long value, int size)
+{
+    while (size--)
+        *p++ = value, value >>= 8;
+}
+
+/* call fn for each line entry */
+static void walk_lines (unsigned char *start,
+                        void (*fn)(unsigned char *, void *), void *arg)
+{
+    unsigned char *p = start + 4;
+
+    while (*p) {
+	p += strlen ((char *)p) + 1;
+	while (*p) {
+	    p += strlen ((char *)p) + 1;
+	    p += -(p - start) & 7;
+	    p += 8;
+	    while (*p) {
+		fn (p, arg);
+		p += 16;
+	    }
+	    p++;
+	}
+	p++;
+    }
+}
+
 static int sort_func (const void *p, const void *q)
 {
     const tcov_function *pp = (const tcov_function *) p;
@@ -109,7 +150,7 @@ static int sort_line (const void *p, const void *q)
 /* sort to let inline functions work */
 static tcov_file *sort_test_coverage (unsigned char *p)
 {
-    int i, j, k;
+    int i;
     unsigned char *start = p;
     tcov_file *file = NULL;
     tcov_file *nfile;
@@ -150,7 +191,7 @@ static tcov_file *sort_test_coverage (unsigned char *p)
 	while (*p) {
 	    int i;
 	    char *function = (char *)p;
-	    tcov_function *func;
+	    tcov_function *func = NULL;
 
 	    p += strlen (function) + 1;
 	    p += -(p - start) & 7;
@@ -214,6 +255,98 @@ static tcov_file *sort_test_coverage (unsigned char *p)
     return file;
 }
 
+static void free_test_coverage (tcov_file *file)
+{
+    int i;
+    tcov_file *nfile;
+
+    while (file) {
+        for (i = 0; i < file->n_func; i++)
+	    free (file->func[i].line);
+	free (file->func);
+	nfile = file;
+	file = file->next;
+	free (nfile);
+    }
+}
+
+typedef struct tcov_merge {
+    unsigned char *start, *old;
+    int add;
+} tcov_merge;
+
+static void merge_line (unsigned char *p, void *arg)
+{
+    tcov_merge *m = arg;
+    unsigned char *q = m->old + (p - m->start) + 8;
+
+    if (m->add)
+	put_value (q, get_value (q, 8) + get_value (p + 8, 8), 8);
+    else
+	put_value (p + 8, get_value (q, 8), 8);
+}
+
+/* add the counters of 'p' to 'old' if both are from the same program */
+static int merge_tcov_binary (unsigned char *old, unsigned char *p,
+			      unsigned int size)
+{
+    tcov_merge m;
+    unsigned char *tmp;
+    int ret = -1;
+
+    if ((tmp = malloc (size)) == NULL)
+	return ret;
+    memcpy (tmp, p, size);
+    m.start = tmp, m.old = old, m.add = 0;
+    walk_lines (tmp, merge_line, &m);
+    if (memcmp (tmp, old, size) == 0) {
+	m.start = p, m.add = 1;
+	walk_lines (p, merge_line, &m);
+	ret = 0;
+    }
+    free (tmp);
+    return ret;
+}
+
+static unsigned char *read_tcov_binary (FILE *fp, unsigned int *pruns,
+					unsigned int *psize)
+{
+    unsigned char hdr[16], *p;
+
+    if (fread (hdr, 1, 16, fp) != 16 || memcmp (hdr, "TCOVBIN\n", 8))
+	return NULL;
+    *pruns = get_value (hdr + 8, 4);
+    *psize = get_value (hdr + 12, 4);
+    if ((p = malloc (*psize + 1)) == NULL)
+	return NULL;
+    if (fread (p, 1, *psize, fp) != *psize || *psize < 5
+	|| get_value (p, 4) >= *psize) {
+	free (p);
+	return NULL;
+    }
+    p[*psize] = 0;
+    return p;
+}
+
+static void write_tcov_binary (FILE *fp, unsigned char *p,
+			       unsigned int size, unsigned int runs)
+{
+    unsigned char hdr[16];
+
+    memcpy (hdr, "TCOVBIN\n", 8);
+    put_value (hdr + 8, runs, 4);
+    put_value (hdr + 12, size, 4);
+    fwrite (hdr, 1, 16, fp);
+    fwrite (p, 1, size, fp);
+    fflush (fp);
+#ifndef _WIN32
+    if (ftruncate (fileno (fp), 16 + size)) {}
+#else
+    _chsize (_fileno (fp), 16 + size);
+#endif
+}
+
+#ifndef TCOV_TOOL
 /* merge with previous tcov file */
 static void merge_test_coverage (tcov_file *file, FILE *fp,
 				 unsigned int *pruns)
@@ -267,31 +400,20 @@ static void merge_test_coverage (tcov_file *file, FILE *fp,
 	file = file->next;
     }
 }
+#endif
 
-/* store tcov data in file */
-void __store_test_coverage (unsigned char * p)
+/* write the text report */
+static void write_test_coverage (tcov_file *file, FILE *fp,
+				 const char *cov_filename, unsigned int runs)
 {
     int i, j;
     unsigned int files;
     unsigned int funcs;
     unsigned int blocks;
     unsigned int blocks_run;
-    unsigned int runs;
-    char *cov_filename = (char *)p + get_value (p, 4);
-    FILE *fp;
-    char *q;
-    tcov_file *file;
     tcov_file *nfile;
     tcov_function *func;
 
-    fp = open_tcov_file (cov_filename);
-    if (fp == NULL) {
-	fprintf (stderr, "Cannot create coverage file: %s\n", cov_filename);
-	return;
-    }
-    file = sort_test_coverage (p);
-    merge_test_coverage (file, fp, &runs);
-    fseek (fp, 0, SEEK_SET);
     fprintf (fp, "        -:    0:Runs:%u\n", runs);
     files = 0;
     funcs = 0;
@@ -414,15 +536,63 @@ void __store_test_coverage (unsigned char * p)
 next:
 	nfile = nfile->next;
     }
-    while (file) {
-        for (i = 0; i < file->n_func; i++) {
-	    func = &file->func[i];
-	    free (func->line);
-        }
-	free (file->func);
-	nfile = file;
-	file = file->next;
-	free (nfile);
+}
+
+#ifndef TCOV_TOOL
+/* size of the section data up to the end of the stamp */
+static unsigned int tcov_size (unsigned char *p)
+{
+    unsigned int n = get_value (p, 4);
+
+    return n + strlen ((char *)p + n) + 1 + 8;
+}
+
+static void fold_line (unsigned char *p, void *arg)
+{
+    unsigned long long *c, count = 0;
+    int i;
+
+    if (p[0] != 0xfe)
+	return;
+    c = (unsigned long long *)(size_t)get_value (p + 8, sizeof (void *));
+    for (i = 0; i < TCOV_SHARDS; i++)
+	count += c[i * 8];
+    put_value (p + 8, count, 8);
+    p[0] = 0xff;
+}
+
+/* store tcov data in file */
+void __store_test_coverage (unsigned char * p)
+{
+    unsigned int runs;
+    char *cov_filename = (char *)p + get_value (p, 4);
+    size_t len = strlen (cov_filename);
+    FILE *fp;
+    tcov_file *file;
+
+    walk_lines (p, fold_line, NULL);
+    fp = open_tcov_file (cov_filename);
+    if (fp == NULL) {
+	fprintf (stderr, "Cannot create coverage file: %s\n", cov_filename);
+	return;
+    }
+    if (len > 6 && strcmp (cov_filename + len - 6, ".tcovb") == 0) {
+	unsigned int size = tcov_size (p), osize;
+	unsigned char *old = read_tcov_binary (fp, &runs, &osize);
+
+	fseek (fp, 0, SEEK_SET);
+	if (old && osize == size && merge_tcov_binary (old, p, size) == 0)
+	    write_tcov_binary (fp, old, size, runs + 1);
+	else
+	    write_tcov_binary (fp, p, size, 1);
+	free (old);
+    } else {
+	file = sort_test_coverage (p);
+	merge_test_coverage (file, fp, &runs);
+	fseek (fp, 0, SEEK_SET);
+	write_test_coverage (file, fp, cov_filename, runs);
+	free_test_coverage (file);
     }
     fclose (fp);
 }
+#endif
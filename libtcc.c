@@ -68,7 +68,9 @@
 
 /* XXX: get rid of this ASAP (or maybe not) */
 ST_DATA struct TCCState *tcc_state;
+#if !CONFIG_TCC_TLS
 TCC_SEM(static tcc_compile_sem);
+#endif
 /* an array of pointers to memory to be free'd after errors */
 ST_DATA void** stk_data;
 ST_DATA int nb_stk_data;
@@ -127,7 +129,9 @@ PUB_FUNC void tcc_enter_state(TCCState *s1)
 {
     if (s1->error_set_jmp_enabled)
         return;
+#if !CONFIG_TCC_TLS
     WAIT_SEM(&tcc_compile_sem);
+#endif
     tcc_state = s1;
 }
 
@@ -136,7 +140,9 @@ PUB_FUNC void tcc_exit_state(TCCState *s1)
     if (s1->error_set_jmp_enabled)
         return;
     tcc_state = NULL;
+#if !CONFIG_TCC_TLS
     POST_SEM(&tcc_compile_sem);
+#endif
 }
 
 /********************************************************/
@@ -674,7 +680,7 @@ ST_FUNC void tcc_open_bf(TCCState *s1, const char *filename, int initlen)
     BufferedFile *bf;
     int buflen = initlen ? initlen : IO_BUF_SIZE;
 
-    bf = tcc_mallocz(sizeof(BufferedFile) + buflen);
+    bf = tcc_mallocz(sizeof(BufferedFile) + buflen + IO_BUF_PAD);
     bf->buf_ptr = bf->buffer;
     bf->buf_end = bf->buffer + initlen;
     bf->buf_end[0] = CH_EOB; /* put eob symbol */
@@ -700,6 +706,10 @@ ST_FUNC void tcc_close(void)
         close(bf->fd);
         total_lines += bf->line_num - 1;
     }
+#ifndef _WIN32
+    if (bf->map)
+        munmap(bf->map, bf->map_size);
+#endif
     if (bf->true_filename != bf->filename)
         tcc_free(bf->true_filename);
     file = bf->prev;
@@ -720,28 +730,70 @@ static int _tcc_open(TCCState *s1, const char *filename)
     return fd;
 }
 
+/* read from 'fd'.  Large files are mapped as a whole (plus room for
+   the CH_EOB sentinel and IO_BUF_PAD) so that the lexer never needs
+   to refill. */
+static void tcc_open_fd(TCCState *s1, const char *filename, int fd)
+{
+    tcc_open_bf(s1, filename, 0);
+    file->fd = fd;
+#ifndef _WIN32
+    if (fd > 0) {
+        long size = lseek(fd, 0, SEEK_END), pg = sysconf(_SC_PAGESIZE);
+        unsigned long n;
+        uint8_t *p;
+
+        lseek(fd, 0, SEEK_SET);
+        if (size < 64 * 1024)
+            return;
+        n = (size + IO_BUF_PAD + pg) & -pg;
+        p = mmap(NULL, n, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return;
+        if (mmap(p, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            munmap(p, n);
+            return;
+        }
+        file->map = file->buf_ptr = p;
+        file->map_size = n;
+        file->buf_end = p + size;
+        *file->buf_end = CH_EOB;
+        total_bytes += size;
+    }
+#endif
+}
+
 ST_FUNC int tcc_open(TCCState *s1, const char *filename)
 {
     int fd = _tcc_open(s1, filename);
     if (fd < 0)
         return -1;
-    tcc_open_bf(s1, filename, 0);
-    file->fd = fd;
+    tcc_open_fd(s1, filename, fd);
     return 0;
 }
 
 /* compile the file opened in 'file'. Return non zero if errors. */
 static int tcc_compile(TCCState *s1, int filetype, const char *str, int fd)
 {
+    int ph;
+
     /* Here we enter the code section where we use the global variables for
        parsing and code generation (tccpp.c, tccgen.c, <target>-gen.c).
-       Other threads need to wait until we're done.
-
-       Alternatively we could use thread local storage for those global
-       variables, which may or may not have advantages */
+       With CONFIG_TCC_TLS those are thread local and other threads may
+       compile at the same time, otherwise they need to wait until we're
+       done. */
 
+#ifdef TCC_IS_NATIVE
+    if (s1->run_ptr && !s1->run_delta)
+        return tcc_error_noabort("cannot add code to this relocated state");
+#endif
     tcc_enter_state(s1);
     s1->error_set_jmp_enabled = 1;
+    /* with -E, what is not lexing or preprocessing is writing output */
+    ph = PROF_SWITCH(s1, s1->output_type == TCC_OUTPUT_PREPROCESS
+                         ? TP_OUTPUT : TP_GEN);
 
     if (setjmp(s1->error_jmp_buf) == 0) {
         s1->nb_errors = 0;
@@ -751,9 +803,10 @@ static int tcc_compile(TCCState *s1, int filetype, const char *str, int fd)
             tcc_open_bf(s1, "<string>", len);
             memcpy(file->buffer, str, len);
         } else {
-            tcc_open_bf(s1, str, 0);
-            file->fd = fd;
+            tcc_open_fd(s1, str, fd);
         }
+        if (s1->prof)
+            tcc_prof_file(s1, 1);
 
         preprocess_start(s1, filetype);
         tccgen_init(s1);
@@ -770,8 +823,15 @@ static int tcc_compile(TCCState *s1, int filetype, const char *str, int fd)
             tccelf_end_file(s1);
         }
     }
+    if (s1->prof)
+        tcc_prof_end(s1);
     tccgen_finish(s1);
     preprocess_end(s1);
+#ifdef TCC_IS_NATIVE
+    if (s1->run_delta)
+        tccelf_end_delta(s1);
+#endif
+    PROF_SWITCH(s1, ph);
     s1->error_set_jmp_enabled = 0;
     tcc_exit_state(s1);
     return s1->nb_errors != 0 ? -1 : 0;
@@ -836,6 +896,7 @@ LIBTCCAPI TCCState *tcc_new(void)
     s->enable_new_dtags = 1;
 #endif
     s->ppfp = stdout;
+    s->time_trace_granularity = 500;
     /* might be used in error() before preprocess_start() */
     s->include_stack_ptr = s->include_stack;
 
@@ -845,6 +906,10 @@ LIBTCCAPI TCCState *tcc_new(void)
 
 LIBTCCAPI void tcc_delete(TCCState *s1)
 {
+    /* print -ftime-report, write -ftime-trace */
+    if (s1->prof)
+        tcc_prof_delete(s1);
+
     /* free sections */
     tccelf_delete(s1);
 
@@ -865,6 +930,7 @@ LIBTCCAPI void tcc_delete(TCCState *s1)
     tcc_free(s1->mapfile);
     tcc_free(s1->outfile);
     tcc_free(s1->deps_outfile);
+    tcc_free(s1->time_trace_file);
 #if defined TCC_TARGET_MACHO
     tcc_free(s1->install_name);
 #endif
@@ -874,6 +940,7 @@ LIBTCCAPI void tcc_delete(TCCState *s1)
     dynarray_reset(&s1->argv, &s1->argc);
     cstr_free(&s1->cmdline_defs);
     cstr_free(&s1->cmdline_incl);
+    tcc_free(s1->pch_file);
     cstr_free(&s1->linker_arg);
     tcc_free(s1->dState);
 #ifdef TCC_IS_NATIVE
@@ -888,6 +955,104 @@ LIBTCCAPI void tcc_delete(TCCState *s1)
 #endif
 }
 
+static char *clone_str(const char *str)
+{
+    return str ? tcc_strdup(str) : NULL;
+}
+
+/* copy an array of strings or of structures ending with a name */
+static void clone_array(void *ptab, int nb, size_t hdr)
+{
+    char **p = *(char ***)ptab, *q;
+    int i, n = 0;
+    *(void **)ptab = NULL;
+    for (i = 0; i < nb; ++i) {
+        q = tcc_malloc(hdr + strlen(p[i] + hdr) + 1);
+        memcpy(q, p[i], hdr + strlen(p[i] + hdr) + 1);
+        dynarray_add(ptab, &n, q);
+    }
+}
+
+static void clone_cstr(CString *cs)
+{
+    CString c = *cs;
+    cstr_new(cs);
+    if (c.size)
+        cstr_cat(cs, c.data, c.size);
+}
+
+LIBTCCAPI TCCState *tcc_state_clone(TCCState *s)
+{
+    TCCState *s1;
+
+#ifdef TCC_IS_NATIVE
+    if (s->run_ptr)
+        return NULL; /* already relocated */
+#endif
+    s1 = tcc_malloc(sizeof(TCCState));
+    memcpy(s1, s, sizeof(TCCState));
+#ifdef MEM_DEBUG
+    tcc_memcheck(1);
+#endif
+    s1->tcc_lib_path = clone_str(s->tcc_lib_path);
+    s1->soname = clone_str(s->soname);
+    s1->rpath = clone_str(s->rpath);
+    s1->elf_entryname = clone_str(s->elf_entryname);
+    s1->init_symbol = clone_str(s->init_symbol);
+    s1->fini_symbol = clone_str(s->fini_symbol);
+    s1->mapfile = clone_str(s->mapfile);
+    s1->outfile = clone_str(s->outfile);
+    s1->deps_outfile = clone_str(s->deps_outfile);
+    s1->pch_file = clone_str(s->pch_file);
+    s1->time_trace_file = clone_str(s->time_trace_file);
+#if defined TCC_TARGET_MACHO
+    s1->install_name = clone_str(s->install_name);
+#endif
+    clone_array(&s1->include_paths, s->nb_include_paths, 0);
+    clone_array(&s1->sysinclude_paths, s->nb_sysinclude_paths, 0);
+    clone_array(&s1->library_paths, s->nb_library_paths, 0);
+    clone_array(&s1->crt_paths, s->nb_crt_paths, 0);
+    clone_array(&s1->target_deps, s->nb_target_deps, 0);
+    clone_array(&s1->pragma_libs, s->nb_pragma_libs, 0);
+    clone_array(&s1->argv, s->argc, 0);
+    clone_array(&s1->files, s->nb_files, offsetof(struct filespec, name));
+    clone_array(&s1->loaded_dlls, s->nb_loaded_dlls, offsetof(DLLReference, name));
+#ifdef TCC_IS_NATIVE
+    {
+        /* each state releases its own reference in tcc_run_free() */
+        int i;
+        for (i = 0; i < s1->nb_loaded_dlls; i++) {
+            DLLReference *ref = s1->loaded_dlls[i];
+            if (ref->handle)
+# ifdef _WIN32
+                ref->handle = LoadLibraryA(ref->name);
+# else
+                ref->handle = dlopen(ref->name, RTLD_GLOBAL | RTLD_LAZY);
+# endif
+        }
+    }
+    s1->run_ptr = NULL, s1->run_size = 0;
+    s1->next = NULL, s1->rc = NULL;
+    s1->run_lj = s1->run_jb = NULL;
+#endif
+    clone_cstr(&s1->cmdline_defs);
+    clone_cstr(&s1->cmdline_incl);
+    clone_cstr(&s1->linker_arg);
+    s1->include_stack_ptr = s1->include_stack;
+    s1->ifdef_stack_ptr = s1->ifdef_stack;
+    s1->pack_stack_ptr = s1->pack_stack;
+    s1->error_set_jmp_enabled = 0;
+    s1->cached_includes = NULL, s1->nb_cached_includes = 0;
+    s1->inline_fns = NULL, s1->nb_inline_fns = 0;
+    tcc_debug_clone(s1);
+    s1->prof = NULL;
+    if (s->prof)
+        tcc_prof_new(s1);
+    if (s->nb_sections)
+        tccelf_clone(s1, s);
+    return s1;
+}
+
 LIBTCCAPI int tcc_set_output_type(TCCState *s, int output_type)
 {
 #ifdef CONFIG_TCC_PIE
@@ -895,6 +1060,8 @@ LIBTCCAPI int tcc_set_output_type(TCCState *s, int output_type)
         output_type |= TCC_OUTPUT_DYN;
 #endif
     s->output_type = output_type;
+    if ((s->time_report || s->time_trace) && !s->prof)
+        tcc_prof_new(s);
 
     if (!s->nostdinc) {
         /* default include paths */
@@ -1025,7 +1192,7 @@ ST_FUNC int tcc_add_file_internal(TCCState *s1, const char *filename, int flags)
     s1->current_filename = filename;
     if (flags & AFF_TYPE_BIN) {
         ElfW(Ehdr) ehdr;
-        int obj_type;
+        int obj_type, ph = PROF_SWITCH(s1, TP_LINK);
 
         obj_type = tcc_object_type(fd, &ehdr);
         lseek(fd, 0, SEEK_SET);
@@ -1109,6 +1276,7 @@ check_success:
 #endif
         }
         close(fd);
+        PROF_SWITCH(s1, ph);
     } else {
         /* update target deps */
         dynarray_add(&s1->target_deps, &s1->nb_target_deps, tcc_strdup(filename));
@@ -1118,9 +1286,9 @@ check_success:
     return ret;
 }
 
-LIBTCCAPI int tcc_add_file(TCCState *s, const char *filename)
+/* return the type of a file as given with -x or from its extension */
+PUB_FUNC int tcc_filetype(const char *filename, int filetype)
 {
-    int filetype = s->filetype;
     if (0 == (filetype & AFF_TYPE_MASK)) {
         /* use a file extension to detect a filetype */
         const char *ext = tcc_fileextension(filename);
@@ -1140,6 +1308,12 @@ LIBTCCAPI int tcc_add_file(TCCState *s, const char *filename)
             filetype = AFF_TYPE_C;
         }
     }
+    return filetype;
+}
+
+LIBTCCAPI int tcc_add_file(TCCState *s, const char *filename)
+{
+    int filetype = tcc_filetype(filename, s->filetype);
     return tcc_add_file_internal(s, filename, filetype | AFF_PRINT_ERROR);
 }
 
@@ -1501,6 +1675,7 @@ enum {
     TCC_OPTION_B,
     TCC_OPTION_l,
     TCC_OPTION_bench,
+    TCC_OPTION_j,
     TCC_OPTION_bt,
     TCC_OPTION_b,
     TCC_OPTION_ba,
@@ -1525,6 +1700,8 @@ enum {
     TCC_OPTION_isystem,
     TCC_OPTION_iwithprefix,
     TCC_OPTION_include,
+    TCC_OPTION_include_pch,
+    TCC_OPTION_emit_pch,
     TCC_OPTION_nostdinc,
     TCC_OPTION_nostdlib,
     TCC_OPTION_print_search_dirs,
@@ -1541,6 +1718,8 @@ enum {
     TCC_OPTION_MP,
     TCC_OPTION_x,
     TCC_OPTION_ar,
+    TCC_OPTION_tcov,
+    TCC_OPTION_server,
     TCC_OPTION_impdef,
     TCC_OPTION_dynamiclib,
     TCC_OPTION_flat_namespace,
@@ -1569,6 +1748,7 @@ static const TCCOption tcc_options[] = {
     { "B", TCC_OPTION_B, TCC_OPTION_HAS_ARG },
     { "l", TCC_OPTION_l, TCC_OPTION_HAS_ARG },
     { "bench", TCC_OPTION_bench, 0 },
+    { "j", TCC_OPTION_j, TCC_OPTION_HAS_ARG },
 #ifdef CONFIG_TCC_BACKTRACE
     { "bt", TCC_OPTION_bt, TCC_OPTION_HAS_ARG | TCC_OPTION_NOSEP },
 #endif
@@ -1609,7 +1789,9 @@ static const TCCOption tcc_options[] = {
 #endif
     { "f", TCC_OPTION_f, TCC_OPTION_HAS_ARG | TCC_OPTION_NOSEP },
     { "isystem", TCC_OPTION_isystem, TCC_OPTION_HAS_ARG },
+    { "include-pch", TCC_OPTION_include_pch, TCC_OPTION_HAS_ARG },
     { "include", TCC_OPTION_include, TCC_OPTION_HAS_ARG },
+    { "emit-pch", TCC_OPTION_emit_pch, 0 },
     { "nostdinc", TCC_OPTION_nostdinc, 0 },
     { "nostdlib", TCC_OPTION_nostdlib, 0 },
     { "print-search-dirs", TCC_OPTION_print_search_dirs, 0 },
@@ -1623,6 +1805,8 @@ static const TCCOption tcc_options[] = {
     { "MP", TCC_OPTION_MP, 0},
     { "x", TCC_OPTION_x, TCC_OPTION_HAS_ARG },
     { "ar", TCC_OPTION_ar, 0},
+    { "tcov", TCC_OPTION_tcov, 0},
+    { "server", TCC_OPTION_server, 0},
 #ifdef TCC_TARGET_PE
     { "impdef", TCC_OPTION_impdef, 0},
 #endif
@@ -1669,6 +1853,9 @@ static const FlagDef options_f[] = {
     { offsetof(TCCState, ms_extensions), 0, "ms-extensions" },
     { offsetof(TCCState, dollars_in_identifiers), 0, "dollars-in-identifiers" },
     { offsetof(TCCState, test_coverage), 0, "test-coverage" },
+    { offsetof(TCCState, time_report), 0, "time-report" },
+    { offsetof(TCCState, loop_regvars), 0, "loop-regvars" },
+    { offsetof(TCCState, float_regvars), 0, "float-regvars" },
     { 0, 0, NULL }
 };
 
@@ -1714,6 +1901,26 @@ static int set_flag(TCCState *s, const FlagDef *flags, const char *name)
     return ret;
 }
 
+/* -ftest-coverage=thread,atomic,binary */
+static int set_tcov_flags(TCCState *s, const char *p)
+{
+    static const char * const names[] = { "thread", "atomic", "binary" };
+    int i, n, f = TCOV_ON;
+
+    while (*p) {
+        n = strcspn(p, ",");
+        for (i = 0; i < 3; i++)
+            if (n == strlen(names[i]) && !strncmp(p, names[i], n))
+                break;
+        if (i == 3)
+            return -1;
+        f |= TCOV_THREAD << i;
+        p += n + (p[n] == ',');
+    }
+    s->test_coverage = f;
+    return 0;
+}
+
 static const char dumpmachine_str[] =
 /* this is a best guess, please refine as necessary */
 #ifdef TCC_TARGET_I386
@@ -1924,6 +2131,9 @@ dorun:
         case TCC_OPTION_bench:
             s->do_bench = 1;
             break;
+        case TCC_OPTION_j:
+            s->nb_jobs = atoi(optarg);
+            break;
 #ifdef CONFIG_TCC_BACKTRACE
         case TCC_OPTION_bt:
             s->rt_num_callers = atoi(optarg); /* zero = default (6) */
@@ -2004,6 +2214,10 @@ dorun:
         case TCC_OPTION_include:
             cstr_printf(&s->cmdline_incl, "#include \"%s\"\n", optarg);
             break;
+        case TCC_OPTION_include_pch:
+            tcc_free(s->pch_file);
+            s->pch_file = tcc_strdup(optarg);
+            break;
         case TCC_OPTION_nostdinc:
             s->nostdinc = 1;
             break;
@@ -2023,6 +2237,22 @@ dorun:
             ++noaction;
             break;
         case TCC_OPTION_f:
+            if (strstart("time-trace", &optarg)) {
+                if (strstart("-granularity=", &optarg)) {
+                    s->time_trace_granularity = atoi(optarg);
+                } else if (*optarg == '=' || !*optarg) {
+                    s->time_trace = 1;
+                    tcc_free(s->time_trace_file);
+                    s->time_trace_file = *optarg ? tcc_strdup(optarg + 1) : NULL;
+                } else
+                    goto unsupported_option;
+                break;
+            }
+            if (strstart("test-coverage=", &optarg)) {
+                if (set_tcov_flags(s, optarg) < 0)
+                    goto unsupported_option;
+                break;
+            }
             if (set_flag(s, options_f, optarg) < 0)
                 goto unsupported_option;
             break;
@@ -2073,6 +2303,10 @@ dorun:
         case TCC_OPTION_E:
             x = TCC_OUTPUT_PREPROCESS;
             goto set_output_type;
+        case TCC_OPTION_emit_pch:
+            s->emit_pch = 1;
+            x = TCC_OUTPUT_PREPROCESS;
+            goto set_output_type;
         case TCC_OPTION_P:
             s->Pflag = atoi(optarg) + 1;
             break;
@@ -2118,7 +2352,8 @@ dorun:
             s->filetype = x | (s->filetype & ~AFF_TYPE_MASK);
             break;
         case TCC_OPTION_O:
-            s->optimize = atoi(optarg);
+            s->optimize = *optarg ? atoi(optarg) : 1;
+            s->loop_regvars = s->float_regvars = s->optimize >= 2;
             break;
         case TCC_OPTION_print_search_dirs:
             x = OPT_PRINT_DIRS;
@@ -2146,6 +2381,13 @@ dorun:
 	    s->current_version = parse_version(s, optarg);;
             break;
 #endif
+        case TCC_OPTION_server:
+            /* after other options too, tcc_server() parses them again */
+            tool = OPT_SERVER;
+            break;
+        case TCC_OPTION_tcov:
+            x = OPT_TCOV;
+            goto extra_action;
         case TCC_OPTION_ar:
             x = OPT_AR;
         extra_action:
@@ -2211,13 +2453,375 @@ PUB_FUNC void tcc_print_stats(TCCState *s1, unsigned total_time)
         unsigned ms = s->data_offset + s->link->data_offset + s->hash->data_offset;
         unsigned rs = s1->run_size;
         fprintf(stderr, ": %d to run, %d symbols, %d other,",
-            rs, ms, mem_cur_size - rs - ms);
+            rs, ms, mem_cur_size - (s1->run_arena ? 0 : rs) - ms);
     }
 #endif
     fprintf(stderr, " %d max (bytes)\n", mem_max_size);
 #endif
 }
 
+/********************************************************/
+/* -ftime-report, -ftime-trace */
+
+typedef struct ProfEntry {
+    uint64_t time, self; /* in ns, self without nested includes */
+    unsigned count, lines;
+    unsigned long allocs, bytes;
+    char name[1];
+} ProfEntry;
+
+typedef struct ProfEvent {
+    uint64_t ts, dur;
+    const char *kind;
+    char detail[1];
+} ProfEvent;
+
+typedef struct TCCProf {
+    uint64_t t0, last, time[TP_NB];
+    unsigned long allocs[TP_NB], bytes[TP_NB];
+    int phase;
+    /* files and macros, over all translation units */
+    ProfEntry **files, **macros;
+    int nb_files, nb_macros;
+    /* files being read */
+    struct {
+        BufferedFile *bf;
+        ProfEntry *e;
+        uint64_t start, child;
+    } stack[INCLUDE_STACK_SIZE + 1];
+    int sp;
+    /* macros of the current translation unit, by token */
+    ProfEntry **mtab, *macro;
+    int nb_mtab, macro_phase;
+    uint64_t macro_start;
+    /* current function */
+    char *func;
+    uint64_t func_start;
+    /* for -ftime-trace, events shorter than 'granularity' are dropped */
+    ProfEvent **events;
+    int nb_events, trace;
+    uint64_t granularity;
+} TCCProf;
+
+static const char prof_names[TP_NB][16] = {
+    "lexing", "preprocessing", "parsing/codegen", "debug info",
+    "linking", "relocation", "output"
+};
+
+/* the profile allocations are accounted to (no phase: NULL) */
+static ST_TLS TCCProf *prof_cur;
+static void *(*prof_next_reallocator)(void*, unsigned long);
+static int prof_users; /* states with a profile, when 0 it is removed */
+TCC_SEM(static prof_sem);
+
+static void *prof_reallocator(void *ptr, unsigned long size)
+{
+    TCCProf *p = prof_cur;
+    if (p && size) {
+        ++p->allocs[p->phase], p->bytes[p->phase] += size;
+        if (p->sp) {
+            ProfEntry *e = p->stack[p->sp - 1].e;
+            ++e->allocs, e->bytes += size;
+        }
+    }
+    return prof_next_reallocator(ptr, size);
+}
+
+static uint64_t prof_clock(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER t;
+    if (!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&t);
+    return (uint64_t)((double)t.QuadPart * 1e9 / freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * (uint64_t)1000000000 + ts.tv_nsec;
+#endif
+}
+
+ST_FUNC void tcc_prof_new(TCCState *s1)
+{
+    TCCProf *p = tcc_mallocz(sizeof *p);
+    p->t0 = p->last = prof_clock();
+    p->phase = TP_NONE;
+    p->trace = s1->time_trace;
+    p->granularity = (uint64_t)s1->time_trace_granularity * 1000;
+    s1->prof = p;
+    WAIT_SEM(&prof_sem);
+    if (prof_users++ == 0 && reallocator != prof_reallocator)
+        prof_next_reallocator = reallocator, reallocator = prof_reallocator;
+    POST_SEM(&prof_sem);
+}
+
+static void prof_switch(TCCProf *p, int phase, uint64_t t)
+{
+    if (p->phase >= 0)
+        p->time[p->phase] += t - p->last;
+    p->last = t, p->phase = phase;
+    prof_cur = phase >= 0 ? p : NULL;
+}
+
+ST_FUNC int tcc_prof_switch(TCCState *s1, int phase)
+{
+    TCCProf *p = s1->prof;
+    int old = p->phase;
+    if (phase != old)
+        prof_switch(p, phase, prof_clock());
+    return old;
+}
+
+static ProfEntry *prof_entry(ProfEntry ***ptab, int *pnb, const char *name)
+{
+    ProfEntry *e;
+    int i;
+    for (i = 0; i < *pnb; ++i)
+        if (!strcmp((*ptab)[i]->name, name))
+            return (*ptab)[i];
+    e = tcc_mallocz(sizeof *e + strlen(name));
+    strcpy(e->name, name);
+    dynarray_add(ptab, pnb, e);
+    return e;
+}
+
+static void prof_event(TCCProf *p, const char *kind, const char *detail,
+                       uint64_t ts, uint64_t dur)
+{
+    ProfEvent *ev;
+    if (!p->trace || dur < p->granularity)
+        return;
+    ev = tcc_malloc(sizeof *ev + strlen(detail));
+    ev->ts = ts - p->t0, ev->dur = dur, ev->kind = kind;
+    strcpy(ev->detail, detail);
+    dynarray_add(&p->events, &p->nb_events, ev);
+}
+
+static void prof_pop(TCCProf *p, uint64_t t)
+{
+    ProfEntry *e;
+    uint64_t dur;
+
+    --p->sp;
+    e = p->stack[p->sp].e;
+    dur = t - p->stack[p->sp].start;
+    e->time += dur;
+    e->self += dur - p->stack[p->sp].child;
+    e->lines += p->stack[p->sp].bf->line_num - 1;
+    if (p->sp)
+        p->stack[p->sp - 1].child += dur;
+    prof_event(p, "Source", e->name, p->stack[p->sp].start, dur);
+}
+
+/* 'file' was opened (enter) or is about to be closed */
+ST_FUNC void tcc_prof_file(TCCState *s1, int enter)
+{
+    TCCProf *p = s1->prof;
+    if (enter) {
+        if (p->sp < countof(p->stack)) {
+            ProfEntry *e = prof_entry(&p->files, &p->nb_files, file->filename);
+            ++e->count;
+            p->stack[p->sp].bf = file;
+            p->stack[p->sp].e = e;
+            p->stack[p->sp].start = prof_clock();
+            p->stack[p->sp].child = 0;
+            ++p->sp;
+        }
+    } else if (p->sp && p->stack[p->sp - 1].bf == file) {
+        prof_pop(p, prof_clock());
+    }
+}
+
+/* start (v: the macro token) or end (v == 0) a macro expansion */
+ST_FUNC void tcc_prof_macro(TCCState *s1, int v)
+{
+    TCCProf *p = s1->prof;
+    uint64_t t = prof_clock();
+    ProfEntry *e;
+
+    if (v) {
+        v -= TOK_IDENT;
+        if (v >= p->nb_mtab) {
+            int n = p->nb_mtab ? p->nb_mtab : 256;
+            while (n <= v)
+                n *= 2;
+            p->mtab = tcc_realloc(p->mtab, n * sizeof *p->mtab);
+            memset(p->mtab + p->nb_mtab, 0, (n - p->nb_mtab) * sizeof *p->mtab);
+            p->nb_mtab = n;
+        }
+        e = p->mtab[v];
+        if (!e)
+            e = p->mtab[v] = prof_entry(&p->macros, &p->nb_macros,
+                                        get_tok_str(v + TOK_IDENT, NULL));
+        p->macro = e;
+        p->macro_start = t;
+        p->macro_phase = p->phase;
+        if (p->phase != TP_PP)
+            prof_switch(p, TP_PP, t);
+    } else if ((e = p->macro)) {
+        e->time += t - p->macro_start;
+        ++e->count;
+        p->macro = NULL;
+        if (p->macro_phase != TP_PP)
+            prof_switch(p, p->macro_phase, t);
+    }
+}
+
+/* start (name: the function) or end (name == NULL) code for a function */
+ST_FUNC void tcc_prof_func(TCCState *s1, const char *name)
+{
+    TCCProf *p = s1->prof;
+    uint64_t t = prof_clock();
+
+    if (p->func)
+        prof_event(p, "Function", p->func, p->func_start, t - p->func_start);
+    tcc_free(p->func);
+    p->func = name ? tcc_strdup(name) : NULL;
+    p->func_start = t;
+}
+
+/* end of a translation unit (also after errors) */
+ST_FUNC void tcc_prof_end(TCCState *s1)
+{
+    TCCProf *p = s1->prof;
+    uint64_t t = prof_clock();
+
+    tcc_prof_func(s1, NULL);
+    while (p->sp)
+        prof_pop(p, t);
+    tcc_free(p->mtab);
+    p->mtab = NULL, p->nb_mtab = 0, p->macro = NULL;
+}
+
+static int prof_cmp(const void *a, const void *b)
+{
+    uint64_t x = (*(ProfEntry **)a)->time, y = (*(ProfEntry **)b)->time;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static void prof_report(TCCProf *p)
+{
+    uint64_t total = 0;
+    int i;
+
+    for (i = 0; i < TP_NB; ++i)
+        total += p->time[i];
+    if (!total)
+        total = 1;
+    fprintf(stderr, "# time report: %0.3f s\n", total / 1e9);
+    for (i = 0; i < TP_NB; ++i)
+        fprintf(stderr, "#   %-16s %8.3f s %5.1f%% %9lu allocs %9lu KB\n",
+            prof_names[i], p->time[i] / 1e9, p->time[i] * 100.0 / total,
+            p->allocs[i], p->bytes[i] >> 10);
+    if (p->nb_files) {
+        qsort(p->files, p->nb_files, sizeof *p->files, prof_cmp);
+        fprintf(stderr, "# files (time, self, count, lines, allocs, KB):\n");
+        for (i = 0; i < p->nb_files && i < 10; ++i) {
+            ProfEntry *e = p->files[i];
+            fprintf(stderr, "#   %8.3f s %8.3f s %5u %7u %9lu %9lu  %s\n",
+                e->time / 1e9, e->self / 1e9, e->count, e->lines,
+                e->allocs, e->bytes >> 10, e->name);
+        }
+    }
+    if (p->nb_macros) {
+        qsort(p->macros, p->nb_macros, sizeof *p->macros, prof_cmp);
+        fprintf(stderr, "# macros (time, expansions):\n");
+        for (i = 0; i < p->nb_macros && i < 10; ++i) {
+            ProfEntry *e = p->macros[i];
+            fprintf(stderr, "#   %8.3f s %9u  %s\n",
+                e->time / 1e9, e->count, e->name);
+        }
+    }
+}
+
+static void prof_json_str(FILE *f, const char *s)
+{
+    int c;
+    fputc('"', f);
+    while ((c = (unsigned char)*s++)) {
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if (c < 32)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+/* write Chrome trace event format, as read by chrome://tracing
+   or https://ui.perfetto.dev */
+static void prof_trace(TCCState *s1, TCCProf *p)
+{
+    char buf[1024], *ext;
+    const char *fn = s1->time_trace_file;
+    uint64_t total = 0;
+    FILE *f;
+    int i;
+
+    if (!fn) {
+        fn = "tcc-trace.json";
+        if (s1->outfile && strcmp(s1->outfile, "-")) {
+            pstrcpy(buf, sizeof buf - 5, s1->outfile);
+            ext = tcc_fileextension(buf);
+            strcpy(ext, ".json");
+            fn = buf;
+        }
+    }
+    f = fopen(fn, "w");
+    if (!f) {
+        tcc_error_noabort("could not write '%s'", fn);
+        return;
+    }
+    fprintf(f, "{\"traceEvents\":[\n"
+        "{\"ph\":\"M\",\"pid\":1,\"tid\":0,\"name\":\"process_name\","
+        "\"args\":{\"name\":\"tcc\"}}");
+    for (i = 0; i < p->nb_events; ++i) {
+        ProfEvent *ev = p->events[i];
+        fprintf(f, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":0,\"ts\":%.3f,"
+            "\"dur\":%.3f,\"name\":\"%s\",\"args\":{\"detail\":",
+            ev->ts / 1e3, ev->dur / 1e3, ev->kind);
+        prof_json_str(f, ev->detail);
+        fprintf(f, "}}");
+    }
+    /* phase totals, one per thread row */
+    for (i = 0; i < TP_NB; ++i)
+        total += p->time[i];
+    fprintf(f, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":0,\"dur\":%.3f,"
+        "\"name\":\"Total\"}", total / 1e3);
+    for (i = 0; i < TP_NB; ++i)
+        if (p->time[i])
+            fprintf(f, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":0,"
+                "\"dur\":%.3f,\"name\":\"Total %s\"}",
+                i + 2, p->time[i] / 1e3, prof_names[i]);
+    fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(f);
+}
+
+ST_FUNC void tcc_prof_delete(TCCState *s1)
+{
+    TCCProf *p = s1->prof;
+
+    prof_switch(p, TP_NONE, prof_clock());
+    if (s1->time_report)
+        prof_report(p);
+    if (s1->time_trace)
+        prof_trace(s1, p);
+    dynarray_reset(&p->files, &p->nb_files);
+    dynarray_reset(&p->macros, &p->nb_macros);
+    dynarray_reset(&p->events, &p->nb_events);
+    tcc_free(p->mtab);
+    tcc_free(p->func);
+    tcc_free(p);
+    s1->prof = NULL;
+    WAIT_SEM(&prof_sem);
+    if (--prof_users == 0 && reallocator == prof_reallocator)
+        reallocator = prof_next_reallocator;
+    POST_SEM(&prof_sem);
+}
+
 #if ONE_SOURCE
 # undef malloc
 # undef realloc
@@ -23,6 +23,10 @@ LIBTCCAPI TCCState *tcc_new(void);
 /* free a TCC compilation context */
 LIBTCCAPI void tcc_delete(TCCState *s);
 
+/* create a copy of a compilation context, e.g. after headers were
+   compiled and symbols added. Must not be relocated yet. */
+LIBTCCAPI TCCState *tcc_state_clone(TCCState *s);
+
 /* set CONFIG_TCCDIR at runtime */
 LIBTCCAPI void tcc_set_lib_path(TCCState *s, const char *path);
 
@@ -88,7 +92,15 @@ LIBTCCAPI int tcc_output_file(TCCState *s, const char *filename);
    tcc_relocate() before. */
 LIBTCCAPI int tcc_run(TCCState *s, int argc, char **argv);
 
-/* do all relocations (needed before using tcc_get_symbol()) */
+/* do all relocations (needed before using tcc_get_symbol()).  On Linux,
+   the code and data of all states are put into one shared arena, without
+   page protection changes.  The executable part is shared with children
+   after fork(): delete states only when they no longer run it.
+   More code may be compiled into a relocated state, then tcc_relocate()
+   again puts it into memory of its own, linked to the symbols from
+   before.  Its symbols show with tcc_get_symbol() only after that.
+   A file that fails to compile is dropped.  (not with -g, -b or
+   -ftest-coverage) */
 LIBTCCAPI int tcc_relocate(TCCState *s1);
 
 /* return symbol value or NULL if not found */
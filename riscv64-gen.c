@@ -30,6 +30,10 @@
 
 #define CHAR_IS_UNSIGNED
 
+#define TCC_TARGET_NATIVE_STRUCT_COPY
+ST_FUNC int gen_struct_copy(int size, int align);
+ST_FUNC int gen_struct_clear(int size, int align);
+
 #else
 #define USING_GLOBALS
 #include "tcc.h"
@@ -74,8 +78,8 @@ ST_DATA const int reg_classes[NB_REGS] = {
 };
 
 #if defined(CONFIG_TCC_BCHECK)
-static addr_t func_bound_offset;
-static unsigned long func_bound_ind;
+static ST_TLS addr_t func_bound_offset;
+static ST_TLS unsigned long func_bound_ind;
 ST_DATA int func_bound_add_epilog;
 #endif
 
@@ -780,7 +784,7 @@ done:
    tcc_free(info);
 }
 
-static int func_sub_sp_offset, num_va_regs, func_va_list_ofs;
+static ST_TLS int func_sub_sp_offset, num_va_regs, func_va_list_ofs;
 
 ST_FUNC void gfunc_prolog(Sym *func_sym)
 {
@@ -1444,4 +1448,75 @@ ST_FUNC void gen_vla_alloc(CType *type, int align)
     }
 #endif
 }
+
+static int is_local_addr(SValue *sv, int size)
+{
+    int c = sv->c.i;
+    return (sv->r & (VT_VALMASK | VT_LVAL | VT_SYM)) == VT_LOCAL
+        && c >= -2048 && c + size <= 2048;
+}
+
+// base register of the address 'sv', s0 for a local
+static int struct_base(SValue *sv, int *off)
+{
+    if ((sv->r & VT_VALMASK) == VT_LOCAL) {
+        *off = sv->c.i;
+        return 8;
+    }
+    *off = 0;
+    return ireg(sv->r & VT_VALMASK);
+}
+
+// size of the moves: up to 8, but no unaligned ones
+static int struct_move_size(int size, int align)
+{
+    int n = align < 8 ? align : 8;
+    while (size & (n - 1))
+        n >>= 1;
+    return n;
+}
+
+ST_FUNC int gen_struct_copy(int size, int align)
+{
+    int n = struct_move_size(size, align), sz, d, s, dc, sc, c;
+
+    if (size / n > 16)
+        return 0;
+    if (!is_local_addr(vtop - 1, size) && !is_local_addr(vtop, size))
+        gv2(RC_INT, RC_INT);
+    else if (!is_local_addr(vtop - 1, size)) {
+        vswap();
+        gv(RC_INT);
+        vswap();
+    } else if (!is_local_addr(vtop, size))
+        gv(RC_INT);
+    d = struct_base(vtop - 1, &dc);
+    s = struct_base(vtop, &sc);
+    for (sz = 0; 1 << sz < n; sz++)
+        ;
+    for (c = 0; c < size; c += n) {
+        EI(0x03, sz, 5, s, sc + c); // l[bhwd] t0, c(s)
+        ES(0x23, sz, d, 5, dc + c); // s[bhwd] t0, c(d)
+    }
+    vpop();
+    vpop();
+    return 1;
+}
+
+ST_FUNC int gen_struct_clear(int size, int align)
+{
+    int n = struct_move_size(size, align), sz, d, dc, c;
+
+    if (size / n > 16)
+        return 0;
+    if (!is_local_addr(vtop, size))
+        gv(RC_INT);
+    d = struct_base(vtop, &dc);
+    for (sz = 0; 1 << sz < n; sz++)
+        ;
+    for (c = 0; c < size; c += n)
+        ES(0x23, sz, d, 0, dc + c); // s[bhwd] zero, c(d)
+    vpop();
+    return 1;
+}
 #endif
@@ -23,6 +23,12 @@
 # include "libtcc.c"
 #endif
 #include "tcctools.c"
+#ifndef _WIN32
+# include <sys/wait.h>
+# include <sys/socket.h>
+# include <sys/un.h>
+# include <signal.h>
+#endif
 
 static const char help[] =
     "Tiny C Compiler "TCC_VERSION" - Copyright (C) 2001-2006 Fabrice Bellard\n"
@@ -39,6 +45,7 @@ static const char help[] =
     "  -vv          show search paths or loaded files\n"
     "  -h -hh       show this, show more help\n"
     "  -bench       show compilation statistics\n"
+    "  -j N         compile source files in N parallel processes\n"
     "  -            use stdin pipe as infile\n"
     "  @listfile    read arguments from listfile\n"
     "Preprocessor options:\n"
@@ -80,6 +87,10 @@ static const char help[] =
 #endif
     "Tools:\n"
     "  create library  : tcc -ar [crstvx] lib [files]\n"
+    "  coverage report : tcc -tcov [-o file] files.tcovb\n"
+#ifndef _WIN32
+    "  compile server  : tcc [options] -server socket\n"
+#endif
 #ifdef TCC_TARGET_PE
     "  create def file : tcc -impdef lib.dll [-v] [-o lib.def]\n"
 #endif
@@ -91,9 +102,13 @@ static const char help2[] =
     "  -P -P1                        with -E: no/alternative #line output\n"
     "  -dD -dM                       with -E: output #define directives\n"
     "  -pthread                      same as -D_REENTRANT and -lpthread\n"
-    "  -On                           same as -D__OPTIMIZE__ for n > 0\n"
+    "  -On                           -D__OPTIMIZE__ for n > 0, -O1: register variables,\n"
+    "                                inline small static functions\n"
+    "                                -O2: -O1 -floop-regvars -ffloat-regvars\n"
     "  -Wp,-opt                      same as -opt\n"
     "  -include file                 include 'file' above each input file\n"
+    "  -emit-pch -o file.pch         write a precompiled header\n"
+    "  -include-pch file.pch         use a precompiled header\n"
     "  -isystem dir                  add 'dir' to system include path\n"
     "  -static                       link to static libraries (not recommended)\n"
     "  -dumpversion                  print version\n"
@@ -115,7 +130,14 @@ static const char help2[] =
     "  leading-underscore            decorate extern symbols\n"
     "  ms-extensions                 allow anonymous struct in struct\n"
     "  dollars-in-identifiers        allow '$' in C symbols\n"
-    "  test-coverage                 create code coverage code\n"
+    "  test-coverage[=thread,atomic,binary]\n"
+    "                                create code coverage code [per thread/locked\n"
+    "                                counters, add up runs in .tcovb for tcc -tcov]\n"
+    "  time-report                   print time and memory per phase\n"
+    "  time-trace[=file]             write Chrome trace json\n"
+    "  time-trace-granularity=N      omit trace events below N us\n"
+    "  loop-regvars                  with -O1: weight register variables by loops\n"
+    "  float-regvars                 with -O1: also float register variables\n"
     "-m... target specific options:\n"
     "  ms-bitfields                  use MSVC bitfield layout\n"
 #ifdef TCC_TARGET_ARM
@@ -271,6 +293,353 @@ static unsigned getclock_ms(void)
 #endif
 }
 
+/* -j N: compile the source files in up to N child processes.  With -c
+   the children write the object files and we are done (returns 1).
+   Otherwise they write temporary objects that replace the sources in
+   the file list, such that the link still sees them in order. */
+static int compile_jobs(TCCState *s, char ***ptmp, int *pnb_tmp)
+{
+#ifndef _WIN32
+    TCCState *s1 = s;
+    struct filespec *f;
+    char buf[1024], *obj;
+    const char *tmpdir;
+    int i, fd, status, ret = 0, running = 0, link;
+    pid_t pid;
+
+    link = s->output_type != TCC_OUTPUT_OBJ || s->option_r;
+    if (link && (s->output_type == TCC_OUTPUT_MEMORY
+              || s->output_type == TCC_OUTPUT_PREPROCESS || s->gen_deps))
+        return 0;
+    if (s->just_deps || s->nb_files < 2)
+        return 0;
+    tmpdir = getenv("TMPDIR");
+    if (!tmpdir)
+        tmpdir = "/tmp";
+
+    for (i = 0; i < s->nb_files; ++i) {
+        f = s->files[i];
+        if ((f->type & AFF_TYPE_LIB)
+         || (tcc_filetype(f->name, f->type) & AFF_TYPE_BIN))
+            continue;
+        if (running == s->nb_jobs) {
+            --running;
+            if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status)) {
+                ret = -1;
+                break;
+            }
+        }
+        if (link) {
+            snprintf(buf, sizeof buf, "%s/tccXXXXXX", tmpdir);
+            fd = mkstemp(buf);
+            if (fd < 0) {
+                ret = tcc_error_noabort("could not create '%s'", buf);
+                break;
+            }
+            close(fd);
+            obj = tcc_strdup(buf);
+            *ptmp = tcc_realloc(*ptmp, (*pnb_tmp + 1) * sizeof **ptmp);
+            (*ptmp)[(*pnb_tmp)++] = obj;
+        } else {
+            obj = default_outputfile(s, f->name);
+        }
+        fflush(stdout);
+        pid = fork();
+        if (pid < 0) {
+            ret = tcc_error_noabort("could not fork");
+            break;
+        }
+        if (pid == 0) {
+            tcc_set_output_type(s, TCC_OUTPUT_OBJ);
+            s->filetype = f->type;
+            if (1 == s->verbose)
+                printf("-> %s\n", f->name);
+            if (tcc_add_file(s, f->name) || tcc_output_file(s, obj)
+             || (s->gen_deps && gen_makedeps(s, obj, s->deps_outfile)))
+                exit(1);
+            exit(0);
+        }
+        ++running;
+        if (link) {
+            /* the object replaces the source file in the list */
+            s->files[i] = tcc_malloc(sizeof *f + strlen(obj));
+            s->files[i]->type = AFF_TYPE_BIN;
+            strcpy(s->files[i]->name, obj);
+            tcc_free(f);
+        } else {
+            tcc_free(obj);
+        }
+    }
+    while (running--)
+        if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+            ret = -1;
+    return ret < 0 ? -1 : !link;
+#else
+    return 0;
+#endif
+}
+
+static void remove_files(char **files, int nb_files)
+{
+    while (nb_files--) {
+        remove(files[nb_files]);
+        tcc_free(files[nb_files]);
+    }
+    tcc_free(files);
+}
+
+#ifndef _WIN32
+/* -server: compile the requests of tcc clients that found the socket
+   in TCC_SERVER.  Each request runs in a fork of the server, which has
+   the -include headers precompiled already. */
+static const char *server_socket, *server_pch;
+
+int main(int argc0, char **argv0);
+
+static void server_exit(int sig)
+{
+    unlink(server_socket);
+    if (server_pch)
+        unlink(server_pch);
+    _exit(0);
+}
+
+static int server_connect(const char *path, int listen_fd)
+{
+    struct sockaddr_un sa;
+    int fd;
+
+    if (strlen(path) >= sizeof sa.sun_path)
+        return -1;
+    memset(&sa, 0, sizeof sa);
+    sa.sun_family = AF_UNIX;
+    strcpy(sa.sun_path, path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (listen_fd) {
+        unlink(path);
+        if (bind(fd, (struct sockaddr *)&sa, sizeof sa) == 0
+         && listen(fd, 64) == 0)
+            return fd;
+    } else {
+        if (connect(fd, (struct sockaddr *)&sa, sizeof sa) == 0)
+            return fd;
+    }
+    close(fd);
+    return -1;
+}
+
+static int write_all(int fd, const char *buf, int len)
+{
+    int n;
+    for (; len > 0; buf += n, len -= n)
+        if ((n = write(fd, buf, len)) <= 0)
+            return -1;
+    return 0;
+}
+
+static int read_all(int fd, char *buf, int len)
+{
+    int n;
+    for (; len > 0; buf += n, len -= n)
+        if ((n = read(fd, buf, len)) <= 0)
+            return -1;
+    return 0;
+}
+
+/* send the working directory, the arguments and our stdin/out/err to
+   the server, return the exit code of the compilation or -1 if there
+   is no server */
+static int server_request(const char *path, int argc, char **argv)
+{
+    union { struct cmsghdr h; char buf[CMSG_SPACE(3 * sizeof(int))]; } cm;
+    struct msghdr msg;
+    struct cmsghdr *c;
+    struct iovec iov;
+    char cwd[1024], *data, *p;
+    int fd, i, len, n, status;
+
+    if (!getcwd(cwd, sizeof cwd))
+        return -1;
+    fd = server_connect(path, 0);
+    if (fd < 0)
+        return -1;
+
+    len = strlen(cwd) + 1;
+    for (i = 1; i < argc; ++i)
+        len += strlen(argv[i]) + 1;
+    data = tcc_malloc(sizeof len + len);
+    memcpy(data, &len, sizeof len);
+    p = data + sizeof len;
+    strcpy(p, cwd);
+    for (i = 1; i < argc; ++i)
+        p = strchr(p, 0) + 1, strcpy(p, argv[i]);
+
+    memset(&msg, 0, sizeof msg);
+    iov.iov_base = data;
+    iov.iov_len = sizeof len + len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cm.buf;
+    msg.msg_controllen = sizeof cm.buf;
+    c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(3 * sizeof(int));
+    for (i = 0; i < 3; ++i)
+        ((int *)CMSG_DATA(c))[i] = i;
+
+    fflush(stdout);
+    n = sendmsg(fd, &msg, 0);
+    if (n <= 0 || write_all(fd, data + n, sizeof len + len - n)
+     || read_all(fd, (char *)&status, sizeof status))
+        fprintf(stderr, "tcc: lost connection to %s\n", path), status = 1;
+    tcc_free(data);
+    close(fd);
+    return status;
+}
+
+/* run one request in a child process and send back its exit code */
+static int server_child(int fd, int nb_args, char **args)
+{
+    union { struct cmsghdr h; char buf[CMSG_SPACE(3 * sizeof(int))]; } cm;
+    struct msghdr msg;
+    struct cmsghdr *c;
+    struct iovec iov;
+    char *data, *p, **argv;
+    int i, len, argc, status, fds[3];
+    pid_t pid;
+
+    signal(SIGCHLD, SIG_DFL);
+    memset(&msg, 0, sizeof msg);
+    iov.iov_base = &len;
+    iov.iov_len = sizeof len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cm.buf;
+    msg.msg_controllen = sizeof cm.buf;
+    if (recvmsg(fd, &msg, 0) != sizeof len)
+        return 1;
+    c = CMSG_FIRSTHDR(&msg);
+    if (!c || c->cmsg_type != SCM_RIGHTS
+        || c->cmsg_len != CMSG_LEN(3 * sizeof(int)))
+        return 1;
+    memcpy(fds, CMSG_DATA(c), sizeof fds);
+    if (len <= 0)
+        return 1;
+    data = tcc_malloc(len);
+    if (read_all(fd, data, len) || data[len - 1])
+        return 1;
+
+    /* our options first, then the ones from the client */
+    argv = tcc_malloc((nb_args + len + 1) * sizeof *argv);
+    memcpy(argv, args, nb_args * sizeof *argv);
+    argc = nb_args;
+    for (p = strchr(data, 0) + 1; p < data + len; p = strchr(p, 0) + 1)
+        argv[argc++] = p;
+    argv[argc] = NULL;
+    if (chdir(data))
+        return 1;
+
+    pid = fork();
+    if (pid == 0) {
+        close(fd);
+        for (i = 0; i < 3; ++i)
+            dup2(fds[i], i), close(fds[i]);
+        exit(main(argc, argv));
+    }
+    status = 1;
+    if (pid > 0 && waitpid(pid, &status, 0) == pid)
+        status = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    write_all(fd, (char *)&status, sizeof status);
+    return 0;
+}
+
+static int tcc_server(int argc, char **argv)
+{
+    TCCState *s;
+    char buf[1024], **args, **av;
+    const char *tmpdir;
+    int fd, c, i, ac, nb_args, ret;
+
+    /* the options for the requests are ours without '-server socket' */
+    args = tcc_malloc((argc + 2) * sizeof *args);
+    for (i = nb_args = 0; i < argc; ++i) {
+        if (0 == strcmp(argv[i], "-server") && !server_socket) {
+            server_socket = argv[++i];
+            continue;
+        }
+        args[nb_args++] = argv[i];
+    }
+    if (!server_socket) {
+        fprintf(stderr, "usage: tcc [options] -server socket [options]\n");
+        return 1;
+    }
+    /* our children must not send the requests back to us */
+    unsetenv("TCC_SERVER");
+
+    /* precompile the -include headers */
+    s = tcc_new();
+    ac = nb_args, av = args;
+    ret = tcc_parse_args(s, &ac, &av, 1);
+    if (ret == 0 && s->nb_files)
+        fprintf(stderr, "tcc: server: cannot specify files\n"), ret = 1;
+    if (ret == 0 && s->cmdline_incl.size) {
+        tmpdir = getenv("TMPDIR");
+        if (!tmpdir)
+            tmpdir = "/tmp";
+        snprintf(buf, sizeof buf, "%s/tccpchXXXXXX", tmpdir);
+        fd = mkstemp(buf);
+        if (fd < 0) {
+            fprintf(stderr, "tcc: server: can't create file %s\n", buf), ret = 1;
+        } else {
+            set_environment(s);
+            s->emit_pch = 1;
+            tcc_set_output_type(s, TCC_OUTPUT_PREPROCESS);
+            s->ppfp = fdopen(fd, "wb");
+            ret = tcc_compile_string(s, "");
+            fclose(s->ppfp);
+            server_pch = tcc_strdup(buf);
+            args[nb_args++] = "-include-pch";
+            args[nb_args++] = (char *)server_pch;
+        }
+    }
+    tcc_delete(s);
+
+    fd = -1;
+    if (ret == 0) {
+        fd = server_connect(server_socket, 1);
+        if (fd < 0)
+            fprintf(stderr, "tcc: server: can't listen on %s\n", server_socket), ret = 1;
+    }
+    if (ret == 0) {
+        signal(SIGCHLD, SIG_IGN);
+        signal(SIGINT, server_exit);
+        signal(SIGTERM, server_exit);
+        for (;;) {
+            c = accept(fd, NULL, NULL);
+            if (c < 0) {
+                if (errno == EINTR)
+                    continue;
+                fprintf(stderr, "tcc: server: can't accept connection\n"), ret = 1;
+                break;
+            }
+            if (fork() == 0) {
+                close(fd);
+                exit(server_child(c, nb_args, args));
+            }
+            close(c);
+        }
+        close(fd);
+        unlink(server_socket);
+    }
+    if (server_pch)
+        unlink(server_pch);
+    return ret != 0;
+}
+#endif
+
 int main(int argc0, char **argv0)
 {
     TCCState *s, *s1;
@@ -279,7 +648,19 @@ int main(int argc0, char **argv0)
     const char *first_file;
     int argc; char **argv;
     FILE *ppfp = stdout;
+    char **tmp_files = NULL;
+    int nb_tmp_files = 0;
 
+#ifndef _WIN32
+    if ((first_file = getenv("TCC_SERVER")) && *first_file) {
+        for (n = 1; n < argc0 && strcmp(argv0[n], "-server"); ++n)
+            ;
+        ret = n < argc0 ? -1 : server_request(first_file, argc0, argv0);
+        n = 0;
+        if (ret >= 0)
+            return ret;
+    }
+#endif
 redo:
     argc = argc0, argv = argv0;
     s = s1 = tcc_new();
@@ -307,6 +688,15 @@ redo:
             printf("%s", version);
         if (opt == OPT_AR)
             return tcc_tool_ar(s, argc, argv);
+        if (opt == OPT_TCOV)
+            return tcc_tool_tcov(s, argc, argv);
+        if (opt == OPT_SERVER) {
+#ifndef _WIN32
+            return tcc_server(argc0, argv0);
+#else
+            return tcc_error_noabort("-server is not supported on Windows") < 0;
+#endif
+        }
 #ifdef TCC_TARGET_PE
         if (opt == OPT_IMPDEF)
             return tcc_tool_impdef(s, argc, argv);
@@ -324,6 +714,8 @@ redo:
         if (s->nb_files == 0) {
             tcc_error_noabort("no input files");
         } else if (s->output_type == TCC_OUTPUT_PREPROCESS) {
+            if (s->emit_pch && s->nb_files > 1)
+                tcc_error_noabort("cannot specify multiple files with -emit-pch");
             if (s->outfile && 0!=strcmp("-",s->outfile)) {
                 ppfp = fopen(s->outfile, "wb");
                 if (!ppfp)
@@ -344,6 +736,14 @@ redo:
     set_environment(s);
     if (s->output_type == 0)
         s->output_type = TCC_OUTPUT_EXE;
+    if (n == 0 && s->nb_jobs > 1) {
+        ret = compile_jobs(s, &tmp_files, &nb_tmp_files);
+        if (ret) {
+            remove_files(tmp_files, nb_tmp_files);
+            tcc_delete(s);
+            return ret < 0;
+        }
+    }
     tcc_set_output_type(s, s->output_type);
     s->ppfp = ppfp;
 
@@ -374,6 +774,10 @@ redo:
         done = ret || ++n >= s->nb_files;
     } while (!done && (s->output_type != TCC_OUTPUT_OBJ || s->option_r));
 
+    /* temporary objects from -j are loaded now */
+    remove_files(tmp_files, nb_tmp_files);
+    tmp_files = NULL, nb_tmp_files = 0;
+
     if (s->do_bench)
         end_time = getclock_ms();
 
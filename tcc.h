@@ -38,10 +38,14 @@
 #include <fcntl.h>
 #include <setjmp.h>
 #include <time.h>
+#if defined __SSE2__ && defined __GNUC__ && !defined __TINYC__
+# include <emmintrin.h> /* for tccpp.c */
+#endif
 
 #ifndef _WIN32
 # include <unistd.h>
 # include <sys/time.h>
+# include <sys/mman.h>
 # ifndef CONFIG_TCC_STATIC
 #  include <dlfcn.h>
 # endif
@@ -378,14 +382,33 @@ extern long double strtold (const char *__nptr, char **__endptr);
 # define CONFIG_TCC_SEMLOCK 1
 #endif
 
+/* keep the compiler's global variables in thread local storage such
+   that states in different threads can compile at the same time */
+#ifndef CONFIG_TCC_TLS
+# if CONFIG_TCC_SEMLOCK && (defined __GNUC__ || defined _MSC_VER) \
+    && !defined __TINYC__
+#  define CONFIG_TCC_TLS 1
+# else
+#  define CONFIG_TCC_TLS 0
+# endif
+#endif
+
+#if !CONFIG_TCC_TLS
+# define ST_TLS
+#elif defined _MSC_VER
+# define ST_TLS __declspec(thread)
+#else
+# define ST_TLS __thread
+#endif
+
 #if ONE_SOURCE
 #define ST_INLN static inline
 #define ST_FUNC static
-#define ST_DATA static
+#define ST_DATA static ST_TLS
 #else
 #define ST_INLN
 #define ST_FUNC
-#define ST_DATA extern
+#define ST_DATA extern ST_TLS
 #endif
 
 #ifdef TCC_PROFILE /* profile all functions */
@@ -461,13 +484,11 @@ extern long double strtold (const char *__nptr, char **__endptr);
 #define TOKSTR_MAX_SIZE     256
 #define PACK_STACK_SIZE     8
 
-#define TOK_HASH_SIZE       16384 /* must be a power of two */
 #define TOK_ALLOC_INCR      512  /* must be a power of two */
 #define TOK_MAX_SIZE        4 /* token max size in int unit when stored in string */
 
 /* token symbol management */
 typedef struct TokenSym {
-    struct TokenSym *hash_next;
     struct Sym *sym_define; /* direct pointer to define */
     struct Sym *sym_label; /* direct pointer to label */
     struct Sym *sym_struct; /* direct pointer to structure */
@@ -550,7 +571,8 @@ struct FuncAttr {
     func_dtor   : 1, /* attribute((destructor)) */
     func_args   : 8, /* PE __stdcall args */
     func_alwinl : 1, /* always_inline */
-    xxxx        : 15;
+    func_inl    : 1, /* -O1: may be expanded at calls */
+    xxxx        : 14;
 };
 
 /* symbol management */
@@ -654,11 +676,14 @@ typedef struct DLLReference {
 #define TYPE_NEST      8 /* nested call to post_type */
 
 #define IO_BUF_SIZE 8192
+#define IO_BUF_PAD 16 /* readable bytes after buf_end (see scan_chr()) */
 
 typedef struct BufferedFile {
     uint8_t *buf_ptr;
     uint8_t *buf_end;
     int fd;
+    uint8_t *map; /* large file mapped as a whole */
+    unsigned long map_size;
     struct BufferedFile *prev;
     int line_num;    /* current line number - here to simplify code */
     int line_ref;    /* tcc -E: last printed line */
@@ -705,6 +730,8 @@ typedef struct AttributeDef {
 typedef struct InlineFunc {
     TokenString *func_str;
     Sym *sym;
+    Sym *isym; /* -O1: small static function expanded at calls ... */
+    int *itok; /* ... from these tokens */
     char filename[1];
 } InlineFunc;
 
@@ -763,7 +790,9 @@ struct TCCState {
     unsigned char rdynamic; /* if true, all symbols are exported */
     unsigned char symbolic; /* if true, resolve symbols in the current module first */
     unsigned char filetype; /* file type for compilation (NONE,C,ASM) */
-    unsigned char optimize; /* only to #define __OPTIMIZE__ */
+    unsigned char optimize; /* -O level, see also __OPTIMIZE__ */
+    unsigned char loop_regvars; /* -floop-regvars, on with -O2 */
+    unsigned char float_regvars; /* -ffloat-regvars, on with -O2 */
     unsigned char option_pthread; /* -pthread option */
     unsigned char enable_new_dtags; /* -Wl,--enable-new-dtags */
     unsigned int  cversion; /* supported C ISO version, 199901 (the default), 201112, ... */
@@ -788,6 +817,10 @@ struct TCCState {
 
     unsigned char option_r; /* option -r */
     unsigned char do_bench; /* option -bench */
+    unsigned char time_report; /* option -ftime-report */
+    unsigned char time_trace; /* option -ftime-trace */
+    int nb_jobs; /* option -j N */
+    unsigned char emit_pch; /* option -emit-pch */
     unsigned char just_deps; /* option -M  */
     unsigned char gen_deps; /* option -MD  */
     unsigned char include_sys_deps; /* option -MD  */
@@ -801,7 +834,7 @@ struct TCCState {
     /* compile with built-in memory and bounds checker */
     unsigned char do_bounds_check;
 #endif
-    unsigned char test_coverage;  /* generate test coverage code */
+    unsigned char test_coverage;  /* generate test coverage code, TCOV_xxx */
 
     /* use GNU C extensions */
     unsigned char gnu_ext;
@@ -863,6 +896,8 @@ struct TCCState {
     CString cmdline_defs;
     /* -include options */
     CString cmdline_incl;
+    /* -include-pch option */
+    char *pch_file;
 
     /* error handling */
     void *error_opaque;
@@ -936,6 +971,7 @@ struct TCCState {
     int dwlo, dwhi; /* dwarf section range */
     /* test coverage */
     Section *tcov_section;
+    Section *tcov_shard_section; /* -ftest-coverage=thread counters */
     /* debug state */
     struct _tccdbg *dState;
 
@@ -989,6 +1025,11 @@ struct TCCState {
     const char *run_main; /* entry for tcc_run() */
     void *run_ptr; /* runtime_memory */
     unsigned run_size; /* size of runtime_memory  */
+    unsigned char run_arena; /* run_ptr is from the shared arena */
+    unsigned char run_delta; /* more code may be added after tcc_relocate() */
+    void **run_blocks; /* memory from earlier tcc_relocate()s */
+    int nb_run_blocks;
+    unsigned run_syms, run_strs; /* symtab/strtab size after the last one */
 #ifdef _WIN64
     void *run_function_table; /* unwind data */
 #endif
@@ -1008,6 +1049,10 @@ struct TCCState {
     int total_lines;
     unsigned int total_bytes;
     unsigned int total_output[4];
+    /* -ftime-report, -ftime-trace */
+    struct TCCProf *prof;
+    char *time_trace_file;
+    int time_trace_granularity; /* in microseconds */
 
     /* option -dnum (for general development purposes) */
     int g_debug;
@@ -1191,8 +1236,9 @@ struct filespec {
 #define TOK_PPNUM   0xcd /* preprocessor number */
 #define TOK_PPSTR   0xce /* preprocessor string */
 #define TOK_LINENUM 0xcf /* line number info */
+#define TOK_PPPACK  0xd0 /* #pragma pack() value from a precompiled header */
 
-#define TOK_HAS_VALUE(t) (t >= TOK_CCHAR && t <= TOK_LINENUM)
+#define TOK_HAS_VALUE(t) (t >= TOK_CCHAR && t <= TOK_PPPACK)
 
 #define TOK_EOF       (-1)  /* end of file */
 #define TOK_LINEFEED  10    /* line feed */
@@ -1278,6 +1324,7 @@ ST_FUNC void tcc_close(void);
 #define cstr_free_s(cstr) (cstr_free(cstr), stk_pop())
 
 ST_FUNC int tcc_add_file_internal(TCCState *s1, const char *filename, int flags);
+PUB_FUNC int tcc_filetype(const char *filename, int filetype);
 /* flags: */
 #define AFF_PRINT_ERROR     0x10 /* print error if file not found */
 #define AFF_REFERENCED_DLL  0x20 /* load a referenced dll from another dll */
@@ -1313,6 +1360,31 @@ ST_FUNC void tcc_add_btstub(TCCState *s1);
 ST_FUNC void tcc_add_pragma_libs(TCCState *s1);
 PUB_FUNC int tcc_add_library_err(TCCState *s, const char *f);
 PUB_FUNC void tcc_print_stats(TCCState *s, unsigned total_time);
+
+/* compilation phases for -ftime-report */
+enum {
+    TP_NONE = -1, /* not accounted: outside of libtcc, the program of -run */
+    TP_LEX, TP_PP, TP_GEN, TP_DEBUG, TP_LINK, TP_RELOC, TP_OUTPUT,
+    TP_NB
+};
+ST_FUNC void tcc_prof_new(TCCState *s1);
+ST_FUNC void tcc_prof_delete(TCCState *s1);
+ST_FUNC int tcc_prof_switch(TCCState *s1, int phase);
+ST_FUNC void tcc_prof_file(TCCState *s1, int enter);
+ST_FUNC void tcc_prof_macro(TCCState *s1, int v);
+ST_FUNC void tcc_prof_func(TCCState *s1, const char *name);
+ST_FUNC void tcc_prof_end(TCCState *s1);
+/* switch to 'phase', return the previous one */
+#define PROF_SWITCH(s1, phase) ((s1)->prof ? tcc_prof_switch(s1, phase) : 0)
+/* account 'x' to 'phase' */
+#define PROF_CALL(s1, phase, x) do { \
+    if ((s1)->prof) { \
+        int prof_ph = tcc_prof_switch(s1, phase); \
+        x; \
+        tcc_prof_switch(s1, prof_ph); \
+    } else \
+        x; \
+    } while (0)
 PUB_FUNC int tcc_parse_args(TCCState *s, int *argc, char ***argv, int optind);
 #ifdef _WIN32
 ST_FUNC char *normalize_slashes(char *path);
@@ -1329,6 +1401,8 @@ ST_FUNC int normalized_PATHCMP(const char *f1, const char *f2);
 #define OPT_PRINT_DIRS 4
 #define OPT_AR 5
 #define OPT_IMPDEF 6
+#define OPT_SERVER 7
+#define OPT_TCOV 8
 #define OPT_M32 32
 #define OPT_M64 64
 
@@ -1385,6 +1459,7 @@ ST_FUNC void tok_str_free(TokenString *s);
 ST_FUNC void tok_str_free_str(int *str);
 ST_FUNC void tok_str_add(TokenString *s, int t);
 ST_FUNC void tok_str_add_tok(TokenString *s);
+ST_FUNC int tok_str_next(const int **pp);
 ST_INLN void define_push(int v, int macro_type, int *str, Sym *first_arg);
 ST_FUNC void define_undef(Sym *s);
 ST_INLN Sym *define_find(int v);
@@ -1542,8 +1617,13 @@ typedef struct {
 
 ST_FUNC void tccelf_new(TCCState *s);
 ST_FUNC void tccelf_delete(TCCState *s);
+ST_FUNC void tccelf_clone(TCCState *s1, TCCState *s);
 ST_FUNC void tccelf_begin_file(TCCState *s1);
 ST_FUNC void tccelf_end_file(TCCState *s1);
+#ifdef TCC_IS_NATIVE
+ST_FUNC void tccelf_end_delta(TCCState *s1);
+ST_FUNC void drop_elf_syms(Section *s, int first);
+#endif
 ST_FUNC Section *new_section(TCCState *s1, const char *name, int sh_type, int sh_flags);
 ST_FUNC void section_realloc(Section *sec, unsigned long new_size);
 ST_FUNC size_t section_add(Section *sec, addr_t size, int align);
@@ -1565,6 +1645,8 @@ ST_FUNC void relocate_syms(TCCState *s1, Section *symtab, int do_resolve);
 ST_FUNC void relocate_sections(TCCState *s1);
 
 ST_FUNC ssize_t full_read(int fd, void *buf, size_t count);
+ST_FUNC void *map_data(int fd, unsigned long file_offset, unsigned long size);
+ST_FUNC void unmap_data(void *data, unsigned long size);
 ST_FUNC void *load_data(int fd, unsigned long file_offset, unsigned long size);
 ST_FUNC int tcc_object_type(int fd, ElfW(Ehdr) *h);
 ST_FUNC int tcc_load_object_file(TCCState *s1, int fd, unsigned long file_offset);
@@ -1648,6 +1730,10 @@ ST_FUNC void o(unsigned int c);
 ST_FUNC void gen_vla_sp_save(int addr);
 ST_FUNC void gen_vla_sp_restore(int addr);
 ST_FUNC void gen_vla_alloc(CType *type, int align);
+#ifdef NB_REGVARS
+ST_DATA int func_regvars; /* registers gfunc_prolog() saves for variables */
+ST_FUNC int gen_regvar(int c, int t, int param);
+#endif
 
 static inline uint16_t read16le(unsigned char *p) {
     return p[0] | (uint16_t)p[1] << 8;
@@ -1685,6 +1771,8 @@ ST_FUNC void gen_addr32(int r, Sym *sym, int c);
 ST_FUNC void gen_addrpc32(int r, Sym *sym, int c);
 ST_FUNC void gen_cvt_csti(int t);
 ST_FUNC void gen_increment_tcov (SValue *sv);
+ST_FUNC void gen_tcov_shard(int loc);
+ST_FUNC void gen_increment_tcov_shard (SValue *sv, int loc);
 #endif
 
 /* ------------ x86_64-gen.c ------------ */
@@ -1696,6 +1784,9 @@ ST_FUNC void gen_vla_result(int addr);
 #endif
 ST_FUNC void gen_cvt_sxtw(void);
 ST_FUNC void gen_cvt_csti(int t);
+ST_FUNC void gen_label(void);
+ST_FUNC void gen_peep_reset(void);
+ST_FUNC void gen_store_imm(int t, int fc, int c);
 #endif
 
 /* ------------ arm-gen.c ------------ */
@@ -1812,6 +1903,7 @@ ST_FUNC int tcc_tool_ar(TCCState *s, int argc, char **argv);
 #ifdef TCC_TARGET_PE
 ST_FUNC int tcc_tool_impdef(TCCState *s, int argc, char **argv);
 #endif
+ST_FUNC int tcc_tool_tcov(TCCState *s, int argc, char **argv);
 ST_FUNC int tcc_tool_cross(TCCState *s, char **argv, int option);
 ST_FUNC int gen_makedeps(TCCState *s, const char *target, const char *filename);
 #endif
@@ -1819,6 +1911,7 @@ ST_FUNC int gen_makedeps(TCCState *s, const char *target, const char *filename);
 /* ------------ tccdbg.c ------------ */
 
 ST_FUNC void tcc_debug_new(TCCState *s);
+ST_FUNC void tcc_debug_clone(TCCState *s1);
 
 ST_FUNC void tcc_debug_start(TCCState *s1);
 ST_FUNC void tcc_debug_end(TCCState *s1);
@@ -1836,8 +1929,16 @@ ST_FUNC void tcc_debug_typedef(TCCState *s1, Sym *sym);
 ST_FUNC void tcc_debug_stabn(TCCState *s1, int type, int value);
 ST_FUNC void tcc_debug_fix_anon(TCCState *s1, CType *t);
 
+/* -ftest-coverage=... */
+#define TCOV_ON      1
+#define TCOV_THREAD  2  /* counters per thread (i386, x86_64) */
+#define TCOV_ATOMIC  4  /* locked increments (i386, x86_64) */
+#define TCOV_BINARY  8  /* write a binary .tcovb file */
+#define TCOV_SHARDS 16  /* copies of the counters, as in lib/tcov.c */
+
 ST_FUNC void tcc_tcov_start(TCCState *s1);
 ST_FUNC void tcc_tcov_end(TCCState *s1);
+ST_FUNC void tcc_tcov_prolog(TCCState *s1);
 ST_FUNC void tcc_tcov_check_line(TCCState *s1, int start);
 ST_FUNC void tcc_tcov_block_end(TCCState *s1, int line);
 ST_FUNC void tcc_tcov_block_begin(TCCState *s1);
@@ -1846,6 +1947,7 @@ ST_FUNC void tcc_tcov_reset_ind(TCCState *s1);
 #define stab_section            s1->stab_section
 #define stabstr_section         stab_section->link
 #define tcov_section            s1->tcov_section
+#define tcov_shard_section      s1->tcov_shard_section
 #define dwarf_info_section      s1->dwarf_info_section
 #define dwarf_abbrev_section    s1->dwarf_abbrev_section
 #define dwarf_line_section      s1->dwarf_line_section
@@ -1884,8 +1986,8 @@ typedef struct { int init; dispatch_semaphore_t sem; } TCCSem;
 #include <semaphore.h>
 typedef struct { int init; sem_t sem; } TCCSem;
 #endif
-ST_FUNC void wait_sem(TCCSem *p);
-ST_FUNC void post_sem(TCCSem *p);
+ST_INLN void wait_sem(TCCSem *p);
+ST_INLN void post_sem(TCCSem *p);
 #define TCC_SEM(s) TCCSem s
 #define WAIT_SEM wait_sem
 #define POST_SEM post_sem
@@ -1898,9 +2000,9 @@ ST_FUNC void post_sem(TCCSem *p);
 /********************************************************/
 #undef ST_DATA
 #if ONE_SOURCE
-#define ST_DATA static
+#define ST_DATA static ST_TLS
 #else
-#define ST_DATA
+#define ST_DATA ST_TLS
 #endif
 /********************************************************/
 
@@ -1950,35 +2052,35 @@ PUB_FUNC void tcc_exit_state(TCCState *s1);
 #if CONFIG_TCC_SEMLOCK && TCC_SEM_IMPL
 #undef TCC_SEM_IMPL
 #if defined _WIN32
-ST_FUNC void wait_sem(TCCSem *p)
+ST_INLN void wait_sem(TCCSem *p)
 {
     if (!p->init)
         InitializeCriticalSection(&p->cr), p->init = 1;
     EnterCriticalSection(&p->cr);
 }
-ST_FUNC void post_sem(TCCSem *p)
+ST_INLN void post_sem(TCCSem *p)
 {
     LeaveCriticalSection(&p->cr);
 }
 #elif defined __APPLE__
-ST_FUNC void wait_sem(TCCSem *p)
+ST_INLN void wait_sem(TCCSem *p)
 {
     if (!p->init)
         p->sem = dispatch_semaphore_create(1), p->init = 1;
     dispatch_semaphore_wait(p->sem, DISPATCH_TIME_FOREVER);
 }
-ST_FUNC void post_sem(TCCSem *p)
+ST_INLN void post_sem(TCCSem *p)
 {
     dispatch_semaphore_signal(p->sem);
 }
 #else
-ST_FUNC void wait_sem(TCCSem *p)
+ST_INLN void wait_sem(TCCSem *p)
 {
     if (!p->init)
         sem_init(&p->sem, 0, 1), p->init = 1;
     while (sem_wait(&p->sem) < 0 && errno == EINTR);
 }
-ST_FUNC void post_sem(TCCSem *p)
+ST_INLN void post_sem(TCCSem *p)
 {
     sem_post(&p->sem);
 }
@@ -22,8 +22,8 @@
 #include "tcc.h"
 #ifdef CONFIG_TCC_ASM
 
-static Section *last_text_section; /* to handle .previous asm directive */
-static int asmgoto_n;
+static ST_TLS Section *last_text_section; /* to handle .previous asm directive */
+static ST_TLS int asmgoto_n;
 
 static int asm_get_prefix_name(TCCState *s1, const char *prefix, unsigned int n)
 {
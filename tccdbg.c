@@ -388,6 +388,9 @@ struct _tccdbg {
         unsigned long last_func_name;
         int ind;
         int line;
+        unsigned long shard_base; /* of this file in tcov_shard_section */
+        int nb_shard; /* counters there */
+        int shard_loc; /* frame offset of the thread's shard, or 0 */
     } tcov_data;
 
 };
@@ -411,6 +414,13 @@ struct _tccdbg {
 static void put_stabs(TCCState *s1, const char *str, int type, int other,
     int desc, unsigned long value);
 
+/* give a cloned state its own, idle debug state */
+ST_FUNC void tcc_debug_clone(TCCState *s1)
+{
+    if (s1->dState)
+        s1->dState = tcc_mallocz(sizeof *s1->dState);
+}
+
 ST_FUNC void tcc_debug_new(TCCState *s1)
 {
     int shf = 0;
@@ -2022,6 +2032,12 @@ ST_FUNC void tcc_debug_typedef(TCCState *s1, Sym *sym)
 /* ------------------------------------------------------------------------- */
 /* for section layout see lib/tcov.c */
 
+#if defined TCC_TARGET_I386 || defined TCC_TARGET_X86_64
+# define TCOV_THREAD_OK TCOV_THREAD
+#else
+# define TCOV_THREAD_OK 0 /* no per thread counters */
+#endif
+
 ST_FUNC void tcc_tcov_block_end(TCCState *s1, int line);
 
 ST_FUNC void tcc_tcov_block_begin(TCCState *s1)
@@ -2093,6 +2109,23 @@ ST_FUNC void tcc_tcov_block_begin(TCCState *s1)
         sv.r2 = VT_CONST;
         sv.c.i = 0;
         sv.sym = &label;
+#if TCOV_THREAD_OK
+        if (tcov_data.shard_loc) {
+            /* the counter is the address of the first copy, the copies
+               of 8 counters are in the same 64 bytes */
+            int n = tcov_data.nb_shard++;
+            Sym counter = {0};
+            counter.type = label.type;
+            write64le (ptr, (tcov_data.line << 8) | 0xfe);
+            put_extern_sym(&counter, tcov_shard_section, tcov_data.shard_base
+                           + n / 8 * (TCOV_SHARDS * 64) + n % 8 * 8, 0);
+            greloca(tcov_section, &counter,
+                    (unsigned char *)ptr - tcov_section->data + 8,
+                    R_DATA_PTR, 0);
+            sv.sym = &counter;
+            gen_increment_tcov_shard (&sv, tcov_data.shard_loc);
+        } else
+#endif
 #if defined TCC_TARGET_I386 || defined TCC_TARGET_X86_64 || \
     defined TCC_TARGET_ARM || defined TCC_TARGET_ARM64 || \
     defined TCC_TARGET_RISCV64
@@ -2149,6 +2182,12 @@ ST_FUNC void tcc_tcov_start(TCCState *s1)
 				   SHF_ALLOC | SHF_WRITE);
 	section_ptr_add(tcov_section, 4); // pointer to executable name
     }
+    if (s1->test_coverage & TCOV_THREAD_OK) {
+        if (tcov_shard_section == NULL)
+            tcov_shard_section = new_section(tcc_state, ".tcovs", SHT_NOBITS,
+                                             SHF_ALLOC | SHF_WRITE);
+        tcov_data.shard_base = section_add(tcov_shard_section, 0, 64);
+    }
 }
 
 ST_FUNC void tcc_tcov_end(TCCState *s1)
@@ -2159,6 +2198,24 @@ ST_FUNC void tcc_tcov_end(TCCState *s1)
         section_ptr_add(tcov_section, 1);
     if (tcov_data.last_file_name)
         section_ptr_add(tcov_section, 1);
+    if (tcov_data.nb_shard)
+        section_add(tcov_shard_section,
+                    (tcov_data.nb_shard + 7) / 8 * (TCOV_SHARDS * 64), 1);
+}
+
+/* at function entry, after the prolog */
+ST_FUNC void tcc_tcov_prolog(TCCState *s1)
+{
+    if (s1->test_coverage == 0)
+	return;
+    tcov_data.shard_loc = 0;
+#if TCOV_THREAD_OK
+    if (s1->test_coverage & TCOV_THREAD) {
+        loc = (loc - 8) & -8;
+        tcov_data.shard_loc = loc;
+        gen_tcov_shard(loc);
+    }
+#endif
 }
 
 ST_FUNC void tcc_tcov_reset_ind(TCCState *s1)
@@ -141,6 +141,111 @@ ST_FUNC void tccelf_delete(TCCState *s1)
     symtab_section = NULL; /* for tccrun.c:rt_printline() */
 }
 
+static Section *clone_map(TCCState *s1, TCCState *s, Section *sec)
+{
+    int i;
+    if (sec) {
+        for (i = 1; i < s->nb_sections; i++)
+            if (s->sections[i] == sec)
+                return s1->sections[i];
+        for (i = 0; i < s->nb_priv_sections; i++)
+            if (s->priv_sections[i] == sec)
+                return s1->priv_sections[i];
+    }
+    return NULL;
+}
+
+static Section *clone_section(TCCState *s1, Section *sec)
+{
+    Section *n = tcc_malloc(sizeof(Section) + strlen(sec->name));
+    memcpy(n, sec, sizeof(Section) + strlen(sec->name));
+    n->s1 = s1;
+    if (sec->data_allocated) {
+        n->data = tcc_malloc(sec->data_allocated);
+        memcpy(n->data, sec->data, sec->data_allocated);
+    }
+    return n;
+}
+
+/* copy sections and symbol tables of 's' into 's1' (a memcpy of 's') */
+ST_FUNC void tccelf_clone(TCCState *s1, TCCState *s)
+{
+    Section *sec;
+    int i;
+
+    s1->sections = s1->priv_sections = NULL;
+    s1->nb_sections = s1->nb_priv_sections = 0;
+    dynarray_add(&s1->sections, &s1->nb_sections, NULL);
+    for (i = 1; i < s->nb_sections; i++)
+        dynarray_add(&s1->sections, &s1->nb_sections,
+            clone_section(s1, s->sections[i]));
+    for (i = 0; i < s->nb_priv_sections; i++)
+        dynarray_add(&s1->priv_sections, &s1->nb_priv_sections,
+            clone_section(s1, s->priv_sections[i]));
+    for (i = 1; i < s1->nb_sections + s1->nb_priv_sections; i++) {
+        sec = i < s1->nb_sections ? s1->sections[i]
+            : s1->priv_sections[i - s1->nb_sections];
+        sec->link = clone_map(s1, s, sec->link);
+        sec->reloc = clone_map(s1, s, sec->reloc);
+        sec->hash = clone_map(s1, s, sec->hash);
+        sec->prev = clone_map(s1, s, sec->prev);
+    }
+
+    text_section = clone_map(s1, s, text_section);
+    data_section = clone_map(s1, s, data_section);
+    rodata_section = clone_map(s1, s, rodata_section);
+    bss_section = clone_map(s1, s, bss_section);
+    common_section = clone_map(s1, s, common_section);
+    cur_text_section = clone_map(s1, s, cur_text_section);
+#ifdef CONFIG_TCC_BCHECK
+    bounds_section = clone_map(s1, s, bounds_section);
+    lbounds_section = clone_map(s1, s, lbounds_section);
+#endif
+    symtab_section = clone_map(s1, s, symtab_section);
+    s1->dynsymtab_section = clone_map(s1, s, s1->dynsymtab_section);
+    s1->dynsym = clone_map(s1, s, s1->dynsym);
+    s1->got = clone_map(s1, s, s1->got);
+    s1->plt = clone_map(s1, s, s1->plt);
+    stab_section = clone_map(s1, s, stab_section);
+    dwarf_info_section = clone_map(s1, s, dwarf_info_section);
+    dwarf_abbrev_section = clone_map(s1, s, dwarf_abbrev_section);
+    dwarf_line_section = clone_map(s1, s, dwarf_line_section);
+    dwarf_aranges_section = clone_map(s1, s, dwarf_aranges_section);
+    dwarf_str_section = clone_map(s1, s, dwarf_str_section);
+    dwarf_line_str_section = clone_map(s1, s, dwarf_line_str_section);
+    tcov_section = clone_map(s1, s, tcov_section);
+    tcov_shard_section = clone_map(s1, s, tcov_shard_section);
+#if defined TCC_TARGET_PE && defined TCC_TARGET_X86_64
+    s1->uw_pdata = clone_map(s1, s, s1->uw_pdata);
+#endif
+    qrel = NULL;
+
+    if (s->nb_sym_attrs) {
+        s1->sym_attrs = tcc_malloc(s->nb_sym_attrs * sizeof *s1->sym_attrs);
+        memcpy(s1->sym_attrs, s->sym_attrs,
+            s->nb_sym_attrs * sizeof *s1->sym_attrs);
+    }
+
+#ifndef ELF_OBJ_ONLY
+    versym_section = clone_map(s1, s, versym_section);
+    verneed_section = clone_map(s1, s, verneed_section);
+    if (nb_sym_versions) {
+        struct sym_version *sv = sym_versions;
+        sym_versions = tcc_malloc(nb_sym_versions * sizeof *sv);
+        for (i = 0; i < nb_sym_versions; i++) {
+            sym_versions[i] = sv[i];
+            sym_versions[i].lib = tcc_strdup(sv[i].lib);
+            sym_versions[i].version = tcc_strdup(sv[i].version);
+        }
+    }
+    if (nb_sym_to_version) {
+        int *sv = sym_to_version;
+        sym_to_version = tcc_malloc(nb_sym_to_version * sizeof *sv);
+        memcpy(sym_to_version, sv, nb_sym_to_version * sizeof *sv);
+    }
+#endif
+}
+
 /* save section data state */
 ST_FUNC void tccelf_begin_file(TCCState *s1)
 {
@@ -158,6 +263,7 @@ ST_FUNC void tccelf_begin_file(TCCState *s1)
 }
 
 static void update_relocs(TCCState *s1, Section *s, int *old_to_new_syms, int first_sym);
+static ElfW(Word) elf_hash(const unsigned char *name);
 
 /* At the end of compilation, convert any UNDEF syms to global, and merge
    with previously existing symbols */
@@ -202,6 +308,62 @@ ST_FUNC void tccelf_end_file(TCCState *s1)
     }
 }
 
+#ifdef TCC_IS_NATIVE
+/* more code for a relocated state: keep what the file added, or drop
+   it after errors such that the state remains usable */
+ST_FUNC void tccelf_end_delta(TCCState *s1)
+{
+    Section *s = s1->symtab, *sec;
+    ElfW(Sym) *sym;
+    int i;
+
+    if (s1->nb_errors) {
+        if (s->hash)
+            drop_elf_syms(s, s->sh_offset / sizeof (ElfW(Sym)));
+        else /* stopped during the file, before hashing */
+            s->hash = s->reloc, s->reloc = NULL;
+    }
+    for (i = 1; i < s1->nb_sections; i++) {
+        sec = s1->sections[i];
+        if (s1->nb_errors)
+            sec->data_offset = sec->sh_offset;
+        else
+            sec->sh_offset = sec->data_offset;
+    }
+    if (0 == s1->nb_errors)
+        return;
+    /* symbols from before that the file defined are undefined again */
+    for_each_elem(s, 1, sym, ElfW(Sym)) {
+        i = sym->st_shndx;
+        if (i != SHN_UNDEF && i < SHN_LORESERVE
+            && (sym->st_value > s1->sections[i]->data_offset
+                || (sym->st_value == s1->sections[i]->data_offset
+                    && sym->st_size)))
+            sym->st_shndx = SHN_UNDEF, sym->st_value = 0;
+    }
+}
+
+/* remove the symbols from 'first' on, which are the newest and thus
+   come first in their hash chains */
+ST_FUNC void drop_elf_syms(Section *s, int first)
+{
+    int *base = (int *)s->hash->data, nb_buckets = base[0], i;
+    ElfW(Sym) *sym;
+
+    for (i = s->data_offset / sizeof (ElfW(Sym)); --i >= first; ) {
+        sym = (ElfW(Sym) *)s->data + i;
+        if (ELFW(ST_BIND)(sym->st_info) != STB_LOCAL) {
+            base[2 + elf_hash(s->link->data + sym->st_name) % nb_buckets]
+                = base[2 + nb_buckets + i];
+            s->hash->nb_hashed_syms--;
+        }
+    }
+    base[1] = first;
+    s->hash->data_offset = (2 + nb_buckets + first) * sizeof (int);
+    s->data_offset = first * sizeof (ElfW(Sym));
+}
+#endif
+
 ST_FUNC Section *new_section(TCCState *s1, const char *name, int sh_type, int sh_flags)
 {
     Section *sec;
@@ -504,7 +666,12 @@ ST_FUNC addr_t get_sym_addr(TCCState *s1, const char *name, int err, int forc)
     }
     sym_index = find_elf_sym(s1->symtab, name);
     sym = &((ElfW(Sym) *)s1->symtab->data)[sym_index];
-    if (!sym_index || sym->st_shndx == SHN_UNDEF) {
+    if (!sym_index || sym->st_shndx == SHN_UNDEF
+#ifdef TCC_IS_NATIVE
+        /* code added to a relocated state shows after its tcc_relocate() */
+        || (s1->run_ptr && sym->st_shndx < SHN_LORESERVE)
+#endif
+        ) {
         if (err)
             tcc_error_noabort("%s not defined", name);
         return (addr_t)-1;
@@ -533,7 +700,12 @@ ST_FUNC void list_elf_symbols(TCCState *s, void *ctx,
     end_sym = symtab->data_offset / sizeof (ElfSym);
     for (sym_index = 0; sym_index < end_sym; ++sym_index) {
         sym = &((ElfW(Sym) *)symtab->data)[sym_index];
-        if (sym->st_value) {
+        if (sym->st_value
+#ifdef TCC_IS_NATIVE
+            && !(s->run_ptr && sym->st_shndx != SHN_UNDEF
+                 && sym->st_shndx < SHN_LORESERVE)
+#endif
+            ) {
             name = (char *) symtab->link->data + sym->st_name;
             sym_bind = ELFW(ST_BIND)(sym->st_info);
             sym_vis = ELFW(ST_VISIBILITY)(sym->st_other);
@@ -1638,11 +1810,23 @@ ST_FUNC void tcc_add_btstub(TCCState *s1)
 }
 #endif /* def CONFIG_TCC_BACKTRACE */
 
+/* FNV-1a hash of the unrelocated code */
+static uint64_t tcov_stamp(Section *s)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    addr_t i;
+
+    for (i = 0; i < s->data_offset; i++)
+        h = (h ^ s->data[i]) * 0x100000001b3ULL;
+    return h;
+}
+
 static void tcc_tcov_add_file(TCCState *s1, const char *filename)
 {
     CString cstr;
     void *ptr;
     char wd[1024];
+    const char *ext = s1->test_coverage & TCOV_BINARY ? "tcovb" : "tcov";
 
     if (tcov_section == NULL)
         return;
@@ -1651,10 +1835,10 @@ static void tcc_tcov_add_file(TCCState *s1, const char *filename)
 
     cstr_new (&cstr);
     if (filename[0] == '/')
-        cstr_printf (&cstr, "%s.tcov", filename);
+        cstr_printf (&cstr, "%s.%s", filename, ext);
     else {
         getcwd (wd, sizeof(wd));
-        cstr_printf (&cstr, "%s/%s.tcov", wd, filename);
+        cstr_printf (&cstr, "%s/%s.%s", wd, filename, ext);
     }
     ptr = section_ptr_add(tcov_section, cstr.size + 1);
     strcpy((char *)ptr, cstr.data);
@@ -1663,6 +1847,9 @@ static void tcc_tcov_add_file(TCCState *s1, const char *filename)
     normalize_slashes((char *)ptr);
 #endif
     cstr_free (&cstr);
+    /* stamp of the code: a .tcovb from another build is not merged */
+    ptr = section_ptr_add(tcov_section, 8);
+    write64le(ptr, tcov_stamp(text_section));
 
     cstr_new(&cstr);
     cstr_printf(&cstr,
@@ -1863,6 +2050,10 @@ ST_FUNC void resolve_common_syms(TCCState *s1)
     }
 
     /* Now assign linker provided symbols their value.  */
+#ifdef TCC_IS_NATIVE
+    if (s1->run_ptr)
+        return; /* done with the first tcc_relocate() */
+#endif
     tcc_add_linker_symbols(s1);
 }
 
@@ -2661,6 +2852,7 @@ static int tcc_write_elf_file(TCCState *s1, const char *filename, int phnum,
     int fd, mode, file_type, ret;
     FILE *f;
 
+    PROF_SWITCH(s1, TP_OUTPUT);
     file_type = s1->output_type;
     if (file_type == TCC_OUTPUT_OBJ)
         mode = 0666;
@@ -2911,6 +3103,7 @@ static int elf_output_file(TCCState *s1, const char *filename)
     /* compute section to program header mapping */
     layout_sections(s1, sec_order, &dyninf);
 
+        PROF_SWITCH(s1, TP_RELOC);
         if (dynamic) {
             /* put in GOT the dynamic section address and relocate PLT */
             write32le(s1->got->data, dynamic->sh_addr);
@@ -2937,6 +3130,7 @@ static int elf_output_file(TCCState *s1, const char *filename)
             fill_got(s1);
         else if (s1->got)
             fill_local_got_entries(s1);
+        PROF_SWITCH(s1, TP_LINK);
 
     if (dyninf.gnu_hash)
         update_gnu_hash(s1, dyninf.gnu_hash);
@@ -2994,17 +3188,21 @@ static int elf_output_obj(TCCState *s1, const char *filename)
 
 LIBTCCAPI int tcc_output_file(TCCState *s, const char *filename)
 {
+    int ret, ph = PROF_SWITCH(s, TP_LINK);
     if (s->test_coverage)
         tcc_tcov_add_file(s, filename);
     if (s->output_type == TCC_OUTPUT_OBJ)
-        return elf_output_obj(s, filename);
+        ret = elf_output_obj(s, filename);
+    else
 #ifdef TCC_TARGET_PE
-    return  pe_output_file(s, filename);
+    ret = pe_output_file(s, filename);
 #elif TCC_TARGET_MACHO
-    return macho_output_file(s, filename);
+    ret = macho_output_file(s, filename);
 #else
-    return elf_output_file(s, filename);
+    ret = elf_output_file(s, filename);
 #endif
+    PROF_SWITCH(s, ph);
+    return ret;
 }
 
 ST_FUNC ssize_t full_read(int fd, void *buf, size_t count) {
@@ -3029,6 +3227,87 @@ ST_FUNC void *load_data(int fd, unsigned long file_offset, unsigned long size)
     return data;
 }
 
+/* smaller data is cheaper to read than to map */
+#define MAP_MIN_SIZE (64 * 1024)
+
+/* map file data read-only, NULL on error */
+ST_FUNC void *map_data(int fd, unsigned long file_offset, unsigned long size)
+{
+#ifndef _WIN32
+    if (size >= MAP_MIN_SIZE) {
+        unsigned long d = file_offset & (sysconf(_SC_PAGESIZE) - 1);
+        char *p = mmap(NULL, size + d, PROT_READ, MAP_PRIVATE, fd, file_offset - d);
+        return p == MAP_FAILED ? NULL : p + d;
+    }
+#endif
+    return load_data(fd, file_offset, size);
+}
+
+ST_FUNC void unmap_data(void *data, unsigned long size)
+{
+#ifndef _WIN32
+    if (size >= MAP_MIN_SIZE) {
+        unsigned long d = (uintptr_t)data & (sysconf(_SC_PAGESIZE) - 1);
+        munmap((char*)data - d, size + d);
+        return;
+    }
+#endif
+    tcc_free(data);
+}
+
+/* whether ELF structures can be read in place at 'p' */
+#if defined __i386__ || defined __x86_64__ || defined __aarch64__
+# define ELF_IN_PLACE(p) 1
+#else
+# define ELF_IN_PLACE(p) (0 == ((uintptr_t)(p) & (sizeof(ElfW(Addr)) - 1)))
+#endif
+
+static void *elf_in_place(void *p, unsigned long size, void **copy)
+{
+    if (ELF_IN_PLACE(p))
+        return p;
+    return *copy = memcpy(tcc_malloc(size), p, size);
+}
+
+/* map an ELF file at 'file_offset' up to the end of its last section,
+   NULL if the section table does not fit in the file */
+static uint8_t *map_elf(int fd, unsigned long file_offset,
+                        ElfW(Ehdr) *ehdr, unsigned long *psize)
+{
+    ElfW(Shdr) *sh;
+    unsigned long size, end, max;
+    uint8_t *data;
+    int i;
+
+    max = lseek(fd, 0, SEEK_END);
+    if (max < file_offset)
+        return NULL;
+    max -= file_offset;
+    if (ehdr->e_shoff > max)
+        return NULL;
+    /* the section table usually comes last */
+    size = ehdr->e_shoff + sizeof(ElfW(Shdr)) * ehdr->e_shnum;
+    for (;;) {
+        if (size > max || !(data = map_data(fd, file_offset, size)))
+            return NULL;
+        sh = (ElfW(Shdr) *)(data + ehdr->e_shoff);
+        for (end = size, i = 0; i < ehdr->e_shnum; i++, sh++) {
+            if (sh->sh_type == SHT_NOBITS)
+                continue;
+            if (sh->sh_offset > max || sh->sh_size > max - sh->sh_offset)
+                end = max + 1;
+            else if (sh->sh_offset + sh->sh_size > end)
+                end = sh->sh_offset + sh->sh_size;
+        }
+        if (end == size)
+            break;
+        unmap_data(data, size);
+        size = end;
+    }
+    *psize = size;
+    return data;
+}
+
 typedef struct SectionMergeInfo {
     Section *s;            /* corresponding existing section */
     unsigned long offset;  /* offset of the new section in the existing section */
@@ -3062,8 +3341,11 @@ ST_FUNC int tcc_load_object_file(TCCState *s1,
 {
     ElfW(Ehdr) ehdr;
     ElfW(Shdr) *shdr, *sh;
-    unsigned long size, offset, offseti;
-    int i, j, nb_syms, sym_index, ret, seencompressed;
+    unsigned long size, offset, offseti, data_size, align;
+    int i, j, nb_syms, sym_index, ret, seencompressed, shndx;
+    uint8_t *data;
+    void *shdr_copy, *symtab_copy;
+    addr_t value;
     char *strsec, *strtab;
     int stab_index, stabstr_index;
     int *old_to_new_syms;
@@ -3082,16 +3364,20 @@ ST_FUNC int tcc_load_object_file(TCCState *s1,
 invalid:
         return tcc_error_noabort("invalid object file");
     }
-    /* read sections */
-    shdr = load_data(fd, file_offset + ehdr.e_shoff,
-                     sizeof(ElfW(Shdr)) * ehdr.e_shnum);
+    /* map the file, section contents are copied from there */
+    data = map_elf(fd, file_offset, &ehdr, &data_size);
+    if (!data)
+        goto invalid;
+    shdr_copy = symtab_copy = NULL;
+    shdr = elf_in_place(data + ehdr.e_shoff,
+                        sizeof(ElfW(Shdr)) * ehdr.e_shnum, &shdr_copy);
     sm_table = tcc_mallocz(sizeof(SectionMergeInfo) * ehdr.e_shnum);
 
-    /* load section names */
+    /* section names */
     sh = &shdr[ehdr.e_shstrndx];
-    strsec = load_data(fd, file_offset + sh->sh_offset, sh->sh_size);
+    strsec = (char *)data + sh->sh_offset;
 
-    /* load symtab and strtab */
+    /* find symtab and strtab */
     old_to_new_syms = NULL;
     symtab = NULL;
     strtab = NULL;
@@ -3108,12 +3394,13 @@ invalid:
                 goto the_end;
             }
             nb_syms = sh->sh_size / sizeof(ElfW(Sym));
-            symtab = load_data(fd, file_offset + sh->sh_offset, sh->sh_size);
+            symtab = elf_in_place(data + sh->sh_offset,
+                                  sh->sh_size, &symtab_copy);
             sm_table[i].s = symtab_section;
 
-            /* now load strtab */
+            /* the strtab */
             sh = &shdr[sh->sh_link];
-            strtab = load_data(fd, file_offset + sh->sh_offset, sh->sh_size);
+            strtab = (char *)data + sh->sh_offset;
         }
 	if (sh->sh_flags & SHF_COMPRESSED)
 	    seencompressed = 1;
@@ -3149,8 +3436,9 @@ invalid:
 
 	sh = &shdr[i];
         sh_name = strsec + sh->sh_name;
-        if (sh->sh_addralign < 1)
-            sh->sh_addralign = 1;
+        align = sh->sh_addralign;
+        if (align < 1)
+            align = 1;
         /* find corresponding section, if any */
         for(j = 1; j < s1->nb_sections;j++) {
             s = s1->sections[j];
@@ -3177,7 +3465,7 @@ invalid:
         s = new_section(s1, sh_name, sh->sh_type, sh->sh_flags & ~SHF_GROUP);
         /* take as much info as possible from the section. sh_link and
            sh_info will be updated later */
-        s->sh_addralign = sh->sh_addralign;
+        s->sh_addralign = align;
         s->sh_entsize = sh->sh_entsize;
         sm_table[i].new_section = 1;
     found:
@@ -3190,18 +3478,15 @@ invalid:
             goto the_end;
         }
         /* align start of section */
-        s->data_offset += -s->data_offset & (sh->sh_addralign - 1);
-        if (sh->sh_addralign > s->sh_addralign)
-            s->sh_addralign = sh->sh_addralign;
+        s->data_offset += -s->data_offset & (align - 1);
+        if (align > s->sh_addralign)
+            s->sh_addralign = align;
         sm_table[i].offset = s->data_offset;
         sm_table[i].s = s;
         /* concatenate sections */
         size = sh->sh_size;
         if (sh->sh_type != SHT_NOBITS) {
-            unsigned char *ptr;
-            lseek(fd, file_offset + sh->sh_offset, SEEK_SET);
-            ptr = section_ptr_add(s, size);
-            full_read(fd, ptr, size);
+            memcpy(section_ptr_add(s, size), data + sh->sh_offset, size);
         } else {
             s->data_offset += size;
         }
@@ -3244,9 +3529,10 @@ invalid:
 
     sym = symtab + 1;
     for(i = 1; i < nb_syms; i++, sym++) {
-        if (sym->st_shndx != SHN_UNDEF &&
-            sym->st_shndx < SHN_LORESERVE) {
-            sm = &sm_table[sym->st_shndx];
+        shndx = sym->st_shndx;
+        value = sym->st_value;
+        if (shndx != SHN_UNDEF && shndx < SHN_LORESERVE) {
+            sm = &sm_table[shndx];
             if (sm->link_once) {
                 /* if a symbol is in a link once section, we use the
                    already defined symbol. It is very important to get
@@ -3263,15 +3549,14 @@ invalid:
             if (!sm->s)
                 continue;
             /* convert section number */
-            sym->st_shndx = sm->s->sh_num;
+            shndx = sm->s->sh_num;
             /* offset value */
-            sym->st_value += sm->offset;
+            value += sm->offset;
         }
         /* add symbol */
         name = strtab + sym->st_name;
-        sym_index = set_elf_sym(symtab_section, sym->st_value, sym->st_size,
-                                sym->st_info, sym->st_other,
-                                sym->st_shndx, name);
+        sym_index = set_elf_sym(symtab_section, value, sym->st_size,
+                                sym->st_info, sym->st_other, shndx, name);
         old_to_new_syms[i] = sym_index;
     }
 
@@ -3337,12 +3622,11 @@ invalid:
 
     ret = 0;
  the_end:
-    tcc_free(symtab);
-    tcc_free(strtab);
+    tcc_free(symtab_copy);
+    tcc_free(shdr_copy);
     tcc_free(old_to_new_syms);
     tcc_free(sm_table);
-    tcc_free(strsec);
-    tcc_free(shdr);
+    unmap_data(data, data_size);
     return ret;
 }
 
@@ -3384,51 +3668,76 @@ static int read_ar_header(int fd, int offset, ArchiveHeader *hdr)
     return len;
 }
 
-/* load only the objects which resolve undefined symbols */
-static int tcc_load_alacarte(TCCState *s1, int fd, int size, int entrysize)
+/* load only the objects which resolve undefined symbols.  The archive
+   index is hashed once, then the symbol table is walked once, including
+   the undefined symbols that the loaded objects add to it. */
+static int tcc_load_alacarte(TCCState *s1, int fd, unsigned long offset,
+                             int size, int entrysize)
 {
-    int i, bound, nsyms, sym_index, len, ret = -1;
+    int i, h, n, nsyms, sym_index, len, ret = -1, *tab = NULL;
     unsigned long long off;
     uint8_t *data;
-    const char *ar_names, *p;
+    const char *ar_names, *p, *e, **names = NULL;
     const uint8_t *ar_index;
+    Section *s = symtab_section;
     ElfW(Sym) *sym;
     ArchiveHeader hdr;
 
-    data = tcc_malloc(size);
-    if (full_read(fd, data, size) != size)
-        goto the_end;
+    /* a mapping beyond the end of the file faults when read */
+    if (size < entrysize || offset + size > (unsigned long)lseek(fd, 0, SEEK_END)
+        || !(data = map_data(fd, offset, size)))
+        return tcc_error_noabort("invalid archive");
     nsyms = get_be(data, entrysize);
     ar_index = data + entrysize;
     ar_names = (char *) ar_index + nsyms * entrysize;
+    e = (char *) data + size;
+    if (nsyms < 0 || nsyms >= size / entrysize) {
+        tcc_error_noabort("invalid archive");
+        goto the_end;
+    }
 
-    do {
-        bound = 0;
-        for (p = ar_names, i = 0; i < nsyms; i++, p += strlen(p)+1) {
-            Section *s = symtab_section;
-            sym_index = find_elf_sym(s, p);
-            if (!sym_index)
-                continue;
-            sym = &((ElfW(Sym) *)s->data)[sym_index];
-            if(sym->st_shndx != SHN_UNDEF)
-                continue;
-            off = get_be(ar_index + i * entrysize, entrysize);
-            len = read_ar_header(fd, off, &hdr);
-            if (len <= 0 || memcmp(hdr.ar_fmag, ARFMAG, 2)) {
-                tcc_error_noabort("invalid archive");
-                goto the_end;
-            }
-            off += len;
-            if (s1->verbose == 2)
-                printf("   -> %s\n", hdr.ar_name);
-            if (tcc_load_object_file(s1, fd, off) < 0)
-                goto the_end;
-            ++bound;
+    /* open addressing, first definition wins */
+    for (n = 1; n < 2 * nsyms; n *= 2)
+        ;
+    tab = tcc_mallocz(n * sizeof *tab);
+    names = tcc_malloc((nsyms + 1) * sizeof *names);
+    for (p = ar_names, i = 0; i < nsyms && p < e; i++, p += strnlen(p, e - p) + 1) {
+        names[i] = p;
+        for (h = elf_hash((uint8_t *)p) & (n - 1); tab[h]; h = (h + 1) & (n - 1))
+            if (!strcmp(names[tab[h] - 1], p))
+                goto next;
+        tab[h] = i + 1;
+    next: ;
+    }
+    nsyms = i;
+
+    for (sym_index = 1; sym_index < s->data_offset / sizeof (ElfW(Sym)); ++sym_index) {
+        sym = &((ElfW(Sym) *)s->data)[sym_index];
+        if (sym->st_shndx != SHN_UNDEF)
+            continue;
+        p = (char *) s->link->data + sym->st_name;
+        for (h = elf_hash((uint8_t *)p) & (n - 1); (i = tab[h]); h = (h + 1) & (n - 1))
+            if (!strcmp(names[i - 1], p))
+                break;
+        if (!i)
+            continue;
+        off = get_be(ar_index + (i - 1) * entrysize, entrysize);
+        len = read_ar_header(fd, off, &hdr);
+        if (len <= 0 || memcmp(hdr.ar_fmag, ARFMAG, 2)) {
+            tcc_error_noabort("invalid archive");
+            goto the_end;
         }
-    } while(bound);
+        off += len;
+        if (s1->verbose == 2)
+            printf("   -> %s\n", hdr.ar_name);
+        if (tcc_load_object_file(s1, fd, off) < 0)
+            goto the_end;
+    }
     ret = 0;
  the_end:
-    tcc_free(data);
+    tcc_free(names);
+    tcc_free(tab);
+    unmap_data(data, size);
     return ret;
 }
 
@@ -3456,9 +3765,9 @@ ST_FUNC int tcc_load_archive(TCCState *s1, int fd, int alacarte)
         if (alacarte) {
             /* coff symbol table : we handle it */
             if (!strcmp(hdr.ar_name, "/"))
-                return tcc_load_alacarte(s1, fd, size, 4);
+                return tcc_load_alacarte(s1, fd, file_offset, size, 4);
             if (!strcmp(hdr.ar_name, "/SYM64/"))
-                return tcc_load_alacarte(s1, fd, size, 8);
+                return tcc_load_alacarte(s1, fd, file_offset, size, 8);
         } else if (tcc_object_type(fd, &ehdr) == AFF_BINTYPE_REL) {
             if (s1->verbose == 2)
                 printf("   -> %s\n", hdr.ar_name);
@@ -3612,7 +3921,8 @@ ST_FUNC int tcc_load_dll(TCCState *s1, int fd, const char *filename, int level)
     int i, nb_syms, nb_dts, sym_bind, ret = -1;
     ElfW(Sym) *sym, *dynsym;
     ElfW(Dyn) *dt, *dynamic;
-
+    uint8_t *data;
+    unsigned long data_size;
     char *dynstr;
     int sym_index;
     const char *name, *soname;
@@ -3626,8 +3936,11 @@ ST_FUNC int tcc_load_dll(TCCState *s1, int fd, const char *filename, int level)
         return tcc_error_noabort("bad architecture");
     }
 
-    /* read sections */
-    shdr = load_data(fd, ehdr.e_shoff, sizeof(ElfW(Shdr)) * ehdr.e_shnum);
+    /* map the file, the tables are read in place */
+    data = map_elf(fd, 0, &ehdr, &data_size);
+    if (!data)
+        return tcc_error_noabort("invalid shared library");
+    shdr = (ElfW(Shdr) *)(data + ehdr.e_shoff);
 
     /* load dynamic section and dynamic symbols */
     nb_syms = 0;
@@ -3641,23 +3954,23 @@ ST_FUNC int tcc_load_dll(TCCState *s1, int fd, const char *filename, int level)
         switch(sh->sh_type) {
         case SHT_DYNAMIC:
             nb_dts = sh->sh_size / sizeof(ElfW(Dyn));
-            dynamic = load_data(fd, sh->sh_offset, sh->sh_size);
+            dynamic = (ElfW(Dyn) *)(data + sh->sh_offset);
             break;
         case SHT_DYNSYM:
             nb_syms = sh->sh_size / sizeof(ElfW(Sym));
-            dynsym = load_data(fd, sh->sh_offset, sh->sh_size);
+            dynsym = (ElfW(Sym) *)(data + sh->sh_offset);
             sh1 = &shdr[sh->sh_link];
-            dynstr = load_data(fd, sh1->sh_offset, sh1->sh_size);
+            dynstr = (char *)data + sh1->sh_offset;
             break;
         case SHT_GNU_verdef:
-	    v.verdef = load_data(fd, sh->sh_offset, sh->sh_size);
+	    v.verdef = (ElfW(Verdef) *)(data + sh->sh_offset);
 	    break;
         case SHT_GNU_verneed:
-	    v.verneed = load_data(fd, sh->sh_offset, sh->sh_size);
+	    v.verneed = (ElfW(Verneed) *)(data + sh->sh_offset);
 	    break;
         case SHT_GNU_versym:
             v.nb_versyms = sh->sh_size / sizeof(ElfW(Half));
-	    v.versym = load_data(fd, sh->sh_offset, sh->sh_size);
+	    v.versym = (ElfW(Half) *)(data + sh->sh_offset);
 	    break;
         default:
             break;
@@ -3678,7 +3991,7 @@ ST_FUNC int tcc_load_dll(TCCState *s1, int fd, const char *filename, int level)
         goto ret_success;
 
     if (v.nb_versyms != nb_syms)
-        tcc_free (v.versym), v.versym = NULL;
+        v.versym = NULL;
     else
         store_version(s1, &v, dynstr);
 
@@ -3727,14 +4040,8 @@ ST_FUNC int tcc_load_dll(TCCState *s1, int fd, const char *filename, int level)
  ret_success:
     ret = 0;
  the_end:
-    tcc_free(dynstr);
-    tcc_free(dynsym);
-    tcc_free(dynamic);
-    tcc_free(shdr);
     tcc_free(v.local_ver);
-    tcc_free(v.verdef);
-    tcc_free(v.verneed);
-    tcc_free(v.versym);
+    unmap_data(data, data_size);
     return ret;
 }
 
@@ -37,16 +37,16 @@ ST_DATA Sym *define_stack;
 ST_DATA Sym *global_label_stack;
 ST_DATA Sym *local_label_stack;
 
-static Sym *sym_free_first;
-static void **sym_pools;
-static int nb_sym_pools;
+static ST_TLS Sym *sym_free_first;
+static ST_TLS void **sym_pools;
+static ST_TLS int nb_sym_pools;
 
-static Sym *all_cleanups, *pending_gotos;
-static int local_scope;
+static ST_TLS Sym *all_cleanups, *pending_gotos;
+static ST_TLS int local_scope;
 ST_DATA char debug_modes;
 
 ST_DATA SValue *vtop;
-static SValue _vstack[1 + VSTACK_SIZE];
+static ST_TLS SValue _vstack[1 + VSTACK_SIZE];
 #define vstack (_vstack + 1)
 
 ST_DATA int nocode_wanted; /* no code generation wanted */
@@ -73,8 +73,21 @@ ST_DATA int func_var; /* true if current function is variadic (used by return in
 ST_DATA int func_vc;
 ST_DATA int func_ind;
 ST_DATA const char *funcname;
+#ifdef NB_REGVARS
+#ifndef NB_FREGVARS
+# define NB_FREGVARS 0
+#endif
+ST_DATA int func_regvars;
+static ST_TLS int regvar_tok[NB_REGVARS + NB_FREGVARS]; /* names of register variables */
+static ST_TLS int regvar_ntok;
+/* uses of the identifiers in the function body, hashed by token */
+typedef struct RegvarCnt { int v, cnt; /* -1: address taken or called */ } RegvarCnt;
+static ST_TLS RegvarCnt *regvar_cnt;
+static ST_TLS int regvar_mask, regvar_last; /* tok_ident when scanned */
+static RegvarCnt *regvar_lookup(int v, int add);
+#endif
 ST_DATA CType int_type, func_old_type, char_type, char_pointer_type;
-static CString initstr;
+static ST_TLS CString initstr;
 
 #if PTR_SIZE == 4
 #define VT_SIZE_T (VT_INT | VT_UNSIGNED)
@@ -87,7 +100,7 @@ static CString initstr;
 #define VT_PTRDIFF_T (VT_LONG | VT_LLONG)
 #endif
 
-static struct switch_t {
+static ST_TLS struct switch_t {
     struct case_t {
         int64_t v1, v2;
 	int sym;
@@ -102,14 +115,14 @@ static struct switch_t {
 
 #define MAX_TEMP_LOCAL_VARIABLE_NUMBER 8
 /*list of temporary local variables on the stack in current function. */
-static struct temp_local_variable {
+static ST_TLS struct temp_local_variable {
 	int location; //offset on stack. Svalue.c.i
 	short size;
 	short align;
 } arr_temp_local_vars[MAX_TEMP_LOCAL_VARIABLE_NUMBER];
-static int nb_temp_local_vars;
+static ST_TLS int nb_temp_local_vars;
 
-static struct scope {
+static ST_TLS struct scope {
     struct scope *prev;
     struct { int loc, locorig, num; } vla;
     struct { Sym *s; int n; } cl;
@@ -117,6 +130,15 @@ static struct scope {
     Sym *lstk, *llstk;
 } *cur_scope, *loop_scope, *root_scope;
 
+/* -O1: a call being expanded in place */
+static ST_TLS struct inline_ctx {
+    struct inline_ctx *prev;
+    Sym *sym;
+    struct scope *scope;
+    CType type; /* of the result */
+    int loc, rsym, level;
+} *inl_cur;
+
 typedef struct {
     Section *sec;
     int local_offset;
@@ -129,6 +151,7 @@ static void init_prec(void);
 #endif
 
 static void block(int flags);
+static int inline_call(void);
 #define STMT_EXPR 1
 #define STMT_COMPOUND 2
 
@@ -158,6 +181,13 @@ static int get_temp_local_var(int size,int align);
 static void clear_temp_local_var_list();
 static void cast_error(CType *st, CType *dt);
 static void end_switch(void);
+static void cprop_flush(int c, int size, int kill);
+static void cprop_label(void);
+static void gcall(int nb_args);
+static void gen_opic(int op);
+#ifdef CONFIG_TCC_BCHECK
+static void gbound(void);
+#endif
 
 /* ------------------------------------------------------------------------- */
 /* Automagical code suppression */
@@ -166,6 +196,7 @@ static void end_switch(void);
 ST_FUNC void gsym(int t)
 {
   if (t) {
+    cprop_label();
     gsym_addr(t, ind);
     CODE_ON();
   }
@@ -174,8 +205,13 @@ ST_FUNC void gsym(int t)
 /* Clear 'nocode_wanted' if current pc is a label */
 static int gind()
 {
-  int t = ind;
+  int t;
+  cprop_label();
+  t = ind;
   CODE_ON();
+#ifdef TCC_TARGET_X86_64
+  gen_label();
+#endif
   if (debug_modes)
     tcc_tcov_block_begin(tcc_state);
   return t;
@@ -184,6 +220,7 @@ static int gind()
 /* Set 'nocode_wanted' after unconditional (backwards) jump */
 static void gjmp_addr_acs(int t)
 {
+  cprop_flush(0, 0, 0);
   gjmp_addr(t);
   CODE_OFF();
 }
@@ -191,6 +228,7 @@ static void gjmp_addr_acs(int t)
 /* Set 'nocode_wanted' after unconditional (forwards) jump */
 static int gjmp_acs(int t)
 {
+  cprop_flush(0, 0, 0);
   t = gjmp(t);
   CODE_OFF();
   return t;
@@ -228,6 +266,236 @@ static int btype_size(int bt)
         bt == VT_PTR ? PTR_SIZE : 0;
 }
 
+/* ------------------------------------------------------------------------- */
+#ifdef CONFIG_TCC_BCHECK
+/* -b -O1: byte ranges already checked through local pointer variables
+   whose address is never taken, valid until the next label, call or
+   store to the variable */
+typedef struct BoundChk {
+    int c, lo, hi; /* frame offset of the pointer, checked [lo, hi) */
+} BoundChk;
+
+#define BOUND_CHK_MAX 8
+static ST_TLS BoundChk bound_chks[BOUND_CHK_MAX];
+static ST_TLS int nb_bound_chks, bound_chk_gen;
+/* the last check through such a pointer, until its size is known */
+static ST_TLS struct { int rel, c, off, gen; } bound_chk_last;
+
+/* forget the checks through the variable at [c, c + size), or all
+   if size == 0 */
+static void bound_chk_kill(int c, int size)
+{
+    int i, n;
+    for (i = n = 0; i < nb_bound_chks; i++)
+        if (size && (bound_chks[i].c >= c + size || bound_chks[i].c < c))
+            bound_chks[n++] = bound_chks[i];
+    nb_bound_chks = n;
+    bound_chk_gen++;
+}
+#else
+#define bound_chk_kill(c, size)
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* -O1: scalar locals known to hold a constant.  On x86_64, stores of
+   small integer constants are also delayed until the value is needed
+   in memory, so that stores overwritten before are left out. */
+
+typedef struct CPropVal {
+    SValue sv; /* the constant, with the type of the variable */
+    int c, size; /* frame offset and size of the variable */
+    char pending; /* not yet stored */
+    char safe; /* address never taken: not changed by calls or pointers */
+} CPropVal;
+
+#define CPROP_MAX 16
+static ST_TLS CPropVal cprop_vals[CPROP_MAX];
+static ST_TLS int nb_cprop, cprop_on;
+
+/* store the delayed values of the locals overlapping [c, c + size),
+   or of all if size == 0, or of those not 'safe' if size < 0.  With
+   'kill', forget about their values too. */
+static void cprop_flush(int c, int size, int kill)
+{
+    CPropVal *e;
+    int i, n;
+
+    if (!nb_cprop || nocode_wanted)
+        return;
+    for (i = n = 0; i < nb_cprop; i++) {
+        e = &cprop_vals[i];
+        if (size == 0 || (size < 0 ? !e->safe
+                          : e->c < c + size && c < e->c + e->size)) {
+#ifdef TCC_TARGET_X86_64
+            if (e->pending)
+                gen_store_imm(e->sv.type.t, e->c, e->sv.c.i);
+#endif
+            e->pending = 0;
+            if (kill)
+                continue;
+        }
+        cprop_vals[n++] = *e;
+    }
+    nb_cprop = n;
+}
+
+/* a label: other paths join here */
+static void cprop_label(void)
+{
+    int i, n;
+    bound_chk_kill(0, 0);
+    if (nocode_wanted & ~CODE_OFF_BIT) {
+        /* in sizeof() etc.: keep the stores delayed from outside */
+        for (i = n = 0; i < nb_cprop; i++)
+            if (cprop_vals[i].pending)
+                cprop_vals[n++] = cprop_vals[i];
+        nb_cprop = n;
+        return;
+    }
+    cprop_flush(0, 0, 1); /* no-op if unreachable: they are dead */
+    nb_cprop = 0;
+}
+
+/* 'sv' is used as a value: replace a local by its constant, or store
+   the delayed values that it might read */
+static void cprop_use(SValue *sv)
+{
+    CPropVal *e;
+    int r = sv->r, align;
+
+    if (!nb_cprop)
+        return;
+    if ((r & VT_VALMASK) == VT_CMP || (r & VT_VALMASK) == VT_JMP
+        || (r & VT_VALMASK) == VT_JMPI) {
+        cprop_flush(0, 0, 0); /* before it generates a label */
+    } else if ((r & (VT_VALMASK | VT_LVAL)) == (VT_LOCAL | VT_LVAL)) {
+        for (e = cprop_vals; r == (VT_LOCAL | VT_LVAL) && e < cprop_vals + nb_cprop; e++)
+            if (e->c == sv->c.i
+                && !(sv->type.t & (VT_VOLATILE | VT_BITFIELD))
+                && ((e->sv.type.t ^ sv->type.t) & (VT_BTYPE | VT_UNSIGNED)) == 0) {
+                sv->r = e->sv.r | VT_NONCONST;
+                sv->r2 = VT_CONST;
+                sv->c = e->sv.c;
+                sv->sym = e->sv.sym;
+                return;
+            }
+        cprop_flush(sv->c.i, type_size(&sv->type, &align), 0);
+    } else if ((r & VT_LVAL) && (r & VT_VALMASK) != VT_CONST) {
+        cprop_flush(0, -1, 0); /* through a pointer */
+    }
+}
+
+/* return true if 'sv' is a scalar local whose address is never taken */
+static int cprop_safe(SValue *sv)
+{
+#ifdef NB_REGVARS
+    Sym *s = sv->sym;
+    RegvarCnt *e;
+    return regvar_cnt && !inl_cur && s && s->r == (VT_LOCAL | VT_LVAL)
+        && s->c == sv->c.i && s->v >= TOK_UIDENT && s->v < regvar_last
+        && (!(e = regvar_lookup(s->v, 0)) || e->cnt >= 0)
+        && !(s->type.t & (VT_ARRAY | VT_VLA | VT_BITFIELD))
+        && (s->type.t & VT_BTYPE) == (sv->type.t & VT_BTYPE);
+#else
+    return 0;
+#endif
+}
+
+/* vstore() of vtop to vtop[-1]: track the value of the local, or
+   return true if the store was delayed */
+static int cprop_store(void)
+{
+    SValue *d = vtop - 1;
+    CPropVal *e;
+    int c, size, align, bt;
+
+    if (!cprop_on || nocode_wanted)
+        return 0;
+    cprop_use(vtop);
+    if ((d->r & VT_VALMASK) == VT_CONST)
+        return 0; /* a global */
+    if ((d->r & (VT_VALMASK | VT_LVAL)) != (VT_LOCAL | VT_LVAL)) {
+        cprop_flush(0, -1, 1); /* might be any variable not 'safe' */
+        return 0;
+    }
+    c = d->c.i;
+    size = type_size(&d->type, &align);
+    /* a delayed store of the same size to here is dead */
+    for (e = cprop_vals; e < cprop_vals + nb_cprop; e++)
+        if (e->c == c && e->size == size)
+            e->pending = 0;
+    cprop_flush(c, size, 1);
+
+    bt = d->type.t & VT_BTYPE;
+    if (d->r != (VT_LOCAL | VT_LVAL)
+        || (vtop->r & (VT_VALMASK | VT_LVAL)) != VT_CONST
+        || (d->type.t & (VT_VOLATILE | VT_BITFIELD))
+        || bt == VT_STRUCT || bt == VT_LDOUBLE || bt == VT_VOID
+        || bt == VT_FUNC || bt == VT_QLONG || bt == VT_QFLOAT)
+        return 0;
+    if (vtop->r & VT_SYM) {
+        /* only addresses of symbols, as is */
+        if (bt != VT_PTR || ((vtop->type.t & VT_BTYPE) != VT_PTR
+                             && (vtop->type.t & VT_BTYPE) != VT_FUNC))
+            return 0;
+    } else {
+        gen_cast(&d->type); /* fold */
+        if ((vtop->r & (VT_VALMASK | VT_LVAL | VT_SYM)) != VT_CONST)
+            return 0;
+    }
+    if (nb_cprop == CPROP_MAX) {
+        cprop_flush(cprop_vals[0].c, cprop_vals[0].size, 1);
+    }
+    e = &cprop_vals[nb_cprop++];
+    e->sv = *vtop;
+    e->sv.type = d->type;
+    e->c = c;
+    e->size = size;
+    e->safe = cprop_safe(d);
+    e->pending = 0;
+#ifdef TCC_TARGET_X86_64
+    if (!(vtop->r & VT_SYM) && bt != VT_FLOAT && bt != VT_DOUBLE
+        && (size < 8 || vtop->c.i == (int)vtop->c.i)) {
+        e->pending = 1;
+        vswap();
+        vtop--; /* the value is the result */
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+/* a call: pointers passed might be used */
+static void gcall(int nb_args)
+{
+    cprop_flush(0, -1, 0);
+    gfunc_call(nb_args);
+    cprop_flush(0, -1, 1);
+    bound_chk_kill(0, 0); /* might have freed memory */
+}
+
+/* forget the values, as the function returns */
+static void cprop_drop(void)
+{
+    nb_cprop = 0;
+    bound_chk_kill(0, 0);
+}
+
+/* forget the -O1 state of the function, also when it was left by an
+   error: the stores still pending belong to its frame */
+static void func_opt_reset(void)
+{
+    nb_cprop = cprop_on = 0;
+#ifdef CONFIG_TCC_BCHECK
+    nb_bound_chks = 0;
+#endif
+#ifdef NB_REGVARS
+    func_regvars = regvar_ntok = 0;
+    tcc_free(regvar_cnt);
+    regvar_cnt = NULL;
+#endif
+}
+
 /* returns function return register from type */
 static int R_RET(int t)
 {
@@ -377,6 +645,10 @@ ST_FUNC void tccgen_init(TCCState *s1)
 #ifdef precedence_parser
     init_prec();
 #endif
+#ifdef TCC_TARGET_X86_64
+    gen_peep_reset();
+#endif
+    func_opt_reset();
     cstr_new(&initstr);
 }
 
@@ -384,11 +656,12 @@ ST_FUNC int tccgen_compile(TCCState *s1)
 {
     funcname = "";
     func_ind = -1;
+    inl_cur = NULL;
     anon_sym = SYM_FIRST_ANOM;
     nocode_wanted = DATA_ONLY_WANTED; /* no code outside of functions */
-    debug_modes = (s1->do_debug ? 1 : 0) | s1->test_coverage << 1;
+    debug_modes = (s1->do_debug ? 1 : 0) | (s1->test_coverage ? 2 : 0);
 
-    tcc_debug_start(s1);
+    PROF_CALL(s1, TP_DEBUG, tcc_debug_start(s1));
     tcc_tcov_start (s1);
 #ifdef TCC_TARGET_ARM
     arm_init(s1);
@@ -402,7 +675,7 @@ ST_FUNC int tccgen_compile(TCCState *s1)
     gen_inline_functions(s1);
     check_vstack();
     /* end of translation unit info */
-    tcc_debug_end(s1);
+    PROF_CALL(s1, TP_DEBUG, tcc_debug_end(s1));
     tcc_tcov_end(s1);
     return 0;
 }
@@ -426,6 +699,7 @@ ST_FUNC void tccgen_finish(TCCState *s1)
     all_cleanups = NULL;
     pending_gotos = NULL;
     nb_temp_local_vars = 0;
+    func_opt_reset();
     global_label_stack = NULL;
     local_label_stack = NULL;
     cur_text_section = NULL;
@@ -1049,6 +1323,7 @@ static int gvtst(int inv, int t)
     int op, x, u;
 
     gvtst_set(inv, t);
+    cprop_flush(0, 0, 0);
     t = vtop->jtrue, u = vtop->jfalse;
     if (inv)
         x = u, u = t, t = x;
@@ -1542,21 +1817,78 @@ ST_FUNC void gaddrof(void)
     vtop->r &= ~VT_LVAL;
     /* tricky: if saved lvalue, then we can go back to lvalue */
     if ((vtop->r & VT_VALMASK) == VT_LLOCAL)
-        vtop->r = (vtop->r & ~VT_VALMASK) | VT_LOCAL | VT_LVAL;
+        vtop->r = (vtop->r & ~(VT_VALMASK | VT_MUSTBOUND)) | VT_LOCAL | VT_LVAL;
 }
 
 #ifdef CONFIG_TCC_BCHECK
+/* return true if the 'size' bytes at address 'sv' + 'off' are within
+   a local or global object of known size */
+static int bound_known(SValue *sv, int64_t off, int size)
+{
+    Sym *s = sv->sym;
+    int n, align;
+
+    if (!s || (sv->r & VT_LVAL))
+        return 0;
+    if ((sv->r & (VT_VALMASK | VT_SYM)) == VT_LOCAL) {
+        if ((s->r & ~VT_LVAL) != VT_LOCAL)
+            return 0;
+        off += (int64_t)sv->c.i - s->c;
+    } else if ((sv->r & (VT_VALMASK | VT_SYM)) == (VT_CONST | VT_SYM))
+        off += (int64_t)sv->c.i;
+    else
+        return 0;
+    if ((s->type.t & VT_VLA) || (s->type.t & VT_BTYPE) == VT_FUNC)
+        return 0;
+    n = type_size(&s->type, &align);
+    return n >= 0 && off >= 0 && off + size <= n;
+}
+
+/* return true if 'vtop[-1] op vtop' is a constant offset within a
+   known object, which needs no check */
+static int bound_known_add(int op)
+{
+    int64_t off = vtop->c.i;
+    if ((vtop->r & (VT_VALMASK | VT_LVAL | VT_SYM)) != VT_CONST)
+        return 0;
+    return bound_known(vtop - 1, op == '-' ? -off : off, 0);
+}
+
 /* generate a bounded pointer addition */
 static void gen_bounded_ptr_add(void)
 {
-    int save = (vtop[-1].r & VT_VALMASK) == VT_LOCAL;
+    int save, key = 0, c = 0, i;
+    int64_t off = vtop->c.i;
+    BoundChk *b;
+
+    /* a constant offset from a pointer variable */
+    if ((vtop->r & (VT_VALMASK | VT_LVAL | VT_SYM)) == VT_CONST
+        && !nocode_wanted && off == (int)off
+        && vtop[-1].r == (VT_LOCAL | VT_LVAL) && cprop_safe(vtop - 1)) {
+        key = 1, c = vtop[-1].c.i;
+        for (b = bound_chks; b < bound_chks + nb_bound_chks; b++)
+            if (b->c == c && b->lo <= off && off < b->hi) {
+                /* within a range checked before: no call, tell
+                   gen_bounded_ptr_deref() how much is left */
+                i = b->hi - off;
+                gen_opic('+');
+                gv(RC_INT);
+                vtop->r |= VT_BOUNDED;
+                vtop->c.i = -1 - i;
+                return;
+            }
+    }
+
+    save = (vtop[-1].r & VT_VALMASK) == VT_LOCAL;
     if (save) {
       vpushv(&vtop[-1]);
       vrott(3);
     }
     vpush_helper_func(TOK___bound_ptr_add);
     vrott(3);
-    gfunc_call(2);
+    i = nb_bound_chks;
+    gcall(2);
+    nb_bound_chks = i; /* frees nothing */
     vtop -= save;
     vpushi(0);
     /* returned pointer is in REG_IRET */
@@ -1565,6 +1897,12 @@ static void gen_bounded_ptr_add(void)
         return;
     /* relocation offset of the bounding function call point */
     vtop->c.i = (cur_text_section->reloc->data_offset - sizeof(ElfW_Rel));
+    if (key) {
+        bound_chk_last.rel = vtop->c.i;
+        bound_chk_last.c = c;
+        bound_chk_last.off = off;
+        bound_chk_last.gen = bound_chk_gen;
+    }
 }
 
 /* patch pointer addition in vtop so that pointer dereferencing is
@@ -1580,6 +1918,14 @@ static void gen_bounded_ptr_deref(void)
         return;
 
     size = type_size(&vtop->type, &align);
+    if ((int64_t)vtop->c.i < 0) {
+        /* from a checked range */
+        if (size >= 0 && size <= -1 - (int64_t)vtop->c.i)
+            return;
+        vtop->r &= ~VT_BOUNDED;
+        gbound();
+        return;
+    }
     switch(size) {
     case  1: func = TOK___bound_ptr_indir1; break;
     case  2: func = TOK___bound_ptr_indir2; break;
@@ -1598,6 +1944,29 @@ static void gen_bounded_ptr_deref(void)
     /* XXX: find a better solution ? */
     rel = (ElfW_Rel *)(cur_text_section->reloc->data + vtop->c.i);
     rel->r_info = ELFW(R_INFO)(sym->c, ELFW(R_TYPE)(rel->r_info));
+    /* remember the range checked through a pointer variable */
+    if (vtop->c.i == bound_chk_last.rel
+        && bound_chk_last.gen == bound_chk_gen) {
+        int lo = bound_chk_last.off, hi = lo + size;
+        BoundChk *b;
+        bound_chk_last.gen--;
+        /* within the same object as an adjacent range */
+        for (b = bound_chks; b < bound_chks + nb_bound_chks; b++)
+            if (b->c == bound_chk_last.c && lo <= b->hi && hi >= b->lo) {
+                if (lo < b->lo)
+                    b->lo = lo;
+                if (hi > b->hi)
+                    b->hi = hi;
+                return;
+            }
+        if (nb_bound_chks == BOUND_CHK_MAX)
+            memmove(bound_chks, bound_chks + 1,
+                    --nb_bound_chks * sizeof *bound_chks);
+        b = &bound_chks[nb_bound_chks++];
+        b->c = bound_chk_last.c;
+        b->lo = lo;
+        b->hi = hi;
+    }
 }
 
 /* generate lvalue bound code */
@@ -1610,6 +1979,11 @@ static void gbound(void)
     if (vtop->r & VT_LVAL) {
         /* if not VT_BOUNDED value, then make one */
         if (!(vtop->r & VT_BOUNDED)) {
+            int align, size = type_size(&vtop->type, &align);
+            SValue sv = *vtop;
+            sv.r &= ~VT_LVAL;
+            if (size > 0 && bound_known(&sv, 0, size))
+                return;
             /* must save type because we must set it to int to get pointer */
             type1 = vtop->type;
             vtop->type.t = VT_PTR;
@@ -1650,7 +2024,7 @@ ST_FUNC void gbound_args(int nb_args)
           ) {
             vpush_helper_func(TOK___bound_setjmp);
             vpushv(sv + 1);
-            gfunc_call(1);
+            gcall(1);
             func_bound_add_epilog = 1;
         }
 #if defined TCC_TARGET_I386 || defined TCC_TARGET_X86_64
@@ -1804,6 +2178,7 @@ ST_FUNC int gv(int rc)
     int r, r2, r_ok, r2_ok, rc2, bt;
     int bit_pos, bit_size, size, align;
 
+    cprop_use(vtop);
     /* NOTE: get_reg can modify vstack[] */
     if (vtop->type.t & VT_BITFIELD) {
         CType type;
@@ -2083,7 +2458,7 @@ static void gen_opl(int op)
         /* call generic long long function */
         vpush_helper_func(func);
         vrott(3);
-        gfunc_call(2);
+        gcall(2);
         vpushi(0);
         vtop->r = reg_iret;
         vtop->r2 = reg_lret;
@@ -2976,6 +3351,8 @@ ST_FUNC void gen_op(int op)
     CType type1, combtype;
     int op_class = op;
 
+    cprop_use(vtop - 1);
+    cprop_use(vtop);
     if (op == TOK_SHR || op == TOK_SAR || op == TOK_SHL)
         op_class = SHIFT_OP;
     else if (TOK_ISCOND(op)) /* == != > ... */
@@ -3038,7 +3415,8 @@ op_err:
             vpush_type_size(pointed_type(&vtop[-1].type), &align);
             gen_op('*');
 #ifdef CONFIG_TCC_BCHECK
-            if (tcc_state->do_bounds_check && !CONST_WANTED) {
+            if (tcc_state->do_bounds_check && !CONST_WANTED
+                && !bound_known_add(op)) {
                 /* if bounded pointers, we generate a special code to
                    test bounds */
                 if (op == '-') {
@@ -3125,7 +3503,7 @@ static void gen_cvt_itof1(int t)
         else
             vpush_helper_func(TOK___floatundidf);
         vrott(2);
-        gfunc_call(1);
+        gcall(1);
         vpushi(0);
         PUT_R_RET(vtop, t);
     } else {
@@ -3153,7 +3531,7 @@ static void gen_cvt_ftoi1(int t)
         else
             vpush_helper_func(TOK___fixunsdfdi);
         vrott(2);
-        gfunc_call(1);
+        gcall(1);
         vpushi(0);
         PUT_R_RET(vtop, t);
     } else {
@@ -3187,6 +3565,7 @@ static void gen_cast(CType *type)
     int sbt, dbt, sf, df, c;
     int dbt_bt, sbt_bt, ds, ss, bits, trunc;
 
+    cprop_use(vtop);
     /* special delayed cast for char/short */
     if (vtop->r & VT_MUSTCAST)
         force_charshort_cast();
@@ -3251,8 +3630,10 @@ error:
                 if(sf)
                     /* the range of [int64_t] is enough to hold the integer part of any float value.
                        Meanwhile, converting negative double to unsigned integer is UB.
-                       So first convert to [int64_t] here. */
-                    vtop->c.i = (int64_t)vtop->c.ld;
+                       So first convert to [int64_t] here, unless too big. */
+                    vtop->c.i = dbt == (VT_LLONG | VT_UNSIGNED)
+                        && vtop->c.ld >= 9223372036854775808.0
+                        ? (uint64_t)vtop->c.ld : (int64_t)vtop->c.ld;
                 else if (sbt_bt == VT_LLONG || (PTR_SIZE == 8 && sbt == VT_PTR))
                     ;
                 else if (sbt & VT_UNSIGNED)
@@ -3624,6 +4005,13 @@ ST_FUNC void vstore(void)
     sbt = vtop->type.t & VT_BTYPE;
     dbt = ft & VT_BTYPE;
     verify_assign_cast(&vtop[-1].type);
+#ifdef CONFIG_TCC_BCHECK
+    if (tcc_state->do_bounds_check
+        && (vtop[-1].r & (VT_VALMASK | VT_LVAL)) == (VT_LOCAL | VT_LVAL))
+        bound_chk_kill(vtop[-1].c.i, type_size(&vtop[-1].type, &align));
+#endif
+    if (cprop_store())
+        return;
 
     if (sbt == VT_STRUCT) {
         /* if structure, only generate pointer */
@@ -3651,8 +4039,8 @@ ST_FUNC void vstore(void)
 #ifdef CONFIG_TCC_BCHECK
             && !tcc_state->do_bounds_check
 #endif
-            ) {
-            gen_struct_copy(size);
+            && gen_struct_copy(size, align)) {
+            /* done inline */
         } else
 #endif
         {
@@ -3668,7 +4056,7 @@ ST_FUNC void vstore(void)
 #endif
             vpush_helper_func(TOK_memmove);
             vrott(4);
-            gfunc_call(3);
+            gcall(3);
         }
 
     } else if (ft & VT_BITFIELD) {
@@ -5188,6 +5576,15 @@ ST_FUNC void indir(void)
             return;
         expect("pointer");
     }
+#ifdef CONFIG_TCC_BCHECK
+    /* keep the pointer variable known for gen_bounded_ptr_add() */
+    if (tcc_state->do_bounds_check && vtop->r == (VT_LOCAL | VT_LVAL)
+        && cprop_safe(vtop)
+        && !(pointed_type(&vtop->type)->t & (VT_ARRAY | VT_VLA))
+        && (pointed_type(&vtop->type)->t & VT_BTYPE) != VT_FUNC)
+        vtop->r = VT_LLOCAL;
+    else
+#endif
     if (vtop->r & VT_LVAL)
         gv(RC_INT);
     vtop->type = *pointed_type(&vtop->type);
@@ -5432,7 +5829,7 @@ static void parse_atomic(int atok)
     sprintf(buf, "%s_%d", get_tok_str(atok, 0), size);
     vpush_helper_func(tok_alloc_const(buf));
     vrott(arg - save + 1);
-    gfunc_call(arg - save);
+    gcall(arg - save);
 
     vpush(&ct);
     PUT_R_RET(vtop, ct.t);
@@ -5461,8 +5858,10 @@ ST_FUNC void unary(void)
     AttributeDef ad;
 
     /* generate line number info */
-    if (debug_modes)
-        tcc_debug_line(tcc_state), tcc_tcov_check_line (tcc_state, 1);
+    if (debug_modes) {
+        PROF_CALL(tcc_state, TP_DEBUG, tcc_debug_line(tcc_state));
+        tcc_tcov_check_line (tcc_state, 1);
+    }
 
     type.ref = NULL;
     /* XXX: GCC 2.95.3 does not generate a table although it should be
@@ -6067,6 +6466,8 @@ special_math_val:
             /* get return type */
             s = vtop->type.ref;
             next();
+            if (s->f.func_inl && inline_call())
+                continue;
             sa = s->next; /* first parameter */
             nb_args = regsize = 0;
             ret.r2 = VT_CONST;
@@ -6128,7 +6529,7 @@ special_math_val:
             if (sa)
                 tcc_error("too few arguments to function");
             skip(')');
-            gfunc_call(nb_args);
+            gcall(nb_args);
 
             if (ret_nregs < 0) {
                 vsetc(&ret.type, ret.r, &ret.c);
@@ -6335,7 +6736,7 @@ static int precedence(int tok)
 	    return 0;
     }
 }
-static unsigned char prec[256];
+static ST_TLS unsigned char prec[256];
 static void init_prec(void)
 {
     int i;
@@ -6388,7 +6789,8 @@ static void expr_landor(int op)
         if (c < 0)
             save_regs(1), cc = 0;
         else if (c != i)
-            nocode_wanted++, f = 1;
+            /* the jumps in 't' still join below */
+            cprop_flush(0, 0, 0), nocode_wanted++, f = 1;
         if (tok != op)
             break;
         if (c < 0)
@@ -6719,12 +7121,94 @@ static void gtst_addr(int t, int a)
     gsym_addr(gvtst(0, t), a);
 }
 
+/* dense cases: jump through a table in rodata */
+static void gcase_table(struct case_t **base, int len, int *bsym)
+{
+    struct case_t *p;
+    uint64_t min, i, n, nv;
+    int ll, hole, a, j;
+    CType type;
+    Sym *sym;
+    Section *sec = rodata_section;
+    unsigned long c;
+#ifdef CONFIG_TCC_BCHECK
+    int bc_save;
+#endif
+
+    ll = (vtop->type.t & VT_BTYPE) == VT_LLONG;
+    min = base[0]->v1;
+    n = base[len - 1]->v2 - min + 1;
+    for (nv = j = 0; j < len; j++)
+        nv += base[j]->v2 - base[j]->v1 + 1;
+    /* index = x - min, default if above n - 1 */
+    gv_dup();
+    if (ll)
+        vpushll(min);
+    else
+        vpushi(min);
+    gen_op('-');
+    vdup();
+    if (ll)
+        vpushll(n - 1);
+    else
+        vpushi(n - 1);
+    gen_op(TOK_UGT);
+    *bsym = gvtst(0, *bsym);
+#if PTR_SIZE == 4
+    if (ll)
+        gen_cast_s(VT_INT);
+#endif
+    /* the entries are relative to the first case label */
+    type.t = VT_VOID;
+    type.ref = NULL;
+    sym = get_sym_ref(&type, cur_text_section, base[0]->sym, 0);
+    c = section_add(sec, n * PTR_SIZE, PTR_SIZE);
+    mk_pointer(&type);
+    mk_pointer(&type);
+    vpush_ref(&type, sec, c, n * PTR_SIZE);
+    vswap();
+#ifdef CONFIG_TCC_BCHECK
+    /* no calls here: 'x' must stay in its register */
+    bc_save = tcc_state->do_bounds_check;
+    tcc_state->do_bounds_check = 0;
+#endif
+    gen_op('+');
+    indir();
+    cprop_flush(0, 0, 0);
+    ggoto();
+#ifdef CONFIG_TCC_BCHECK
+    tcc_state->do_bounds_check = bc_save;
+#endif
+    CODE_OFF();
+    hole = 0;
+    if (nv < n) {
+        hole = gind();
+        *bsym = gjmp(*bsym);
+    }
+    for (i = j = 0; i < n; i++) {
+        p = base[j];
+        if (i > (uint64_t)p->v2 - min)
+            p = base[++j];
+        a = i >= (uint64_t)p->v1 - min ? p->sym : hole;
+#if PTR_SIZE == 8
+        greloca(sec, sym, c + i * PTR_SIZE, R_DATA_PTR, a - base[0]->sym);
+#else
+        greloc(sec, sym, c + i * PTR_SIZE, R_DATA_PTR);
+        write32le(sec->data + c + i * PTR_SIZE, a - base[0]->sym);
+#endif
+    }
+}
+
 static void gcase(struct case_t **base, int len, int *bsym)
 {
     struct case_t *p;
     int e;
     int ll = (vtop->type.t & VT_BTYPE) == VT_LLONG;
     while (len > 8) {
+        if ((uint64_t)base[len - 1]->v2 - base[0]->v1 < 3 * len) {
+            gcase_table(base, len, bsym);
+            return;
+        }
         /* binary search */
         p = base[len/2];
         vdup();
@@ -6799,7 +7283,7 @@ static void try_call_scope_cleanup(Sym *stop)
 	vtop->sym = vs;
         mk_pointer(&vtop->type);
 	gaddrof();
-	gfunc_call(1);
+	gcall(1);
     }
 }
 
@@ -6953,6 +7437,190 @@ static void lblock(int *bsym, int *csym)
     }
 }
 
+/* ------------------------------------------------------------------------- */
+/* -O1: expand calls of small static functions in place */
+
+#define INLINE_MAX_TOKS 64  /* of the body */
+#define INLINE_MAX_ARGS 8
+#define INLINE_MAX_DEPTH 3
+
+/* keep the tokens of function 'sym' if it can be expanded */
+static void inline_record(Sym *sym, TokenString *str, InlineFunc *fn)
+{
+    Sym *s = sym->type.ref, *sa;
+    const int *p = str->str;
+    int t, prev = 0, prev2 = 0, n = 0, ta;
+
+    if (tcc_state->optimize < 1 || debug_modes
+        || !(sym->type.t & VT_STATIC) || s->f.func_type != FUNC_NEW
+        || s->f.func_noreturn)
+        return;
+    for (sa = s->next; sa; sa = sa->next)
+        if (++n > INLINE_MAX_ARGS || !(sa->v & ~SYM_FIELD)
+            || ((sa->type.t & VT_BTYPE) == VT_PTR
+                && (sa->type.ref->type.t & VT_VLA)))
+            return;
+    ta = tok_alloc_const("alloca");
+    for (n = 0; (t = tok_str_next(&p)) != TOK_EOF; prev2 = prev, prev = t) {
+        if (t == TOK_LINENUM || t == TOK_PPPACK)
+            continue;
+        if (++n > INLINE_MAX_TOKS || t == sym->v
+            || t == TOK_STATIC || t == TOK_GOTO || t == TOK_LABEL
+            || t == TOK_ASM1 || t == TOK_ASM2 || t == TOK_ASM3
+            || t == TOK___FUNCTION__ || t == TOK___FUNC__ || t == ta
+            || t == TOK_builtin_frame_address
+            || t == TOK_builtin_return_address)
+            return;
+        /* no labels ('ident:' after the end of a statement) */
+        if (t == ':' && prev >= TOK_UIDENT
+            && (prev2 == ';' || prev2 == '{' || prev2 == '}' || prev2 == ')'
+                || prev2 == ':' || prev2 == TOK_ELSE || prev2 == TOK_DO))
+            return;
+    }
+    if (!fn) {
+        fn = tcc_mallocz(sizeof *fn);
+        dynarray_add(&tcc_state->inline_fns, &tcc_state->nb_inline_fns, fn);
+    }
+    fn->isym = sym;
+    fn->itok = tcc_malloc(str->len * sizeof (int));
+    memcpy(fn->itok, str->str, str->len * sizeof (int));
+    s->f.func_inl = 1;
+}
+
+/* 'return' in an expanded body: store the value and jump to the end */
+static void inline_return(int b)
+{
+    struct inline_ctx *c = inl_cur;
+    if (b) {
+        vset(&c->type, VT_LOCAL | VT_LVAL, c->loc);
+        vswap();
+        vstore();
+        vpop();
+    }
+    leave_scope(c->scope);
+    skip(';');
+    if (tok != '}' || local_scope != c->level + 1)
+        c->rsym = gjmp(c->rsym);
+    else
+        cprop_flush(0, 0, 0); /* falls through to the end */
+}
+
+/* vtop is the function and '(' was parsed: expand the call in place
+   if possible, with the arguments in new locals */
+static int inline_call(void)
+{
+    struct inline_ctx ctx, *c;
+    struct InlineFunc *fn;
+    struct scope o, *lo;
+    struct switch_t *sw;
+    Sym *s, *sa, *sym;
+    TokenSym *ts;
+    TokenString *str;
+    CType func_vt1;
+    const int *p;
+    int i, t, prev, size, align, pack, func_var1, args[INLINE_MAX_ARGS];
+
+    if ((vtop->r & (VT_VALMASK | VT_LVAL | VT_SYM)) != (VT_CONST | VT_SYM)
+        || vtop->c.i || !cprop_on || nocode_wanted)
+        return 0;
+    sym = vtop->sym;
+    for (i = tcc_state->nb_inline_fns; --i >= 0; )
+        if (tcc_state->inline_fns[i]->isym == sym)
+            break;
+    if (i < 0)
+        return 0;
+    fn = tcc_state->inline_fns[i];
+    for (c = inl_cur, i = 0; c; c = c->prev, i++)
+        if (c->sym == sym || i >= INLINE_MAX_DEPTH - 1)
+            return 0;
+    s = sym->type.ref;
+    /* the names in the body must not see the locals of the caller */
+    for (p = fn->itok, prev = 0; (t = tok_str_next(&p)) != TOK_EOF; prev = t) {
+        if (t < TOK_UIDENT || prev == '.' || prev == TOK_ARROW)
+            continue;
+        ts = table_ident[t - TOK_IDENT];
+        if (ts->sym_struct && sym_scope(ts->sym_struct))
+            return 0;
+        if (ts->sym_identifier && sym_scope(ts->sym_identifier)) {
+            for (sa = s->next; sa && (sa->v & ~SYM_FIELD) != t; sa = sa->next)
+                ;
+            if (!sa)
+                return 0;
+        }
+    }
+
+    vpop();
+    for (sa = s->next, i = 0; sa; sa = sa->next, i++) {
+        if (tok == ')')
+            tcc_error("too few arguments to function");
+        if (i)
+            skip(',');
+        expr_eq();
+        gfunc_param_typed(s, sa);
+        size = type_size(&sa->type, &align);
+        loc = (loc - size) & -align;
+        args[i] = loc;
+        ctx.type = sa->type;
+        ctx.type.t &= ~VT_CONSTANT;
+        vset(&ctx.type, VT_LOCAL | VT_LVAL, loc);
+        vswap();
+        vstore();
+        vpop();
+    }
+    if (tok != ')')
+        tcc_error("too many arguments to function");
+    ctx.type = s->type;
+    ctx.type.t &= ~(VT_CONSTANT | VT_VOLATILE);
+    ctx.loc = 0;
+    if ((ctx.type.t & VT_BTYPE) != VT_VOID) {
+        size = type_size(&ctx.type, &align);
+        loc = (loc - size) & -align;
+        ctx.loc = loc;
+    }
+    save_regs(0);
+
+    new_scope(&o);
+    o.bsym = o.csym = NULL;
+    lo = loop_scope, loop_scope = NULL;
+    sw = cur_switch, cur_switch = NULL;
+    for (sa = s->next, i = 0; sa; sa = sa->next, i++)
+        sym_push(sa->v & ~SYM_FIELD, &sa->type, VT_LOCAL | VT_LVAL, args[i]);
+    func_vt1 = func_vt, func_vt = s->type;
+    func_var1 = func_var, func_var = 0;
+    ctx.prev = inl_cur, ctx.sym = sym, ctx.scope = &o;
+    ctx.rsym = 0, ctx.level = local_scope;
+    inl_cur = &ctx;
+    pack = *tcc_state->pack_stack_ptr;
+
+    str = tok_str_alloc();
+    str->str = fn->itok;
+    begin_macro(str, 2);
+    next();
+    block(0);
+    end_macro();
+
+    *tcc_state->pack_stack_ptr = pack;
+    inl_cur = ctx.prev;
+    func_vt = func_vt1, func_var = func_var1;
+    cur_switch = sw, loop_scope = lo;
+    gsym(ctx.rsym);
+    prev_scope(&o, 0);
+    nocode_wanted = 0;
+    next();
+
+    if (ctx.loc) {
+        vset(&ctx.type, VT_LOCAL | VT_LVAL, ctx.loc);
+        if ((ctx.type.t & VT_BTYPE) != VT_STRUCT) {
+            cprop_use(vtop);
+            if (vtop->r & VT_LVAL)
+                gv(RC_TYPE(ctx.type.t));
+        }
+    } else {
+        vset(&ctx.type, VT_CONST | VT_NONCONST, 0);
+    }
+    return 1;
+}
+
 static void block(int flags)
 {
     int a, b, c, d, e, t;
@@ -7057,13 +7725,18 @@ again:
             tcc_warning("'return' with no value");
             b = 0;
         }
-        leave_scope(root_scope);
-        if (b)
-            gfunc_return(&func_vt);
-        skip(';');
-        /* jump unless last stmt in top-level block */
-        if (tok != '}' || local_scope != 1)
-            rsym = gjmp(rsym);
+        if (inl_cur) {
+            inline_return(b);
+        } else {
+            leave_scope(root_scope);
+            if (b)
+                gfunc_return(&func_vt);
+            skip(';');
+            cprop_drop(); /* locals are dead now */
+            /* jump unless last stmt in top-level block */
+            if (tok != '}' || local_scope != 1)
+                rsym = gjmp(rsym);
+        }
         if (debug_modes)
 	    tcc_tcov_block_end (tcc_state, -1);
         CODE_OFF();
@@ -7222,6 +7895,7 @@ again:
             gexpr();
             if ((vtop->type.t & VT_BTYPE) != VT_PTR)
                 expect("pointer");
+            cprop_flush(0, 0, 0);
             ggoto();
 
         } else if (tok >= TOK_UIDENT) {
@@ -7253,7 +7927,12 @@ again:
         skip(';');
 
     } else if (t == TOK_ASM1 || t == TOK_ASM2 || t == TOK_ASM3) {
+        cprop_flush(0, 0, 0);
         asm_instr();
+        cprop_drop();
+#ifdef TCC_TARGET_X86_64
+        gen_label(); /* the asm might define one */
+#endif
 
     } else {
         if (tok == ':' && t >= TOK_UIDENT) {
@@ -7325,11 +8004,18 @@ static void skip_or_save_block(TokenString **str)
 {
     int braces = tok == '{';
     int level = 0;
+    int pack = -1;
     if (str)
       *str = tok_str_alloc();
 
     while (1) {
 	int t = tok;
+        if (str && pack != *tcc_state->pack_stack_ptr) {
+            /* record #pragma pack() state for the replay */
+            pack = *tcc_state->pack_stack_ptr;
+            tok_str_add(*str, TOK_PPPACK);
+            tok_str_add(*str, pack);
+        }
         if (level == 0
             && (t == ','
              || t == ';'
@@ -7406,6 +8092,17 @@ static void init_putz(init_params *p, unsigned long c, int size)
     if (p->sec) {
         /* nothing to do because globals are already set to zero */
     } else {
+#ifdef TCC_TARGET_NATIVE_STRUCT_COPY
+        cprop_flush(c, size, 1);
+        vseti(VT_LOCAL, c);
+        if (1
+#ifdef CONFIG_TCC_BCHECK
+            && !tcc_state->do_bounds_check
+#endif
+            && gen_struct_clear(size, (c | MAX_ALIGN) & -(c | MAX_ALIGN)))
+            return;
+        vpop();
+#endif
         vpush_helper_func(TOK_memset);
         vseti(VT_LOCAL, c);
         vpushi(0);
@@ -7413,7 +8110,7 @@ static void init_putz(init_params *p, unsigned long c, int size)
 #if defined TCC_TARGET_ARM && defined TCC_ARM_EABI
         vswap();  /* using __aeabi_memset(void*, size_t, int) */
 #endif
-        gfunc_call(3);
+        gcall(3);
     }
 }
 
@@ -7786,8 +8483,10 @@ static void decl_initializer(init_params *p, CType *type, unsigned long c, int f
     CType *t1;
 
     /* generate line number info */
-    if (debug_modes && !(flags & DIF_SIZE_ONLY) && !p->sec)
-        tcc_debug_line(tcc_state), tcc_tcov_check_line (tcc_state, 1);
+    if (debug_modes && !(flags & DIF_SIZE_ONLY) && !p->sec) {
+        PROF_CALL(tcc_state, TP_DEBUG, tcc_debug_line(tcc_state));
+        tcc_tcov_check_line (tcc_state, 1);
+    }
 
     if (!(flags & DIF_HAVE_ELEM) && tok != '{' &&
 	/* In case of strings we have special handling for arrays, so
@@ -7994,6 +8693,148 @@ static void decl_initializer(init_params *p, CType *type, unsigned long c, int f
     }
 }
 
+#ifdef NB_REGVARS
+/* -O2: uses inside loops count more.  Returns the nesting of loops
+   at token 't', following the loop headers and bodies in 'lp' */
+static int regvar_loops(int t, int *lp, int *nl, int *depth)
+{
+    enum { HEAD, BODY, BRACED, STMT };
+    int *e = &lp[*nl ? 2 * *nl - 2 : 0]; /* depth at start, state */
+
+    if (*nl && e[1] == BODY)
+        e[1] = t == '{' ? BRACED : STMT;
+    if (t == '(' || t == '{') {
+        ++*depth;
+    } else if (t == ')' || t == '}') {
+        --*depth;
+        if (*nl && *depth == e[0] && e[1] == (t == ')' ? HEAD : BRACED)) {
+            if (t == ')')
+                e[1] = BODY;
+            else
+                --*nl;
+        }
+    } else if (t == ';') {
+        while (*nl && lp[2 * *nl - 1] == STMT && lp[2 * *nl - 2] == *depth)
+            --*nl;
+    } else if ((t == TOK_FOR || t == TOK_WHILE || t == TOK_DO) && *nl < 8) {
+        e = &lp[2 * (*nl)++];
+        e[0] = *depth;
+        e[1] = t == TOK_DO ? BODY : HEAD;
+    }
+    return *nl;
+}
+
+/* the entry of identifier 'v', NULL or a new one if not there */
+static RegvarCnt *regvar_lookup(int v, int add)
+{
+    RegvarCnt *e;
+    int h;
+    for (h = v;; h++) {
+        e = &regvar_cnt[h & regvar_mask];
+        if (e->v == v)
+            return e;
+        if (e->v == 0)
+            break;
+    }
+    if (add)
+        e->v = v;
+    return add ? e : NULL;
+}
+
+/* -O1: choose the most used identifiers of the function body 'str'
+   that never follow a unary '&' or precede a '(', for register
+   variables.  At -O2 also choose some more for floating point ones.
+   With -b, none are chosen but the counts are kept for cprop_safe(). */
+static void regvar_scan(TokenString *str)
+{
+    const int *p = str->str;
+    int t, prev = 0, prev2 = 0, amp = 0, i, n;
+    int lp[16], nl = 0, depth = 0, w = 1;
+    RegvarCnt *e, *best;
+
+    func_regvars = regvar_ntok = 0;
+    tcc_free(regvar_cnt);
+    regvar_cnt = NULL;
+    if (tcc_state->optimize < 1
+        || (tcc_state->do_debug && !tcc_state->do_bounds_check))
+        return;
+    /* no more identifiers than tokens: keep it at most half full */
+    for (n = 16; n < 2 * str->len; n *= 2)
+        ;
+    regvar_cnt = tcc_mallocz(n * sizeof *regvar_cnt);
+    regvar_mask = n - 1;
+    regvar_last = tok_ident;
+    while ((t = tok_str_next(&p)) != TOK_EOF) {
+        if (t == TOK_LINENUM || t == TOK_PPPACK)
+            continue;
+        if (t == TOK_ASM1 || t == TOK_ASM2 || t == TOK_ASM3)
+            goto done; /* asm operands may refer to variables */
+        if (tcc_state->loop_regvars)
+            w = 1 << 3 * regvar_loops(t, lp, &nl, &depth);
+        if (t == '&')
+            /* unary unless after an operand (')' might be a cast) */
+            amp = !(prev >= TOK_UIDENT || TOK_HAS_VALUE(prev) || prev == ']');
+        else if (t == '(' && prev >= TOK_UIDENT && prev2 != '.' && prev2 != TOK_ARROW)
+            regvar_lookup(prev, 1)->cnt = -1;
+        else if (t != '(')
+            amp = amp && t >= TOK_UIDENT;
+        if (t >= TOK_UIDENT && prev != '.' && prev != TOK_ARROW) {
+            e = regvar_lookup(t, 1);
+            if (amp)
+                e->cnt = -1;
+            else if (e->cnt >= 0 && e->cnt < 0x10000000)
+                e->cnt += w;
+        }
+        prev2 = prev, prev = t;
+    }
+    n = NB_REGVARS;
+    if (tcc_state->float_regvars)
+        n += NB_FREGVARS;
+    if (tcc_state->do_bounds_check)
+        n = 0;
+    for (; regvar_ntok < n; regvar_ntok++) {
+        for (i = 0, best = NULL; i <= regvar_mask; i++) {
+            e = &regvar_cnt[i];
+            if (e->cnt > 0 && (!best || e->cnt > best->cnt
+                               || (e->cnt == best->cnt && e->v < best->v)))
+                best = e;
+        }
+        if (!best)
+            break;
+        regvar_tok[regvar_ntok] = best->v;
+        best->cnt = 0;
+    }
+    func_regvars = regvar_ntok < NB_REGVARS ? regvar_ntok : NB_REGVARS;
+    return; /* the counts are kept for cprop_safe() */
+done:
+    tcc_free(regvar_cnt);
+    regvar_cnt = NULL;
+}
+
+/* put scalar local 's' into a register if it was chosen above: the
+   first NB_REGVARS names for any type, the others for floats only */
+static void regvar_alloc(Sym *s, int param)
+{
+    int i, bt = s->type.t & VT_BTYPE;
+    if (s->r != (VT_LOCAL | VT_LVAL)
+        || (s->type.t & (VT_VOLATILE | VT_ARRAY | VT_VLA | VT_BITFIELD)))
+        return;
+    if (bt == VT_FLOAT || bt == VT_DOUBLE)
+        i = NB_FREGVARS ? 0 : regvar_ntok;
+    else if (bt == VT_BYTE || bt == VT_SHORT || bt == VT_INT
+             || bt == VT_LLONG || bt == VT_PTR || bt == VT_BOOL)
+        i = 0, bt = 0;
+    else
+        return;
+    for (; i < regvar_ntok && (bt || i < NB_REGVARS); i++)
+        if (regvar_tok[i] == s->v) {
+            regvar_tok[i] = 0;
+            gen_regvar(s->c, s->type.t, param);
+            break;
+        }
+}
+#endif
+
 /* parse an initializer for type 't' if 'has_init' is non zero, and
    allocate space in local or global data space ('r' is either
    VT_LOCAL or VT_CONST). If 'v' is non zero, then an associated
@@ -8127,8 +8968,18 @@ static void decl_initializer_alloc(CType *type, AttributeDef *ad, int r,
 	    }
 #endif
             sym = sym_push(v, type, r, addr);
+#ifdef NB_REGVARS
+            if (func_regvars && !ad->asm_label && !ad->cleanup_func && !inl_cur)
+                regvar_alloc(sym, 0);
+#endif
 	    if (ad->cleanup_func) {
-		Sym *cls = sym_push2(&all_cleanups,
+		Sym *cls;
+#ifdef NB_REGVARS
+                /* its address is passed to the cleanup, without a '&' */
+                if (regvar_cnt && v < regvar_last)
+                    regvar_lookup(v, 1)->cnt = -1;
+#endif
+		cls = sym_push2(&all_cleanups,
                     SYM_FIELD | ++cur_scope->cl.n, 0, 0);
 		cls->prev_tok = sym;
 		cls->next = ad->cleanup_func;
@@ -8333,20 +9184,33 @@ static void gen_function(Sym *sym)
         add_array (tcc_state, ".fini_array", sym->c);
 
     /* put debug symbol */
-    tcc_debug_funcstart(tcc_state, sym);
+    PROF_CALL(tcc_state, TP_DEBUG, tcc_debug_funcstart(tcc_state, sym));
+    if (tcc_state->prof)
+        tcc_prof_func(tcc_state, funcname);
 
     /* push a dummy symbol to enable local sym storage */
     sym_push2(&local_stack, SYM_FIELD, 0, 0);
     local_scope = 1; /* for function parameters */
     gfunc_prolog(sym);
+#ifdef NB_REGVARS
+    if (func_regvars) {
+        Sym *s;
+        for (s = local_stack; s->v != SYM_FIELD; s = s->prev)
+            regvar_alloc(s, 1);
+    }
+#endif
     tcc_debug_prolog_epilog(tcc_state, 0);
+    tcc_tcov_prolog(tcc_state);
 
     local_scope = 0;
     rsym = 0;
     clear_temp_local_var_list();
     func_vla_arg(sym);
+    cprop_on = tcc_state->optimize >= 1 && !debug_modes;
     block(0);
+    cprop_drop();
     gsym(rsym);
+    cprop_on = 0;
 
     nocode_wanted = 0;
     /* reset local stack */
@@ -8355,7 +9219,9 @@ static void gen_function(Sym *sym)
     gfunc_epilog();
 
     /* end of function */
-    tcc_debug_funcend(tcc_state, ind - func_ind);
+    PROF_CALL(tcc_state, TP_DEBUG, tcc_debug_funcend(tcc_state, ind - func_ind));
+    if (tcc_state->prof)
+        tcc_prof_func(tcc_state, NULL);
 
     /* patch symbol size */
     elfsym(sym)->st_size = ind - func_ind;
@@ -8370,6 +9236,7 @@ static void gen_function(Sym *sym)
     funcname = ""; /* for safety */
     func_vt.t = VT_VOID; /* for safety */
     func_var = 0; /* for safety */
+    func_opt_reset();
     ind = 0; /* for safety */
     func_ind = -1;
     nocode_wanted = DATA_ONLY_WANTED;
@@ -8397,6 +9264,9 @@ static void gen_inline_functions(TCCState *s)
                    generate its code and convert it to a normal function */
                 fn->sym = NULL;
                 tccpp_putfile(fn->filename);
+#ifdef NB_REGVARS
+                regvar_scan(fn->func_str);
+#endif
                 begin_macro(fn->func_str, 1);
                 next();
                 cur_text_section = text_section;
@@ -8418,6 +9288,7 @@ static void free_inline_functions(TCCState *s)
         struct InlineFunc *fn = s->inline_fns[i];
         if (fn->sym)
             tok_str_free(fn->func_str);
+        tcc_free(fn->itok);
     }
     dynarray_reset(&s->inline_fns, &s->nb_inline_fns);
 }
@@ -8596,12 +9467,13 @@ static int decl(int l)
                    the compilation unit only if they are used */
                 if (sym->type.t & VT_INLINE) {
                     struct InlineFunc *fn;
-                    fn = tcc_malloc(sizeof *fn + strlen(file->filename));
+                    fn = tcc_mallocz(sizeof *fn + strlen(file->filename));
                     strcpy(fn->filename, file->filename);
                     fn->sym = sym;
                     dynarray_add(&tcc_state->inline_fns,
 				 &tcc_state->nb_inline_fns, fn);
                     skip_or_save_block(&fn->func_str);
+                    inline_record(sym, fn->func_str, fn);
                 } else {
                     /* compute text section */
                     cur_text_section = ad.section;
@@ -8609,6 +9481,22 @@ static int decl(int l)
                         cur_text_section = text_section;
                     else if (cur_text_section->sh_num > bss_section->sh_num)
                         cur_text_section->sh_flags = text_section->sh_flags;
+                    if (tcc_state->optimize >= 1) {
+                        /* look at the whole body first */
+                        TokenString *str;
+                        skip_or_save_block(&str);
+                        unget_tok(0);
+#ifdef NB_REGVARS
+                        regvar_scan(str);
+#endif
+                        begin_macro(str, 1);
+                        next();
+                        gen_function(sym);
+                        inline_record(sym, str, NULL);
+                        end_macro();
+                        next();
+                        break;
+                    }
                     gen_function(sym);
                 }
                 break;
@@ -43,23 +43,29 @@ ST_DATA int pp_expr;
 
 /* ------------------------------------------------------------------------- */
 
-static TokenSym *hash_ident[TOK_HASH_SIZE];
-static char token_buf[STRING_MAX_SIZE + 1];
-static CString cstr_buf;
-static TokenString tokstr_buf;
-static TokenString unget_buf;
-static unsigned char isidnum_table[256 - CH_EOF];
-static int pp_debug_tok, pp_debug_symv;
-static int pp_counter;
+/* open addressed identifier table: full hash and index into table_ident,
+   0 for an empty slot */
+typedef struct TokHash {
+    unsigned hash, id;
+} TokHash;
+static ST_TLS TokHash *hash_ident;
+static ST_TLS unsigned hash_ident_mask;
+static ST_TLS char token_buf[STRING_MAX_SIZE + 1];
+static ST_TLS CString cstr_buf;
+static ST_TLS TokenString tokstr_buf;
+static ST_TLS TokenString unget_buf;
+static ST_TLS unsigned char isidnum_table[256 - CH_EOF];
+static ST_TLS int pp_debug_tok, pp_debug_symv;
+static ST_TLS int pp_counter;
 static void tok_print(const int *str, const char *msg, ...);
 static void next_nomacro(void);
 static void parse_number(const char *p);
 static void parse_string(const char *p, int len);
 
-static struct TinyAlloc *toksym_alloc;
-static struct TinyAlloc *tokstr_alloc;
+static ST_TLS struct TinyAlloc *toksym_alloc;
+static ST_TLS struct TinyAlloc *tokstr_alloc;
 
-static TokenString *macro_stack;
+static ST_TLS TokenString *macro_stack;
 
 static const char tcc_keywords[] = 
 #define DEF(id, str) str "\0"
@@ -252,6 +258,14 @@ static void *tal_realloc_impl(TinyAlloc **pal, void *p, unsigned size TAL_DEBUG_
 tail_call:
     is_own = (al->buffer <= (uint8_t *)p && (uint8_t *)p < al->buffer + al->size);
     if ((!p || is_own) && size <= al->limit) {
+        header = (tal_header_t *)p - 1;
+        if (is_own && (uint8_t *)p + header->size == al->p
+            && (uint8_t *)p - al->buffer + adj_size < al->size) {
+            /* the last chunk can grow in place */
+            header->size = adj_size;
+            al->p = (uint8_t *)p + adj_size;
+            return p;
+        }
         if (al->p - al->buffer + adj_size + sizeof(tal_header_t) < al->size) {
             header = (tal_header_t *)al->p;
             header->size = adj_size;
@@ -460,7 +474,7 @@ static void add_char(CString *cstr, int c)
 
 /* ------------------------------------------------------------------------- */
 /* allocate a new token */
-static TokenSym *tok_alloc_new(TokenSym **pts, const char *str, int len)
+static TokenSym *tok_alloc_new(const char *str, int len)
 {
     TokenSym *ts, **ptable;
     int i;
@@ -483,39 +497,77 @@ static TokenSym *tok_alloc_new(TokenSym **pts, const char *str, int len)
     ts->sym_struct = NULL;
     ts->sym_identifier = NULL;
     ts->len = len;
-    ts->hash_next = NULL;
     memcpy(ts->str, str, len);
     ts->str[len] = '\0';
-    *pts = ts;
     return ts;
 }
 
 #define TOK_HASH_INIT 1
 #define TOK_HASH_FUNC(h, c) ((h) + ((h) << 5) + ((h) >> 27) + (c))
 
+#define TOK_HASH_MIN 16384 /* initial size of hash_ident, a power of two */
+
+/* hash an identifier 8 bytes at a time */
+static inline unsigned tok_hash(const char *str, int len)
+{
+    unsigned char *p = (unsigned char *)str;
+    uint64_t h = len, w;
+
+    if (len >= 8) {
+        for (; len > 8; p += 8, len -= 8)
+            h = (h ^ read64le(p)) * 0x9e3779b97f4a7c15ull;
+        w = read64le(p + len - 8); /* may overlap the previous word */
+    } else {
+        w = 0;
+        if (len & 4)
+            w = read32le(p);
+        if (len & 2)
+            w |= (uint64_t)read16le(p + (len & 4)) << (len & 4) * 8;
+        if (len & 1)
+            w |= (uint64_t)p[len - 1] << (len & 6) * 8;
+    }
+    h = (h ^ w) * 0x9e3779b97f4a7c15ull;
+    return h >> 32;
+}
+
+/* double hash_ident, keeping it at most half full */
+static void tok_hash_grow(void)
+{
+    TokHash *old = hash_ident, *e;
+    unsigned n = hash_ident_mask + 1, i, j;
+
+    hash_ident = tcc_mallocz(2 * n * sizeof(TokHash));
+    hash_ident_mask = 2 * n - 1;
+    for (i = 0; i < n; i++) {
+        if (!old[i].id)
+            continue;
+        for (j = old[i].hash; (e = &hash_ident[j & hash_ident_mask])->id; j++)
+            ;
+        *e = old[i];
+    }
+    tcc_free(old);
+}
 
 /* find a token and add it if not found */
 ST_FUNC TokenSym *tok_alloc(const char *str, int len)
 {
-    TokenSym *ts, **pts;
-    int i;
-    unsigned int h;
-    
-    h = TOK_HASH_INIT;
-    for(i=0;i<len;i++)
-        h = TOK_HASH_FUNC(h, ((unsigned char *)str)[i]);
-    h &= (TOK_HASH_SIZE - 1);
-
-    pts = &hash_ident[h];
-    for(;;) {
-        ts = *pts;
-        if (!ts)
-            break;
-        if (ts->len == len && !memcmp(ts->str, str, len))
-            return ts;
-        pts = &(ts->hash_next);
+    TokenSym *ts;
+    TokHash *e;
+    unsigned h, i;
+
+    h = tok_hash(str, len);
+    for (i = h; (e = &hash_ident[i & hash_ident_mask])->id; i++) {
+        if (e->hash == h) {
+            ts = table_ident[e->id - 1];
+            if (ts->len == len && !memcmp(ts->str, str, len))
+                return ts;
+        }
     }
-    return tok_alloc_new(pts, str, len);
+    ts = tok_alloc_new(str, len);
+    e->hash = h, e->id = ts->tok - TOK_IDENT + 1;
+    if (2 * e->id > hash_ident_mask)
+        tok_hash_grow();
+    return ts;
 }
 
 ST_FUNC int tok_alloc_const(const char *str)
@@ -646,7 +698,7 @@ static int handle_eob(void)
 
     /* only tries to read if really end of buffer */
     if (bf->buf_ptr >= bf->buf_end) {
-        if (bf->fd >= 0) {
+        if (bf->fd >= 0 && !bf->map) {
 #if defined(PARSE_DEBUG)
             len = 1;
 #else
@@ -737,6 +789,55 @@ static int handle_stray(uint8_t **p)
         c = handle_stray(&p); \
 }
 
+#if defined __SSE2__ && defined __GNUC__ && !defined __TINYC__
+# define SCAN_SSE2 1 /* <emmintrin.h> is included by tcc.h */
+#endif
+
+/* return the first 'p' that points to one of 'a', 'b', 'c' or 'd'.
+   One of these must be CH_EOB to stop at the end of the buffer, which
+   is followed by IO_BUF_PAD more bytes so we can look at 16 at once. */
+static inline uint8_t *scan_chr(uint8_t *p, int a, int b, int c, int d)
+{
+#ifdef SCAN_SSE2
+    __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+    __m128i vc = _mm_set1_epi8(c), vd = _mm_set1_epi8(d);
+    for (;; p += 16) {
+        __m128i x = _mm_loadu_si128((__m128i *)p);
+        int m = _mm_movemask_epi8(_mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(x, va), _mm_cmpeq_epi8(x, vb)),
+            _mm_or_si128(_mm_cmpeq_epi8(x, vc), _mm_cmpeq_epi8(x, vd))));
+        if (m)
+            return p + __builtin_ctz(m);
+    }
+#else
+    for (;; p += 2) {
+        if (p[0] == a || p[0] == b || p[0] == c || p[0] == d)
+            return p;
+        if (p[1] == a || p[1] == b || p[1] == c || p[1] == d)
+            return p + 1;
+    }
+#endif
+}
+
+/* skip blanks and tabs */
+static inline uint8_t *scan_blanks(uint8_t *p)
+{
+#ifdef SCAN_SSE2
+    __m128i vs = _mm_set1_epi8(' '), vt = _mm_set1_epi8('\t');
+    for (;; p += 16) {
+        __m128i x = _mm_loadu_si128((__m128i *)p);
+        int m = _mm_movemask_epi8(_mm_or_si128(
+            _mm_cmpeq_epi8(x, vs), _mm_cmpeq_epi8(x, vt))) ^ 0xffff;
+        if (m)
+            return p + __builtin_ctz(m);
+    }
+#else
+    while (*p == ' ' || *p == '\t')
+        ++p;
+    return p;
+#endif
+}
+
 static int skip_spaces(void)
 {
     int ch;
@@ -752,22 +853,18 @@ static uint8_t *parse_line_comment(uint8_t *p)
 {
     int c;
     for(;;) {
-        for (;;) {
-            c = *++p;
+        p = scan_chr(p + 1, '\n', '\\', '\n', '\\');
+        c = *p;
     redo:
-            if (c == '\n' || c == '\\')
-                break;
-            c = *++p;
-            if (c == '\n' || c == '\\')
-                break;
-        }
         if (c == '\n')
             break;
-        c = handle_bs(&p);
-        if (c == CH_EOF)
-            break;
-        if (c != '\\')
-            goto redo;
+        if (c == '\\') {
+            c = handle_bs(&p);
+            if (c == CH_EOF)
+                break;
+            if (c != '\\')
+                goto redo;
+        }
     }
     return p;
 }
@@ -778,15 +875,9 @@ static uint8_t *parse_comment(uint8_t *p)
     int c;
     for(;;) {
         /* fast skip loop */
-        for(;;) {
-            c = *++p;
-        redo:
-            if (c == '\n' || c == '*' || c == '\\')
-                break;
-            c = *++p;
-            if (c == '\n' || c == '*' || c == '\\')
-                break;
-        }
+        p = scan_chr(p + 1, '\n', '*', '\\', '\n');
+        c = *p;
+    redo:
         /* now we can handle all the cases */
         if (c == '\n') {
             file->line_num++;
@@ -799,7 +890,7 @@ static uint8_t *parse_comment(uint8_t *p)
             if (c == '/')
                 break;
             goto check_eof;
-        } else {
+        } else if (c == '\\') {
             c = handle_bs(&p);
         check_eof:
             if (c == CH_EOF)
@@ -814,9 +905,14 @@ static uint8_t *parse_comment(uint8_t *p)
 /* parse a string without interpreting escapes */
 static uint8_t *parse_pp_string(uint8_t *p, int sep, CString *str)
 {
+    uint8_t *p1;
     int c;
     for(;;) {
-        c = *++p;
+        p1 = p + 1;
+        p = scan_chr(p1, sep, '\\', '\n', '\r');
+        if (str && p > p1)
+            cstr_cat(str, (char *)p1, p - p1);
+        c = *p;
     redo:
         if (c == sep) {
             break;
@@ -1102,6 +1198,7 @@ static void tok_str_add2(TokenString *s, int t, CValue *cv)
     case TOK_LCHAR:
     case TOK_CFLOAT:
     case TOK_LINENUM:
+    case TOK_PPPACK:
 #if LONG_SIZE == 4
     case TOK_CLONG:
     case TOK_CULONG:
@@ -1179,6 +1276,17 @@ static void tok_str_add2_spc(TokenString *s, int t, CValue *cv)
     tok_str_add2(s, t, cv);
 }
 
+/* add the already encoded tokens from p to e at once */
+static void tok_str_add_run(TokenString *s, const int *p, const int *e)
+{
+    int len = s->len, n = e - p;
+
+    if (len + n >= s->allocated_len)
+        tok_str_realloc(s, len + n + 1);
+    memcpy(s->str + len, p, n * sizeof(int));
+    s->len = len + n;
+}
+
 /* get a token from an integer array and increment pointer. */
 static inline void tok_get(int *t, const int **pp, CValue *cv)
 {
@@ -1194,6 +1302,7 @@ static inline void tok_get(int *t, const int **pp, CValue *cv)
     case TOK_CCHAR:
     case TOK_LCHAR:
     case TOK_LINENUM:
+    case TOK_PPPACK:
         cv->i = *p++;
         break;
 #if LONG_SIZE == 4
@@ -1255,6 +1364,69 @@ static inline void tok_get(int *t, const int **pp, CValue *cv)
     } while (0)
 #endif
 
+/* return the next token of a token string (without its value) */
+ST_FUNC int tok_str_next(const int **pp)
+{
+    CValue cv;
+    int t;
+    TOK_GET(&t, pp, &cv);
+    return t >= TOK_IDENT ? t & ~SYM_FIELD : t;
+}
+
+/* return the end of the tokens in p that need no macro substitution,
+   stopping at spaces and 'defined' as well */
+static const int *tok_str_plain(const int *p)
+{
+    CValue cv;
+    int t;
+
+    for (;;) {
+        t = *p;
+        if (t == 0 || t == TOK_EOF || t == ' ' || t == TOK_DEFINED
+            || (t >= TOK_IDENT && define_find(t)))
+            return p;
+        TOK_GET(&t, &p, &cv);
+    }
+}
+
+/* return the end of the tokens in p that cannot end a macro argument */
+static const int *tok_str_arg(const int *p)
+{
+    CValue cv;
+    int t;
+
+    for (;;) {
+        t = *p;
+        if (t == 0 || t == TOK_EOF || t == ' '
+            || t == '(' || t == ')' || t == ',')
+            return p;
+        TOK_GET(&t, &p, &cv);
+    }
+}
+
+/* return the TOK_EOF at the end of a macro argument */
+static const int *tok_str_end(const int *p)
+{
+    CValue cv;
+    int t;
+
+    while (*p != TOK_EOF)
+        TOK_GET(&t, &p, &cv);
+    return p;
+}
+
+/* return true if the token string p (up to 0 or TOK_EOF) contains
+   no macro to expand */
+static int tok_str_is_plain(const int *p)
+{
+    for (;;) {
+        p = tok_str_plain(p);
+        if (*p != ' ')
+            return *p == 0 || *p == TOK_EOF;
+        ++p;
+    }
+}
+
 static int macro_is_equal(const int *a, const int *b)
 {
     CValue cv;
@@ -1448,6 +1620,8 @@ static int parse_include(TCCState *s1, int do_next, int test)
         }
         /* add include file debug info */
         tcc_debug_bincl(s1);
+        if (s1->prof)
+            tcc_prof_file(s1, 1);
     }
     return 1;
 }
@@ -1706,7 +1880,7 @@ static int pragma_parse(TCCState *s1)
     } else if (tok == TOK_once) {
         search_cached_include(s1, file->true_filename, 1)->once = 1;
 
-    } else if (s1->output_type == TCC_OUTPUT_PREPROCESS) {
+    } else if (s1->output_type == TCC_OUTPUT_PREPROCESS && !s1->emit_pch) {
         /* tcc -E: keep pragmas below unchanged */
         unget_tok(' ');
         unget_tok(TOK_PRAGMA);
@@ -2550,7 +2724,6 @@ static void next_nomacro(void)
     int t, c, is_long, len;
     TokenSym *ts;
     uint8_t *p, *p1;
-    unsigned int h;
 
     p = file->buf_ptr;
  redo_no_start:
@@ -2563,6 +2736,7 @@ static void next_nomacro(void)
  maybe_space:
         if (parse_flags & PARSE_FLAG_SPACES)
             goto keep_tok_flags;
+        p = scan_blanks(p);
         while (isidnum_table[*p - CH_EOF] & IS_SPC)
             ++p;
         goto redo_no_start;
@@ -2604,6 +2778,8 @@ static void next_nomacro(void)
 
                 /* add end of include file debug info */
                 tcc_debug_eincl(tcc_state);
+                if (s1->prof)
+                    tcc_prof_file(s1, 0);
                 /* pop include stack */
                 tcc_close();
                 s1->include_stack_ptr--;
@@ -2632,7 +2808,7 @@ maybe_newline:
             (parse_flags & PARSE_FLAG_PREPROCESS)) {
             tok_flags &= ~TOK_FLAG_BOL;
             file->buf_ptr = p;
-            preprocess(tok_flags & TOK_FLAG_BOF);
+            PROF_CALL(tcc_state, TP_PP, preprocess(tok_flags & TOK_FLAG_BOF));
             p = file->buf_ptr;
             goto maybe_newline;
         } else {
@@ -2676,28 +2852,12 @@ maybe_newline:
     case '_':
     parse_ident_fast:
         p1 = p;
-        h = TOK_HASH_INIT;
-        h = TOK_HASH_FUNC(h, c);
         while (c = *++p, isidnum_table[c - CH_EOF] & (IS_ID|IS_NUM))
-            h = TOK_HASH_FUNC(h, c);
+            ;
         len = p - p1;
         if (c != '\\') {
-            TokenSym **pts;
-
-            /* fast case : no stray found, so we have the full token
-               and we have already hashed it */
-            h &= (TOK_HASH_SIZE - 1);
-            pts = &hash_ident[h];
-            for(;;) {
-                ts = *pts;
-                if (!ts)
-                    break;
-                if (ts->len == len && !memcmp(ts->str, p1, len))
-                    goto token_found;
-                pts = &(ts->hash_next);
-            }
-            ts = tok_alloc_new(pts, (char *) p1, len);
-        token_found: ;
+            /* fast case : no stray found, so we have the full token */
+            ts = tok_alloc((char *) p1, len);
         } else {
             /* slower case */
             cstr_reset(&tokcstr);
@@ -2952,7 +3112,7 @@ keep_tok_flags:
 }
 
 #ifdef PP_DEBUG
-static int indent;
+static ST_TLS int indent;
 static void define_print(TCCState *s1, int v);
 static void pp_print(const char *msg, int v, const int *str)
 {
@@ -3074,17 +3234,18 @@ static int *macro_arg_subst(Sym **nested_list, const int *macro_str, Sym *args)
 			   used multiple times, but not if the argument
 			   contains the __COUNTER__ macro.  */
 			TokenString str2;
-			tok_str_new(&str2);
-			macro_subst(&str2, nested_list, st);
-			tok_str_add(&str2, TOK_EOF);
-			s->e = str2.str;
+			if (tok_str_is_plain(st)) {
+			    s->e = s->d; /* nothing to expand */
+			} else {
+			    tok_str_new(&str2);
+			    macro_subst(&str2, nested_list, st);
+			    tok_str_add(&str2, TOK_EOF);
+			    s->e = str2.str;
+			}
 		    }
 		    st = s->e;
                 }
-                while (*st != TOK_EOF) {
-                    TOK_GET(&t2, &st, &cval);
-                    tok_str_add2(&str, t2, &cval);
-                }
+                tok_str_add_run(&str, st, tok_str_end(st));
             } else {
                 tok_str_add(&str, t);
             }
@@ -3303,10 +3464,17 @@ static int macro_subst_tok(
                         parlevel++;
                     if (t == ')')
                         parlevel--;
-                    if (t == ' ')
+                    if (t == ' ') {
                         str.need_spc |= 1;
-                    else
+                    } else {
                         tok_str_add2_spc(&str, t, &tokc);
+                        if (macro_ptr) {
+                            /* take what surely belongs to this argument */
+                            const int *p = tok_str_arg(macro_ptr);
+                            tok_str_add_run(&str, macro_ptr, p);
+                            macro_ptr = p;
+                        }
+                    }
                     t = next_argstream(nested_list, NULL);
                 }
                 tok_str_add(&str, TOK_EOF);
@@ -3332,8 +3500,9 @@ static int macro_subst_tok(
             sa = args;
             while (sa) {
                 sa1 = sa->prev;
+                if (sa->e != sa->d)
+                    tok_str_free_str(sa->e);
                 tok_str_free_str(sa->d);
-                tok_str_free_str(sa->e);
                 sym_free(sa);
                 sa = sa1;
             }
@@ -3411,7 +3580,7 @@ static int macro_subst(
     Sym *s;
     int t, nosubst = 0;
     CValue cval;
-    TokenString *str;
+    TokenString str;
 
 #ifdef PP_DEBUG
     int tlen = tok_str->len;
@@ -3419,6 +3588,17 @@ static int macro_subst(
 #endif
 
     while (1) {
+        if (!nosubst) {
+            /* copy tokens without macros in one go */
+            const int *p = tok_str_plain(macro_str);
+            if (p != macro_str) {
+                if (tok_str->need_spc == 3)
+                    tok_str_add(tok_str, ' ');
+                tok_str->need_spc = 2;
+                tok_str_add_run(tok_str, macro_str, p);
+                macro_str = p;
+            }
+        }
         TOK_GET(&t, &macro_str, &cval);
         if (t == 0 || t == TOK_EOF)
             break;
@@ -3432,11 +3612,18 @@ static int macro_subst(
                 t |= SYM_FIELD;
                 goto no_subst;
             }
-            str = tok_str_alloc();
-            str->str = (int*)macro_str; /* setup stream for possible arguments */
-            begin_macro(str, 2);
+            if (s->d && !(s->type.t & (MACRO_FUNC | MACRO_JOIN))
+                && tok_str_is_plain(s->d)) {
+                /* object like macro without macros in its body: needs
+                   neither the argument stream nor the nested list */
+                macro_subst(tok_str, nested_list, s->d);
+                continue;
+            }
+            /* setup stream for possible arguments, not freed by end_macro */
+            str.str = (int*)macro_str;
+            begin_macro(&str, 0);
             nosubst = macro_subst_tok(tok_str, nested_list, s);
-            if (macro_stack != str) {
+            if (macro_stack != &str) {
                 /* already finished by reading function macro arguments */
                 break;
             }
@@ -3476,6 +3663,10 @@ redo:
                 file->line_num = tokc.i;
                 goto redo;
             }
+            if (t == TOK_PPPACK) {
+                *tcc_state->pack_stack_ptr = tokc.i;
+                goto redo;
+            }
             goto convert;
         } else if (t == 0) {
             /* end of macro or unget token string */
@@ -3495,16 +3686,20 @@ redo:
         return;
     }
 
-    next_nomacro();
+    PROF_CALL(tcc_state, TP_LEX, next_nomacro());
     t = tok;
     if (t >= TOK_IDENT && (parse_flags & PARSE_FLAG_PREPROCESS)) {
         /* if reading from file, try to substitute macros */
         Sym *s = define_find(t);
         if (s) {
             Sym *nested_list = NULL;
+            if (tcc_state->prof)
+                tcc_prof_macro(tcc_state, t);
             macro_subst_tok(&tokstr_buf, &nested_list, s);
             tok_str_add(&tokstr_buf, 0);
             begin_macro(&tokstr_buf, 0);
+            if (tcc_state->prof)
+                tcc_prof_macro(tcc_state, 0);
             goto redo;
         }
         return;
@@ -3591,10 +3786,8 @@ static void tcc_predefs(TCCState *s1, CString *cs, int is_asm)
 #endif
     if (is_asm)
       putdef(cs, "__ASSEMBLER__");
-    if (s1->output_type == TCC_OUTPUT_PREPROCESS)
+    if (s1->output_type == TCC_OUTPUT_PREPROCESS && !s1->emit_pch)
       putdef(cs, "__TCC_PP__");
-    if (s1->output_type == TCC_OUTPUT_MEMORY)
-      putdef(cs, "__TCC_RUN__");
 #ifdef CONFIG_TCC_BACKTRACE
     if (s1->do_backtrace)
       putdef(cs, "__TCC_BACKTRACE__");
@@ -3625,7 +3818,255 @@ static void tcc_predefs(TCCState *s1, CString *cs, int is_asm)
 #endif
         , -1);
     }
-    cstr_printf(cs, "#define __BASE_FILE__ \"%s\"\n", file->filename);
+}
+
+/* ------------------------------------------------------------------------- */
+/* precompiled headers (-emit-pch, -include-pch): the token stream of a
+   header as seen by the parser, plus the macros, include guards and
+   pragma libs in effect at its end.  It can be used only with the same
+   predefined macros and -D options. */
+
+#define PCH_MAGIC "TCC PCH " TCC_VERSION
+
+static ST_TLS int *pch_buf, *pch_end, pch_size;
+
+static void pch_free(void)
+{
+    if (pch_buf)
+        unmap_data(pch_buf, pch_size);
+    pch_buf = NULL;
+}
+
+static void pch_put(FILE *fp, const void *data, int size)
+{
+    static const char zeros[sizeof(int)];
+    fwrite(data, 1, size, fp);
+    fwrite(zeros, 1, -size & (sizeof(int) - 1), fp);
+}
+
+static void pch_put_int(FILE *fp, int v)
+{
+    fwrite(&v, sizeof v, 1, fp);
+}
+
+static void pch_put_str(FILE *fp, const char *str)
+{
+    int len = strlen(str);
+    pch_put_int(fp, len);
+    pch_put(fp, str, len + 1);
+}
+
+static int *pch_get(int **pp, int n)
+{
+    int *p = *pp;
+    if (n < 0 || pch_end - p < n)
+        tcc_error("'%s' is not a valid precompiled header", tcc_state->pch_file);
+    *pp = p + n;
+    return p;
+}
+
+static int pch_get_int(int **pp)
+{
+    return *pch_get(pp, 1);
+}
+
+static char *pch_get_str(int **pp)
+{
+    int len = pch_get_int(pp);
+    char *s = (char *)pch_get(pp, len < 0 ? -1 : len / sizeof(int) + 1);
+    if (s[len])
+        pch_get(pp, -1);
+    return s;
+}
+
+static int pch_write(TCCState *s1)
+{
+    FILE *fp = s1->ppfp;
+    TokenString str;
+    CString cstr;
+    CValue cval;
+    CachedInclude *e;
+    Sym *s, *a;
+    int i, n, t, v, pack, base_file;
+    const int *p;
+
+    /* collect the tokens like tccgen_compile() would see them */
+    parse_flags = PARSE_FLAG_PREPROCESS | PARSE_FLAG_TOK_NUM | PARSE_FLAG_TOK_STR;
+    tok_str_new(&str);
+    pack = 0;
+    for (;;) {
+        next();
+        if (*s1->pack_stack_ptr != pack) {
+            cval.i = pack = *s1->pack_stack_ptr;
+            tok_str_add2(&str, TOK_PPPACK, &cval);
+        }
+        if (tok == TOK_EOF)
+            break;
+        tok_str_add2(&str, tok, &tokc);
+    }
+    tok_str_add(&str, 0);
+
+    cstr_new(&cstr);
+    tcc_predefs(s1, &cstr, 0);
+    if (s1->cmdline_defs.size)
+        cstr_cat(&cstr, s1->cmdline_defs.data, s1->cmdline_defs.size);
+    cstr_ccat(&cstr, '\0');
+    pch_put_str(fp, PCH_MAGIC);
+    pch_put_str(fp, cstr.data);
+    /* the -include options, not needed again with the pch */
+    cstr.size = 0;
+    if (s1->cmdline_incl.size)
+        cstr_cat(&cstr, s1->cmdline_incl.data, s1->cmdline_incl.size);
+    cstr_ccat(&cstr, '\0');
+    pch_put_str(fp, cstr.data);
+    cstr_free(&cstr);
+
+    /* all identifiers, such that they get the same token numbers */
+    base_file = tok_alloc_const("__BASE_FILE__");
+    pch_put_int(fp, tok_ident - TOK_IDENT);
+    for (i = TOK_IDENT; i < tok_ident; i++)
+        pch_put_str(fp, table_ident[i - TOK_IDENT]->str);
+
+    /* macros */
+    for (n = 0; n < 2; n++) {
+        if (n)
+            pch_put_int(fp, i);
+        for (i = 0, s = define_stack; s; s = s->prev) {
+            v = s->v;
+            if (v < TOK_IDENT || v >= tok_ident || v == base_file
+                || table_ident[v - TOK_IDENT]->sym_define != s || !s->d)
+                continue;
+            ++i;
+            if (!n)
+                continue;
+            pch_put_int(fp, v);
+            pch_put_int(fp, s->type.t);
+            for (t = 0, a = s->next; a; a = a->next)
+                ++t;
+            pch_put_int(fp, t);
+            for (a = s->next; a; a = a->next)
+                pch_put_int(fp, a->v), pch_put_int(fp, a->type.t);
+            p = s->d;
+            do TOK_GET(&t, &p, &cval); while (t);
+            pch_put_int(fp, p - s->d);
+            pch_put(fp, s->d, (p - s->d) * sizeof(int));
+        }
+    }
+
+    /* include guards and #pragma once */
+    pch_put_int(fp, s1->nb_cached_includes);
+    for (i = 0; i < s1->nb_cached_includes; i++) {
+        e = s1->cached_includes[i];
+        pch_put_int(fp, e->ifndef_macro);
+        pch_put_int(fp, e->once);
+        pch_put_str(fp, e->filename);
+    }
+
+    /* #pragma comment(lib, ...) */
+    pch_put_int(fp, s1->nb_pragma_libs);
+    for (i = 0; i < s1->nb_pragma_libs; i++)
+        pch_put_str(fp, s1->pragma_libs[i]);
+
+    pch_put_int(fp, pp_counter);
+    pch_put_int(fp, str.len);
+    pch_put(fp, str.str, str.len * sizeof(int));
+    tok_str_free_str(str.str);
+    return 0;
+}
+
+/* load the precompiled header and return its token stream. 'sig' has
+   the predefined macros and -D options of the current compilation.
+   Also return in 'incl' the length of the -include options that were
+   precompiled already.  Return NULL if it was created with other
+   options from headers that are given with -include anyway. */
+static TokenString *pch_load(TCCState *s1, CString *sig, int *incl)
+{
+    int fd, size, n, i, v, t, *p, *d;
+    Sym *first, **ps;
+    CachedInclude *e;
+    TokenString *str;
+    char *name, *s;
+
+    fd = open(s1->pch_file, O_RDONLY | O_BINARY);
+    if (fd < 0)
+        tcc_error("could not open '%s'", s1->pch_file);
+    size = lseek(fd, 0, SEEK_END);
+    /* the data is used in place, the token stream too */
+    pch_buf = map_data(fd, 0, size);
+    close(fd);
+    if (!pch_buf)
+        tcc_error("could not read '%s'", s1->pch_file);
+    pch_size = size;
+    pch_end = pch_buf + size / sizeof(int);
+
+    p = pch_buf;
+    if (strcmp(pch_get_str(&p), PCH_MAGIC))
+        pch_get(&p, -1);
+    cstr_ccat(sig, '\0');
+    s = pch_get_str(&p);
+    name = pch_get_str(&p);
+    n = strlen(name);
+    if (n > s1->cmdline_incl.size || memcmp(name, s1->cmdline_incl.data, n))
+        n = 0;
+    if (strcmp(s, sig->data)) {
+        if (!n)
+            tcc_error("'%s' was created with different options", s1->pch_file);
+        /* compile the headers instead */
+        sig->size--;
+        pch_free();
+        return NULL;
+    }
+    *incl = n;
+
+    n = pch_get_int(&p);
+    for (i = TOK_IDENT; i < TOK_IDENT + n; i++) {
+        name = pch_get_str(&p);
+        if (tok_alloc(name, strlen(name))->tok != i)
+            pch_get(&p, -1);
+    }
+
+    n = pch_get_int(&p);
+    while (n-- > 0) {
+        v = pch_get_int(&p);
+        t = pch_get_int(&p);
+        if (v < TOK_IDENT || v >= tok_ident)
+            pch_get(&p, -1);
+        first = NULL, ps = &first;
+        for (i = pch_get_int(&p); i > 0; i--) {
+            d = pch_get(&p, 2);
+            *ps = sym_push2(&define_stack, d[0], d[1], 0);
+            ps = &(*ps)->next;
+        }
+        i = pch_get_int(&p);
+        d = pch_get(&p, i);
+        if (i == 0 || d[i - 1] != 0)
+            pch_get(&p, -1);
+        define_push(v, t, memcpy(tal_realloc(tokstr_alloc, NULL, i * sizeof(int)),
+                                 d, i * sizeof(int)), first);
+    }
+
+    n = pch_get_int(&p);
+    while (n-- > 0) {
+        d = pch_get(&p, 2);
+        e = search_cached_include(s1, pch_get_str(&p), 1);
+        e->ifndef_macro = d[0];
+        e->once = d[1];
+    }
+
+    n = pch_get_int(&p);
+    while (n-- > 0)
+        dynarray_add(&s1->pragma_libs, &s1->nb_pragma_libs,
+                     tcc_strdup(pch_get_str(&p)));
+
+    pp_counter = pch_get_int(&p);
+    n = pch_get_int(&p);
+    d = pch_get(&p, n);
+    if (n == 0 || d[n - 1] != 0)
+        pch_get(&p, -1);
+    str = tok_str_alloc();
+    str->str = d;
+    str->len = n;
+    return str;
 }
 
 ST_FUNC void preprocess_start(TCCState *s1, int filetype)
@@ -3648,17 +4089,28 @@ ST_FUNC void preprocess_start(TCCState *s1, int filetype)
 
     if (!(filetype & AFF_TYPE_ASM)) {
         CString cstr;
+        TokenString *pch = NULL;
+        int incl = 0;
         cstr_new(&cstr);
         tcc_predefs(s1, &cstr, is_asm);
         if (s1->cmdline_defs.size)
           cstr_cat(&cstr, s1->cmdline_defs.data, s1->cmdline_defs.size);
-        if (s1->cmdline_incl.size)
-          cstr_cat(&cstr, s1->cmdline_incl.data, s1->cmdline_incl.size);
+        if (s1->pch_file && !is_asm && s1->output_type != TCC_OUTPUT_PREPROCESS)
+          /* predefs and -D options are part of the precompiled header */
+          if ((pch = pch_load(s1, &cstr, &incl)))
+            cstr.size = 0;
+        if (s1->output_type == TCC_OUTPUT_MEMORY)
+          putdef(&cstr, "__TCC_RUN__");
+        cstr_printf(&cstr, "#define __BASE_FILE__ \"%s\"\n", file->filename);
+        if (s1->cmdline_incl.size > incl)
+          cstr_cat(&cstr, s1->cmdline_incl.data + incl, s1->cmdline_incl.size - incl);
         //printf("%.*s\n", cstr.size, (char*)cstr.data);
         *s1->include_stack_ptr++ = file;
         tcc_open_bf(s1, "<command line>", cstr.size);
         memcpy(file->buffer, cstr.data, cstr.size);
         cstr_free(&cstr);
+        if (pch)
+          begin_macro(pch, 2);
     }
     parse_flags = is_asm ? PARSE_FLAG_ASM_FILE : 0;
 }
@@ -3671,6 +4123,7 @@ ST_FUNC void preprocess_end(TCCState *s1)
     macro_ptr = NULL;
     while (file)
         tcc_close();
+    pch_free();
     tccpp_delete(s1);
 }
 
@@ -3701,7 +4154,8 @@ ST_FUNC void tccpp_new(TCCState *s)
     tal_new(&toksym_alloc, TOKSYM_TAL_LIMIT, TOKSYM_TAL_SIZE);
     tal_new(&tokstr_alloc, TOKSTR_TAL_LIMIT, TOKSTR_TAL_SIZE);
 
-    memset(hash_ident, 0, TOK_HASH_SIZE * sizeof(TokenSym *));
+    hash_ident = tcc_mallocz(TOK_HASH_MIN * sizeof(TokHash));
+    hash_ident_mask = TOK_HASH_MIN - 1;
     memset(s->cached_includes_hash, 0, sizeof s->cached_includes_hash);
 
     cstr_new(&tokcstr);
@@ -3747,6 +4201,8 @@ ST_FUNC void tccpp_delete(TCCState *s)
         tal_free(toksym_alloc, table_ident[i]);
     tcc_free(table_ident);
     table_ident = NULL;
+    tcc_free(hash_ident);
+    hash_ident = NULL;
 
     /* free static buffers */
     cstr_free(&tokcstr);
@@ -3904,6 +4360,9 @@ ST_FUNC int tcc_preprocess(TCCState *s1)
     if (s1->Pflag == LINE_MACRO_OUTPUT_FORMAT_P10)
         parse_flags |= PARSE_FLAG_TOK_NUM, s1->Pflag = 1;
 
+    if (s1->emit_pch)
+        return pch_write(s1);
+
     if (s1->do_bench) {
 	/* for PP benchmarks */
 	do next(); while (tok != TOK_EOF);
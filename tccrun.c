@@ -80,7 +80,10 @@ static void rt_exit(rt_frame *f, int code);
 #endif
 
 static int protect_pages(void *ptr, unsigned long length, int mode);
+static void rt_clear_cache(void *ptr, unsigned long length);
 static int tcc_relocate_ex(TCCState *s1, void *ptr, unsigned ptr_diff);
+static void rt_free_mem(void *ptr, unsigned size, int arena);
+static void rt_drop_new(TCCState *s1);
 static void st_link(TCCState *s1);
 static void st_unlink(TCCState *s1);
 #ifdef CONFIG_TCC_BACKTRACE
@@ -104,6 +107,9 @@ static void win64_del_function_table(void *);
 
 #define PAGEALIGN(n) ((addr_t)n + (-(addr_t)n & (PAGESIZE-1)))
 
+/* memory from an earlier tcc_relocate() of the same state */
+typedef struct rt_block { void *ptr; unsigned size; unsigned char arena; } rt_block;
+
 #if !_WIN32 && !__APPLE__
 //#define HAVE_SELINUX 1
 #endif
@@ -137,36 +143,291 @@ static int rt_mem(TCCState *s1, int size)
     return ptr_diff;
 }
 
+#ifndef CONFIG_TCC_RUN_ARENA
+# if defined __linux__ && !defined HAVE_SELINUX
+#  define CONFIG_TCC_RUN_ARENA 1
+# else
+#  define CONFIG_TCC_RUN_ARENA 0
+# endif
+#endif
+
+#if CONFIG_TCC_RUN_ARENA
+/* All states put their code and data into one arena: a memfd mapped
+   twice, executable and writable, then a private mapping for the data
+   at twice that distance, so no page protection changes ever.  Blocks
+   come from 64k slabs by size (64 bytes to 64k, powers of 2), or are
+   page runs when larger. */
+# include <sys/syscall.h>
+# include <pthread.h>
+
+#define RT_ARENA (PTR_SIZE == 8 ? 0x10000000 : 0x2000000)
+#define RT_SLAB 0x10000
+#define RT_CLASSES 11 /* 64 << 10 == RT_SLAB */
+#define RT_W(p) ((void*)((char*)(p) + RT_ARENA)) /* writable view */
+
+typedef struct rt_run { struct rt_run *next; unsigned size; } rt_run;
+
+static struct {
+    char *rx;
+    unsigned top; /* end of the slabs and runs so far */
+    void *free[RT_CLASSES]; /* linked through their first word */
+    rt_run *runs;
+    int pid;
+    unsigned forked; /* 'top' when the last child was forked */
+} rt_arena;
+TCC_SEM(static rt_arena_sem);
+static int rt_arena_atfork;
+
+/* the code pages are shared with the children, which may still run the
+   states they inherited: never reuse the memory below 'top' of then */
+static void rt_arena_fork_parent(void)
+{
+    rt_arena.forked = rt_arena.top;
+}
+
+static void rt_arena_init(void)
+{
+    size_t n = 3 * (size_t)RT_ARENA + RT_SLAB;
+    char *p = MAP_FAILED, *q;
+    int fd = -1;
+
+    /* after fork(), a child starts its own (the old one is shared) */
+    memset(&rt_arena, 0, sizeof rt_arena);
+    rt_arena.pid = getpid();
+    if (!rt_arena_atfork++)
+        pthread_atfork(NULL, rt_arena_fork_parent, NULL);
+#ifdef SYS_memfd_create
+    fd = syscall(SYS_memfd_create, "tccrun", 1 /* MFD_CLOEXEC */);
+#endif
+    if (fd < 0) {
+        char tmpfname[] = "/tmp/.tccrunXXXXXX";
+        fd = mkstemp(tmpfname);
+        if (fd < 0)
+            return;
+        unlink(tmpfname);
+    }
+    if (ftruncate(fd, RT_ARENA) == 0)
+        p = mmap(NULL, n, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    q = p + (-(addr_t)p & (RT_SLAB - 1)); /* blocks are aligned on their size */
+    if (p == MAP_FAILED
+        || mmap(q, RT_ARENA, PROT_READ | PROT_EXEC,
+                MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+        || mmap(q + RT_ARENA, RT_ARENA, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+        || mmap(q + 2 * RT_ARENA, RT_ARENA, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+        if (p != MAP_FAILED)
+            munmap(p, n);
+    } else {
+        rt_arena.rx = q;
+    }
+    close(fd);
+}
+
+/* return a block of at least '*psize' bytes aligned on 'align' and
+   set '*psize' to its real size, NULL if it does not fit */
+static void *rt_arena_alloc(unsigned *psize, unsigned align)
+{
+    unsigned size = *psize, n, c, i;
+    rt_run *r, **pr;
+    char *p = NULL;
+
+    WAIT_SEM(&rt_arena_sem);
+    if (rt_arena.pid != getpid())
+        rt_arena_init();
+    if (!rt_arena.rx)
+        goto done;
+    if (size < align)
+        size = align;
+    if (size <= RT_SLAB) {
+        for (c = 0; (64u << c) < size; ++c)
+            ;
+        size = 64u << c;
+        if (!rt_arena.free[c]) {
+            n = (rt_arena.top + RT_SLAB - 1) & -RT_SLAB;
+            if (n > RT_ARENA - RT_SLAB)
+                goto done;
+            rt_arena.top = n + RT_SLAB;
+            for (i = RT_SLAB; i; ) {
+                i -= size;
+                p = rt_arena.rx + n + i;
+                *(void**)RT_W(p) = rt_arena.free[c];
+                rt_arena.free[c] = p;
+            }
+        }
+        p = rt_arena.free[c];
+        rt_arena.free[c] = *(void**)RT_W(p);
+    } else if (align <= PAGESIZE) {
+        size = PAGEALIGN(size);
+        for (pr = &rt_arena.runs; (r = *pr); pr = &((rt_run*)RT_W(r))->next) {
+            rt_run *w = RT_W(r);
+            if (w->size >= size) {
+                p = (char*)r;
+                if (w->size - size >= PAGESIZE) {
+                    /* keep the rest */
+                    rt_run *w2 = RT_W(p + size);
+                    w2->next = w->next;
+                    w2->size = w->size - size;
+                    *pr = (rt_run*)(p + size);
+                } else {
+                    size = w->size;
+                    *pr = w->next;
+                }
+                goto done;
+            }
+        }
+        n = PAGEALIGN(rt_arena.top);
+        if (n > RT_ARENA - size)
+            goto done;
+        rt_arena.top = n + size;
+        p = rt_arena.rx + n;
+    }
+done:
+    POST_SEM(&rt_arena_sem);
+    *psize = size;
+    return p;
+}
+
+static void rt_arena_free(void *p, unsigned size)
+{
+    unsigned c;
+    WAIT_SEM(&rt_arena_sem);
+    if (rt_arena.pid == getpid() && rt_arena.rx
+        && (char*)p >= rt_arena.rx + rt_arena.forked
+        && (char*)p < rt_arena.rx + RT_ARENA) {
+        if (size <= RT_SLAB) {
+            for (c = 0; (64u << c) < size; ++c)
+                ;
+            *(void**)RT_W(p) = rt_arena.free[c];
+            rt_arena.free[c] = p;
+        } else {
+            rt_run *w = RT_W(p);
+            w->next = rt_arena.runs;
+            w->size = size;
+            rt_arena.runs = p;
+        }
+    }
+    POST_SEM(&rt_arena_sem);
+}
+
+/* get memory from the arena, returns 0 if the state does not fit */
+static int rt_arena_mem(TCCState *s1, int size)
+{
+    unsigned align = 64, n = size;
+    void *ptr;
+    int i;
+
+    for (i = 1; i < s1->nb_sections; i++)
+        if ((s1->sections[i]->sh_flags & SHF_ALLOC)
+            && s1->sections[i]->sh_addralign > align)
+            align = s1->sections[i]->sh_addralign;
+    if (n > RT_ARENA / 4 || !(ptr = rt_arena_alloc(&n, align)))
+        return 0;
+    s1->run_ptr = ptr;
+    s1->run_size = n;
+    return RT_ARENA;
+}
+#endif /* CONFIG_TCC_RUN_ARENA */
+
 /* ------------------------------------------------------------- */
 /* Do all relocations (needed before using tcc_get_symbol())
    Returns -1 on error. */
 
-LIBTCCAPI int tcc_relocate(TCCState *s1)
+static int tcc_relocate_mem(TCCState *s1)
 {
-    int size, ret, ptr_diff;
-
-    if (s1->run_ptr)
-        exit(tcc_error_noabort("'tcc_relocate()' twice is no longer supported"));
+    int size, ret, ptr_diff, arena = s1->run_arena;
+
+    if (s1->run_ptr) {
+        /* more code was compiled into a relocated state: it goes into
+           memory of its own and links against the symbols from before */
+        if (!s1->run_delta)
+            return tcc_error_noabort("cannot add code to this relocated state");
+        s1->nb_errors = 0; /* files with errors were dropped */
+        if (!s1->nostdlib && TCC_LIBTCC1[0])
+            tcc_add_support(s1, TCC_LIBTCC1);
+        resolve_common_syms(s1);
+        build_got_entries(s1, 0);
+    } else {
 #ifdef CONFIG_TCC_BACKTRACE
-    if (s1->do_backtrace)
-        tcc_add_symbol(s1, "_tcc_backtrace", _tcc_backtrace); /* for bt-log.c */
+        if (s1->do_backtrace)
+            tcc_add_symbol(s1, "_tcc_backtrace", _tcc_backtrace); /* for bt-log.c */
 #endif
+#ifdef TCC_TARGET_PE
+        pe_output_file(s1, NULL);
+#else
+        tcc_add_runtime(s1);
+        resolve_common_syms(s1);
+        build_got_entries(s1, 0);
+#endif
+    }
+    s1->run_arena = CONFIG_TCC_RUN_ARENA;
     size = tcc_relocate_ex(s1, NULL, 0);
-    if (size < 0)
+    if (size < 0) {
+        s1->run_arena = arena;
+        if (s1->run_delta)
+            rt_drop_new(s1);
         return -1;
+    }
+    if (s1->run_ptr) {
+        rt_block *b = tcc_malloc(sizeof *b);
+        b->ptr = s1->run_ptr, b->size = s1->run_size, b->arena = arena;
+        dynarray_add(&s1->run_blocks, &s1->nb_run_blocks, b);
+        s1->run_ptr = NULL;
+    }
+#if CONFIG_TCC_RUN_ARENA
+    ptr_diff = rt_arena_mem(s1, size);
+    if (0 == ptr_diff) {
+        /* lay it out again for memory of its own */
+        s1->run_arena = 0;
+        size = tcc_relocate_ex(s1, NULL, 0);
+    }
+    if (0 == s1->run_arena)
+#endif
     ptr_diff = rt_mem(s1, size);
     if (ptr_diff < 0)
         return -1;
     ret = tcc_relocate_ex(s1, s1->run_ptr, ptr_diff);
-    if (ret == 0)
-        st_link(s1);
+    if (ret == 0) {
+        if (0 == s1->nb_run_blocks)
+            st_link(s1);
+    } else if (s1->run_delta) {
+        /* back to the memory from before, without the new code */
+        rt_block *b = s1->run_blocks[--s1->nb_run_blocks];
+        rt_free_mem(s1->run_ptr, s1->run_size, s1->run_arena);
+        s1->run_ptr = b->ptr, s1->run_size = b->size, s1->run_arena = b->arena;
+        tcc_free(b);
+        rt_drop_new(s1);
+    }
+    return ret;
+}
+
+LIBTCCAPI int tcc_relocate(TCCState *s1)
+{
+    int ret, ph = PROF_SWITCH(s1, TP_LINK);
+    ret = tcc_relocate_mem(s1);
+    PROF_SWITCH(s1, ph);
     return ret;
 }
 
+static void rt_free_mem(void *ptr, unsigned size, int arena)
+{
+#if CONFIG_TCC_RUN_ARENA
+    if (arena) {
+        rt_arena_free(ptr, size);
+        return;
+    }
+#endif
+#ifdef HAVE_SELINUX
+    munmap(ptr, size);
+#else
+    /* unprotect memory to make it usable for malloc again */
+    protect_pages((void*)PAGEALIGN(ptr), size - PAGESIZE, 2 /*rw*/);
+    tcc_free(ptr);
+#endif
+}
+
 ST_FUNC void tcc_run_free(TCCState *s1)
 {
-    unsigned size;
-    void *ptr;
     int i;
 
     /* free any loaded DLLs */
@@ -180,21 +441,18 @@ ST_FUNC void tcc_run_free(TCCState *s1)
 #endif
     }
     /* unmap or unprotect and free memory */
-    ptr = s1->run_ptr;
-    if (NULL == ptr)
+    if (NULL == s1->run_ptr)
         return;
     st_unlink(s1);
-    size = s1->run_size;
-#ifdef HAVE_SELINUX
-    munmap(ptr, size);
-#else
-    /* unprotect memory to make it usable for malloc again */
-    protect_pages((void*)PAGEALIGN(ptr), size - PAGESIZE, 2 /*rw*/);
-# ifdef _WIN64
+#ifdef _WIN64
     win64_del_function_table(s1->run_function_table);
-# endif
-    tcc_free(ptr);
 #endif
+    rt_free_mem(s1->run_ptr, s1->run_size, s1->run_arena);
+    for (i = 0; i < s1->nb_run_blocks; i++) {
+        rt_block *b = s1->run_blocks[i];
+        rt_free_mem(b->ptr, b->size, b->arena);
+    }
+    dynarray_reset(&s1->run_blocks, &s1->nb_run_blocks);
 }
 
 /* launch the compiled program with the given arguments */
@@ -234,6 +492,8 @@ LIBTCCAPI int tcc_run(TCCState *s1, int argc, char **argv)
     errno = 0; /* clean errno value */
     fflush(stdout);
     fflush(stderr);
+    /* the program's own time is not compile time */
+    PROF_SWITCH(s1, TP_NONE);
 
     ret = tcc_setjmp(s1, main_jb, tcc_get_symbol(s1, top_sym));
     if (0 == ret)
@@ -247,40 +507,100 @@ LIBTCCAPI int tcc_run(TCCState *s1, int argc, char **argv)
 }
 
 /* ------------------------------------------------------------- */
-/* remove all STB_LOCAL symbols */
+/* remove all STB_LOCAL symbols, make the others absolute */
 static void cleanup_symbols(TCCState *s1)
 {
     Section *s = s1->symtab;
-    int sym_index, end_sym = s->data_offset / sizeof (ElfSym);
-    /* reset symtab */
-    s->data_offset = s->link->data_offset = s->hash->data_offset = 0;
-    init_symtab(s);
+    int sym_index, end_sym = s->data_offset / sizeof (ElfSym), first = 1;
+    ElfW(Sym) *sym;
+
+    if (s1->run_syms) {
+        /* symbols from before are global already */
+        first = s1->run_syms;
+        for (sym_index = 1; sym_index < first; ++sym_index) {
+            sym = &((ElfW(Sym) *)s->data)[sym_index];
+            if (sym->st_shndx != SHN_UNDEF && sym->st_shndx < SHN_LORESERVE)
+                sym->st_shndx = SHN_ABS; /* was undefined or weak */
+        }
+        drop_elf_syms(s, first);
+        s->link->data_offset = s1->run_strs;
+    } else {
+        /* reset symtab */
+        s->data_offset = s->link->data_offset = s->hash->data_offset = 0;
+        s->hash->nb_hashed_syms = 0;
+        init_symtab(s);
+    }
     /* add global symbols again */
-    for (sym_index = 1; sym_index < end_sym; ++sym_index) {
-        ElfW(Sym) *sym = &((ElfW(Sym) *)s->data)[sym_index];
-        const char *name = (char *)s->link->data + sym->st_name;
+    for (sym_index = first; sym_index < end_sym; ++sym_index) {
+        const char *name;
+        int shndx;
+        sym = &((ElfW(Sym) *)s->data)[sym_index];
+        name = (char *)s->link->data + sym->st_name;
+        shndx = sym->st_shndx;
         if (ELFW(ST_BIND)(sym->st_info) == STB_LOCAL)
             continue;
+        if (shndx != SHN_UNDEF && shndx < SHN_LORESERVE) {
+            /* got/plt are made again for the next code */
+            if ((s1->got && shndx == s1->got->sh_num)
+                || (s1->plt && shndx == s1->plt->sh_num))
+                continue;
+            shndx = SHN_ABS;
+        }
         //printf("sym %s\n", name);
-        put_elf_sym(s, sym->st_value, sym->st_size, sym->st_info, sym->st_other, sym->st_shndx, name);
+        put_elf_sym(s, sym->st_value, sym->st_size, sym->st_info, sym->st_other, shndx, name);
     }
+    s1->run_syms = s->data_offset / sizeof (ElfSym);
+    s1->run_strs = s->link->data_offset;
 }
 
-/* free all sections except symbols */
+/* free all sections except symbols.  With 'run_delta' keep the
+   standard ones (empty) to compile more code into. */
 static void cleanup_sections(TCCState *s1)
 {
     struct { Section **secs; int nb_secs; } *p = (void*)&s1->sections;
-    int i, f = 2;
+    int i, n, f = 2;
     do {
-        for (i = --f; i < p->nb_secs; i++) {
+        for (i = n = --f; i < p->nb_secs; i++) {
             Section *s = p->secs[i];
             if (s == s1->symtab || s == s1->symtab->link || s == s1->symtab->hash) {
                 s->data = tcc_realloc(s->data, s->data_allocated = s->data_offset);
+            } else if (s1->run_delta && (f == 0 || s == text_section
+                    || s == data_section || s == rodata_section || s == bss_section)) {
+                /* private sections (common, dynsymtab) are kept as is */
+                if (f)
+                    free_section(s), s->reloc = NULL;
             } else {
-                free_section(s), tcc_free(s), p->secs[i] = NULL;
+                free_section(s), tcc_free(s);
+                continue;
             }
+            if (f)
+                s->sh_num = n, s->sh_offset = s->data_offset;
+            p->secs[n++] = s;
         }
+        p->nb_secs = n;
     } while (++p, f);
+    /* with symbol indices changed, also the got offsets are gone */
+    s1->got = s1->plt = NULL;
+    tcc_free(s1->sym_attrs);
+    s1->sym_attrs = NULL, s1->nb_sym_attrs = 0;
+    get_sym_attr(s1, 0, 1);
+}
+
+/* drop code that failed to link to a relocated state */
+static void rt_drop_new(TCCState *s1)
+{
+    Section *s = s1->symtab;
+    ElfW(Sym) *sym;
+    int sym_index;
+
+    for (sym_index = 1; sym_index < s1->run_syms; ++sym_index) {
+        sym = &((ElfW(Sym) *)s->data)[sym_index];
+        if (sym->st_shndx != SHN_UNDEF && sym->st_shndx < SHN_LORESERVE)
+            sym->st_shndx = SHN_UNDEF, sym->st_value = 0;
+    }
+    drop_elf_syms(s, s1->run_syms);
+    s->link->data_offset = s1->run_strs;
+    cleanup_sections(s1);
 }
 
 /* ------------------------------------------------------------- */
@@ -308,16 +628,7 @@ static int tcc_relocate_ex(TCCState *s1, void *ptr, unsigned ptr_diff)
     unsigned offset, length, align, i, k, f;
     unsigned n, copy;
     addr_t mem, addr;
-
-    if (NULL == ptr) {
-#ifdef TCC_TARGET_PE
-        pe_output_file(s1, NULL);
-#else
-        tcc_add_runtime(s1);
-	resolve_common_syms(s1);
-        build_got_entries(s1, 0);
-#endif
-    }
+    int ph;
 
     offset = copy = 0;
     mem = (addr_t)ptr;
@@ -369,11 +680,13 @@ redo:
                     align = 64;
 #endif
                 /* start new page for different permissions */
-                if (k <= CONFIG_RUNMEM_RO)
+                if (k <= CONFIG_RUNMEM_RO && !s1->run_arena)
                     align = PAGESIZE;
             }
             s->sh_addralign = align;
             addr = k ? mem + ptr_diff : mem;
+            if (k && s1->run_arena)
+                addr += ptr_diff; /* to the private data view */
             offset += -(addr + offset) & (align - 1);
             s->sh_addr = mem ? addr + offset : 0;
             offset += length;
@@ -381,6 +694,11 @@ redo:
         if (copy == 2) { /* set permissions */
             if (n == 0) /* no data  */
                 continue;
+            if (s1->run_arena) {
+                if (k == 0)
+                    rt_clear_cache((void*)addr, n);
+                continue;
+            }
 #ifdef HAVE_SELINUX
             if (k == 0) /* SHF_EXECINSTR has its own mapping */
                 continue;
@@ -403,7 +721,7 @@ redo:
     }
 
     if (0 == mem)
-        return PAGEALIGN(offset);
+        return s1->run_arena ? (offset + 63) & -64 : PAGEALIGN(offset);
 
     if (++copy == 2) {
         goto redo;
@@ -413,11 +731,15 @@ redo:
         s1->run_function_table = win64_add_function_table(s1);
 #endif
         /* remove local symbols and free sections except symtab */
+#ifndef TCC_TARGET_PE
+        s1->run_delta = !s1->do_debug && !s1->test_coverage; /* -b, -bt: -g */
+#endif
         cleanup_symbols(s1);
         cleanup_sections(s1);
         goto redo;
     }
 
+    ph = PROF_SWITCH(s1, TP_RELOC);
     /* relocate symbols */
     relocate_syms(s1, s1->symtab, !(s1->nostdlib));
     /* relocate sections */
@@ -427,12 +749,23 @@ redo:
     relocate_plt(s1);
 #endif
     relocate_sections(s1);
+    PROF_SWITCH(s1, ph);
     goto redo;
 }
 
 /* ------------------------------------------------------------- */
 /* allow to run code in memory */
 
+/* make new code visible to the instruction cache */
+static void rt_clear_cache(void *ptr, unsigned long length)
+{
+/* XXX: BSD sometimes dump core with bad system call */
+#if !defined _WIN32 && ((defined TCC_TARGET_ARM && !TARGETOS_BSD) || defined TCC_TARGET_ARM64)
+    void __clear_cache(void *beginning, void *end);
+    __clear_cache(ptr, (char *)ptr + length);
+#endif
+}
+
 static int protect_pages(void *ptr, unsigned long length, int mode)
 {
 #ifdef _WIN32
@@ -454,13 +787,8 @@ static int protect_pages(void *ptr, unsigned long length, int mode)
         };
     if (mprotect(ptr, length, protect[mode]))
         return -1;
-/* XXX: BSD sometimes dump core with bad system call */
-# if (defined TCC_TARGET_ARM && !TARGETOS_BSD) || defined TCC_TARGET_ARM64
-    if (mode == 0 || mode == 3) {
-        void __clear_cache(void *beginning, void *end);
-        __clear_cache(ptr, (char *)ptr + length);
-    }
-# endif
+    if (mode == 0 || mode == 3)
+        rt_clear_cache(ptr, length);
 #endif
     return 0;
 }
@@ -580,9 +908,15 @@ static TCCState *rt_find_state(rt_frame *f)
         if (rt_get_caller_pc(&pc, f, level) < 0)
             break;
         for (s = g_s1; s; s = s->next) {
+            int i;
             if (pc >= (addr_t)s->run_ptr
              && pc  < (addr_t)s->run_ptr + s->run_size)
                 return s;
+            for (i = 0; i < s->nb_run_blocks; i++) {
+                rt_block *b = s->run_blocks[i];
+                if (pc >= (addr_t)b->ptr && pc < (addr_t)b->ptr + b->size)
+                    return s;
+            }
         }
     }
     return NULL;
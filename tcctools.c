@@ -474,6 +474,103 @@ the_end:
 
 #endif /* TCC_TARGET_PE */
 
+/* -------------------------------------------------------------- */
+/*
+ *  tcc -tcov: merge -ftest-coverage=binary files, write a report
+ */
+
+#define TCOV_TOOL
+#undef free
+#undef malloc
+#undef realloc
+#define free(p) tcc_free(p)
+#define malloc(s) tcc_malloc(s)
+#define realloc(p, s) tcc_realloc(p, s)
+#include "lib/tcov.c"
+#undef free
+#undef malloc
+#undef realloc
+#define free(p) use_tcc_free(p)
+#define malloc(s) use_tcc_malloc(s)
+#define realloc(p, s) use_tcc_realloc(p, s)
+
+ST_FUNC int tcc_tool_tcov(TCCState *s1, int argc, char **argv)
+{
+    const char *outfile = NULL, *a;
+    unsigned char *p = NULL, *q;
+    unsigned int runs = 0, size = 0, r, n;
+    int i, ret = 1;
+    size_t len;
+    FILE *fp;
+    tcov_file *file;
+
+    for (i = 1; i < argc; ++i) {
+        a = argv[i];
+        if (0 == strcmp(a, "-o")) {
+            if (++i == argc)
+                goto usage;
+            outfile = argv[i];
+            continue;
+        }
+        if ('-' == a[0])
+            goto usage;
+        q = NULL;
+        if ((fp = fopen(a, "rb"))) {
+            q = read_tcov_binary(fp, &r, &n);
+            fclose(fp);
+        }
+        if (q == NULL) {
+            tcc_error_noabort("'%s' is not a binary coverage file", a);
+            goto the_end;
+        }
+        if (p == NULL) {
+            p = q, size = n, runs = r;
+            continue;
+        }
+        if (n != size || merge_tcov_binary(p, q, n)) {
+            tcc_free(q);
+            tcc_error_noabort("'%s' is from a different program", a);
+            goto the_end;
+        }
+        runs += r;
+        tcc_free(q);
+    }
+
+    if (p == NULL) {
+usage:
+        fprintf(stderr,
+            "usage: tcc -tcov [-o outputfile] files.tcovb\n"
+            "merge binary coverage files, write a .tcovb file or a report\n"
+            );
+        goto the_end;
+    }
+
+    len = outfile ? strlen(outfile) : 0;
+    if (len > 6 && 0 == strcmp(outfile + len - 6, ".tcovb")) {
+        fp = fopen(outfile, "wb");
+        if (fp)
+            write_tcov_binary(fp, p, size, runs);
+    } else {
+        fp = outfile ? fopen(outfile, "w") : stdout;
+        if (fp) {
+            file = sort_test_coverage(p);
+            write_test_coverage(file, fp, (char *)p + get_value(p, 4), runs);
+            free_test_coverage(file);
+        }
+    }
+    if (fp == NULL) {
+        tcc_error_noabort("could not create '%s'", outfile);
+        goto the_end;
+    }
+    if (fp != stdout)
+        fclose(fp);
+    ret = 0;
+
+the_end:
+    tcc_free(p);
+    return ret;
+}
+
 /* -------------------------------------------------------------- */
 /*
  *  TCC - Tiny C Compiler
@@ -0,0 +1,35 @@
+/* table driven crc32: byte loads, shifts, table lookups */
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SIZE (16 << 20)
+
+static unsigned table[256];
+
+static unsigned crc32(unsigned crc, const unsigned char *p, size_t n)
+{
+    crc = ~crc;
+    while (n--)
+        crc = table[(crc ^ *p++) & 255] ^ (crc >> 8);
+    return ~crc;
+}
+
+int main(void)
+{
+    unsigned char *buf = malloc(SIZE);
+    unsigned c, crc = 0;
+    int i, k;
+
+    for (i = 0; i < 256; i++) {
+        for (c = i, k = 0; k < 8; k++)
+            c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        table[i] = c;
+    }
+    for (i = 0; i < SIZE; i++)
+        buf[i] = i * 7 + (i >> 9);
+    for (i = 0; i < 8; i++)
+        crc = crc32(crc, buf, SIZE);
+    printf("%08x\n", crc);
+    free(buf);
+    return 0;
+}
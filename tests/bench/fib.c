@@ -0,0 +1,13 @@
+/* naive recursion: call and return overhead */
+#include <stdio.h>
+
+static int fib(int n)
+{
+    return n < 2 ? n : fib(n - 1) + fib(n - 2);
+}
+
+int main(void)
+{
+    printf("%d\n", fib(37));
+    return 0;
+}
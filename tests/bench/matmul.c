@@ -0,0 +1,42 @@
+/* dense matrix multiplication: double arithmetic, 2d indexing */
+#include <stdio.h>
+#include <stdlib.h>
+
+#define N 300
+
+static void matmul(double *c, const double *a, const double *b, int n)
+{
+    int i, j, k;
+    for (i = 0; i < n; i++)
+        for (j = 0; j < n; j++) {
+            double s = 0;
+            for (k = 0; k < n; k++)
+                s += a[i * n + k] * b[k * n + j];
+            c[i * n + j] = s;
+        }
+}
+
+int main(void)
+{
+    double *a = malloc(N * N * sizeof *a);
+    double *b = malloc(N * N * sizeof *b);
+    double *c = malloc(N * N * sizeof *c);
+    double sum = 0;
+    int i, r;
+
+    for (i = 0; i < N * N; i++) {
+        a[i] = (i % 17) * 0.25;
+        b[i] = (i % 13) * 0.5 - 1;
+    }
+    for (r = 0; r < 2; r++) {
+        matmul(c, a, b, N);
+        matmul(a, c, b, N);
+        for (i = 0; i < N * N; i++)
+            a[i] *= 1e-3;
+    }
+    for (i = 0; i < N * N; i++)
+        sum += c[i];
+    printf("%.6e\n", sum);
+    free(a), free(b), free(c);
+    return 0;
+}
@@ -0,0 +1,27 @@
+/* sieve of Eratosthenes: byte stores, simple loops */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N 10000000
+
+int main(void)
+{
+    char *flags = malloc(N + 1);
+    int i, k, r, count = 0;
+
+    for (r = 0; r < 3; r++) {
+        memset(flags, 1, N + 1);
+        count = 0;
+        for (i = 2; i <= N; i++) {
+            if (flags[i]) {
+                for (k = i + i; k <= N; k += i)
+                    flags[k] = 0;
+                count++;
+            }
+        }
+    }
+    printf("%d primes\n", count);
+    free(flags);
+    return 0;
+}
@@ -0,0 +1,73 @@
+/* quicksort and binary search: integer compares, recursion */
+#include <stdio.h>
+#include <stdlib.h>
+
+#define N 1000000
+
+static unsigned seed = 12345;
+
+static unsigned rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 1;
+}
+
+static void quicksort(int *a, int lo, int hi)
+{
+    while (lo < hi) {
+        int p = a[(lo + hi) / 2], i = lo, j = hi, t;
+        while (i <= j) {
+            while (a[i] < p)
+                i++;
+            while (a[j] > p)
+                j--;
+            if (i <= j) {
+                t = a[i], a[i] = a[j], a[j] = t;
+                i++, j--;
+            }
+        }
+        if (j - lo < hi - i) {
+            quicksort(a, lo, j);
+            lo = i;
+        } else {
+            quicksort(a, i, hi);
+            hi = j;
+        }
+    }
+}
+
+static int find(const int *a, int n, int v)
+{
+    int lo = 0, hi = n - 1;
+    while (lo <= hi) {
+        int m = (lo + hi) / 2;
+        if (a[m] == v)
+            return m;
+        if (a[m] < v)
+            lo = m + 1;
+        else
+            hi = m - 1;
+    }
+    return -1;
+}
+
+int main(void)
+{
+    int *a = malloc(N * sizeof *a);
+    int i, found = 0;
+    unsigned sum = 0;
+
+    for (i = 0; i < N; i++)
+        a[i] = rnd() % (N * 4);
+    quicksort(a, 0, N - 1);
+    for (i = 1; i < N; i++)
+        if (a[i - 1] > a[i])
+            return 1;
+    for (i = 0; i < N; i++)
+        found += find(a, N, rnd() % (N * 4)) >= 0;
+    for (i = 0; i < N; i += 1000)
+        sum += a[i];
+    printf("%u %d\n", sum, found);
+    free(a);
+    return 0;
+}
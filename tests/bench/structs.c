@@ -0,0 +1,73 @@
+/* small structs passed, returned, swapped and zero initialized */
+#include <stdio.h>
+
+typedef struct { double x, y, z; } vec;
+typedef struct { vec pos, vel; int id, hits; } body;
+typedef struct { int key; char name[28]; } rec;
+
+#define N 256
+
+static vec add(vec a, vec b)
+{
+    vec r = { a.x + b.x, a.y + b.y, a.z + b.z };
+    return r;
+}
+
+static vec scale(vec a, double s)
+{
+    vec r = { a.x * s, a.y * s, a.z * s };
+    return r;
+}
+
+static body step(body b, double dt)
+{
+    body n = b;
+    n.pos = add(b.pos, scale(b.vel, dt));
+    if (n.pos.x < 0 || n.pos.x > 100) {
+        n.vel.x = -n.vel.x;
+        n.hits++;
+    }
+    return n;
+}
+
+static void sort(rec *r, int n)
+{
+    int i, j;
+    rec t;
+    for (i = 1; i < n; i++) {
+        t = r[i];
+        for (j = i; j > 0 && r[j - 1].key > t.key; j--)
+            r[j] = r[j - 1];
+        r[j] = t;
+    }
+}
+
+int main(void)
+{
+    static body bodies[N];
+    static rec recs[N];
+    long sum = 0;
+    int i, k;
+
+    for (i = 0; i < N; i++) {
+        body b = { { i % 100, i % 7, 0 }, { (i % 5) - 2.5, 1, 0.5 }, i };
+        bodies[i] = b;
+    }
+    for (k = 0; k < 10000; k++) {
+        for (i = 0; i < N; i++)
+            bodies[i] = step(bodies[i], 0.25);
+        if (k % 20 == 0) {
+            for (i = 0; i < N; i++) {
+                rec r = { (i * 7919 + k) % 1009 };
+                r.name[0] = 'a' + i % 26;
+                recs[i] = r;
+            }
+            sort(recs, N);
+            sum += recs[0].key + recs[N - 1].key;
+        }
+    }
+    for (i = 0; i < N; i++)
+        sum += bodies[i].hits;
+    printf("%ld\n", sum);
+    return 0;
+}
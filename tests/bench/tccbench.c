@@ -0,0 +1,449 @@
+/*
+ * Compile throughput and generated code benchmark
+ *
+ *   make bench [BENCH_TCC="tcc ..."] [BENCH_FLAGS=...]
+ *              [BENCH_OUT=file.json] [BENCH_BASE=old.json]
+ *
+ * Generates a synthetic corpus and compiles each file a few times,
+ * reporting the best cpu time as lines/s and MB/s (as counted by
+ * 'tcc -bench', headers included) and the peak RSS.  Then compiles the
+ * kernels from this directory and runs them.  The results are written
+ * as JSON with one record per line and, with -c, compared against the
+ * results of an earlier run (BENCH_BASE, relative to tests/bench).
+ *
+ * usage: tccbench [-n reps] [-s srcdir] [-o out.json] [-c base.json]
+ *                 -- tcc [options]
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef _WIN32
+int main(void)
+{
+    printf("tccbench: not supported on Windows\n");
+    return 0;
+}
+#else
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define GEN "gen"
+
+typedef struct Result {
+    const char *name;
+    double time, ctime;
+    long lines, bytes, rss;
+} Result;
+
+static char **tcc_argv;
+static int tcc_argc, reps = 5;
+static const char *srcdir = ".";
+static char *base;
+
+/* ------------------------------------------------------------- */
+/* the synthetic corpus */
+
+/* huge switch statements */
+static void gen_switch(FILE *f)
+{
+    int i, k;
+    for (k = 0; k < 10; k++) {
+        fprintf(f, "int sw%d(int x, int y)\n{\n    switch (x) {\n", k);
+        for (i = 0; i < 2000; i++)
+            fprintf(f, "    case %d: return y * %d + %d;\n", i * (k + 1), i, k);
+        fprintf(f, "    default: return -1;\n    }\n}\n\n");
+    }
+}
+
+/* many small functions */
+static void gen_funcs(FILE *f)
+{
+    int i, n = 20000;
+    fprintf(f, "static int f0(int a, int b) { return a + b; }\n\n");
+    for (i = 1; i < n; i++)
+        fprintf(f, "static int f%d(int a, int b)\n{\n"
+                   "    int c = a * %d + b;\n"
+                   "    if (c > %d)\n        c -= b;\n"
+                   "    return c ^ f%d(b, a);\n}\n\n", i, i, i, i - 1);
+    fprintf(f, "int funcs(int x) { return f%d(x, 1); }\n", n - 1);
+}
+
+/* deeply nested macros, x-macros, token pasting */
+static void gen_macros(FILE *f)
+{
+    int i;
+    fprintf(f, "#define CAT_(a, b) a ## b\n#define CAT(a, b) CAT_(a, b)\n");
+    fprintf(f, "#define E0(x) (x)\n");
+    for (i = 1; i <= 10; i++)
+        fprintf(f, "#define E%d(x) E%d(x) + E%d((x) + %d)\n", i, i - 1, i - 1, i);
+    for (i = 0; i < 40; i++)
+        fprintf(f, "int CAT(m, %d)(int v) { return E10(v * %d); }\n", i, i);
+    fprintf(f, "\n#define LIST(X)");
+    for (i = 0; i < 1000; i++)
+        fprintf(f, " \\\n    X(a%d, %d)", i, i * 3);
+    fprintf(f, "\n\n#define ENUM(n, v) n = v,\n"
+               "#define CASE(n, v) case n: return #n;\n"
+               "#define SUM(n, v) + CAT(n, _w)\n"
+               "#define VAR(n, v) static int CAT(n, _w) = v;\n"
+               "enum { LIST(ENUM) };\n"
+               "LIST(VAR)\n"
+               "const char *name(int x) { switch (x) { LIST(CASE) } return 0; }\n"
+               "int sum(void) { return 0 LIST(SUM); }\n");
+}
+
+/* big initializers */
+static void gen_init(FILE *f)
+{
+    int i;
+    fprintf(f, "const int tab[] = {");
+    for (i = 0; i < 200000; i++)
+        fprintf(f, "%s%d,", i % 16 ? " " : "\n    ", (i * 2654435761u) >> 12);
+    fprintf(f, "\n};\n\nstruct rec {\n    int id;\n    double v;\n"
+               "    const char *s;\n    struct { short a, b; } p;\n"
+               "} recs[] = {\n");
+    for (i = 0; i < 20000; i++)
+        fprintf(f, "    { %d, %d.5, \"s%d\", { %d, %d } },\n",
+                i, i, i, i & 255, -i & 255);
+    fprintf(f, "};\n");
+}
+
+/* many headers including each other */
+static void gen_headers(FILE *f)
+{
+    char buf[64];
+    FILE *h;
+    int i, k;
+
+    mkdir(GEN "/hdr", 0777);
+    for (i = 0; i < 300; i++) {
+        snprintf(buf, sizeof buf, GEN "/hdr/h%03d.h", i);
+        h = fopen(buf, "w");
+        fprintf(h, "#ifndef H%03d\n#define H%03d\n", i, i);
+        if (i)
+            fprintf(h, "#include \"h%03d.h\"\n#include \"h%03d.h\"\n",
+                    i - 1, i / 2);
+        for (k = 0; k < 10; k++)
+            fprintf(h, "typedef struct s%03d_%d {\n    int a;\n    long b;\n"
+                       "    char c[%d];\n    struct s%03d_%d *next;\n"
+                       "} s%03d_%d_t;\n", i, k, k + 1, i, k, i, k);
+        fprintf(h, "enum e%03d {", i);
+        for (k = 0; k < 10; k++)
+            fprintf(h, " e%03d_%d,", i, k);
+        fprintf(h, " e%03d_n };\n", i);
+        for (k = 0; k < 20; k++)
+            fprintf(h, "#define H%03d_M%d(x) ((x) * %d + e%03d_%d)\n",
+                    i, k, k, i, k % 10);
+        for (k = 0; k < 20; k++)
+            fprintf(h, "extern int h%03d_f%d(s%03d_%d_t *p, int n);\n",
+                    i, k, i, k % 10);
+        for (k = 0; k < 5; k++)
+            fprintf(h, "static inline int h%03d_i%d(int x) "
+                       "{ return H%03d_M%d(x) + %d; }\n", i, k, i, k, k);
+        fprintf(h, "#endif\n");
+        fclose(h);
+    }
+    for (i = 0; i < 300; i++)
+        fprintf(f, "#include \"hdr/h%03d.h\"\n", i);
+    fprintf(f, "\nint use(void)\n{\n    int s = 0;\n");
+    for (i = 0; i < 300; i += 7)
+        fprintf(f, "    s += h%03d_i%d(s);\n", i, i % 5);
+    fprintf(f, "    return s;\n}\n");
+}
+
+/* the standard headers */
+static void gen_libc(FILE *f)
+{
+    static const char *const hdrs[] = {
+        "assert", "ctype", "errno", "float", "limits", "locale", "math",
+        "setjmp", "signal", "stdarg", "stddef", "stdint", "stdio",
+        "stdlib", "string", "time", "wchar", "wctype", "inttypes",
+    };
+    int i;
+    for (i = 0; i < sizeof hdrs / sizeof *hdrs; i++)
+        fprintf(f, "#include <%s.h>\n", hdrs[i]);
+    fprintf(f, "\nint main(int argc, char **argv)\n{\n"
+               "    printf(\"%%s %%d\\n\", argv[0], (int)strlen(argv[0]));\n"
+               "    return isdigit(argc) ? EXIT_FAILURE : EXIT_SUCCESS;\n}\n");
+}
+
+static const struct {
+    const char *name;
+    void (*gen)(FILE *f);
+} corpus[] = {
+    { "switch", gen_switch },
+    { "funcs", gen_funcs },
+    { "macros", gen_macros },
+    { "init", gen_init },
+    { "headers", gen_headers },
+    { "libc", gen_libc },
+};
+
+/* runtime kernels, in 'srcdir' */
+static const char *const kernels[] = {
+    "sieve", "matmul", "sort", "fib", "nbody", "crc", "vm", "structs",
+};
+
+/* ------------------------------------------------------------- */
+
+/* run argv with stdout and stderr to 'out', return the cpu time and
+   the peak RSS (KB) of the process */
+static int run(char **argv, const char *out, double *cpu, long *rss)
+{
+    struct rusage ru;
+    int status, fd;
+    pid_t pid;
+
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0) {
+        fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd >= 0)
+            dup2(fd, 1), dup2(fd, 2);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    if (pid < 0 || wait4(pid, &status, 0, &ru) < 0)
+        return -1;
+    *cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6
+         + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+#ifdef __APPLE__
+    *rss = ru.ru_maxrss >> 10; /* bytes */
+#else
+    *rss = ru.ru_maxrss;
+#endif
+    if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+        fprintf(stderr, "tccbench: '%s' failed, see %s\n", argv[0], out);
+        return -1;
+    }
+    return 0;
+}
+
+/* run tcc with the extra arguments, terminated by NULL */
+static int run_tcc(const char *out, double *cpu, long *rss, ...)
+{
+    char *argv[64];
+    const char *a;
+    va_list ap;
+    int n;
+
+    memcpy(argv, tcc_argv, tcc_argc * sizeof *argv);
+    n = tcc_argc;
+    va_start(ap, rss);
+    while ((a = va_arg(ap, const char *)))
+        argv[n++] = (char *)a;
+    va_end(ap);
+    argv[n] = NULL;
+    return run(argv, out, cpu, rss);
+}
+
+static char *load_file(const char *fn)
+{
+    FILE *f = fopen(fn, "rb");
+    char *buf;
+    long size;
+    if (!f)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    buf = malloc(size + 1);
+    buf[fread(buf, 1, size, f)] = 0;
+    fclose(f);
+    return buf;
+}
+
+/* the time of 'name' in the base results, as "+1.2%" */
+static const char *vs_base(const char *name, double t)
+{
+    static char buf[32];
+    char key[64];
+    const char *p;
+    double b;
+
+    buf[0] = 0;
+    snprintf(key, sizeof key, "\"name\": \"%s\"", name);
+    if (base && (p = strstr(base, key)) && (p = strstr(p, "\"time\": "))
+        && sscanf(p + 8, "%lf", &b) == 1 && b > 0)
+        snprintf(buf, sizeof buf, "%+6.1f%%", (t - b) * 100 / b);
+    return buf;
+}
+
+static int bench_compile(Result *r, const char *name, void (*gen)(FILE *))
+{
+    char src[64], obj[64], out[64], *log, *p;
+    double t;
+    long rss;
+    FILE *f;
+    int i;
+
+    snprintf(src, sizeof src, GEN "/%s.c", name);
+    snprintf(obj, sizeof obj, GEN "/%s.o", name);
+    snprintf(out, sizeof out, GEN "/%s.log", name);
+    f = fopen(src, "w");
+    if (!f)
+        return -1;
+    gen(f);
+    fclose(f);
+
+    r->name = name, r->time = 1e9, r->rss = 0;
+    for (i = 0; i < reps; i++) {
+        if (run_tcc(out, &t, &rss, "-bench", "-w", "-c", src, "-o", obj, NULL))
+            return -1;
+        if (t < r->time)
+            r->time = t;
+        if (rss > r->rss)
+            r->rss = rss;
+    }
+    /* "# 123 idents, 456 lines, 789 bytes" */
+    r->lines = r->bytes = 0;
+    log = load_file(out);
+    if (log && (p = strstr(log, " idents, ")))
+        sscanf(p, " idents, %ld lines, %ld bytes", &r->lines, &r->bytes);
+    free(log);
+    if (r->time <= 0)
+        r->time = 1e-6;
+    printf("%-10s %9ld %7.2f %8.3f %10.0f %8.1f %8ld %8s\n",
+           name, r->lines, r->bytes / 1e6, r->time, r->lines / r->time,
+           r->bytes / 1e6 / r->time, r->rss, vs_base(name, r->time));
+    return 0;
+}
+
+static int bench_run(Result *r, const char *name)
+{
+    char src[1024], exe[64], out[64], *argv[2];
+    double t;
+    long rss;
+    int i;
+
+    snprintf(src, sizeof src, "%s/%s.c", srcdir, name);
+    snprintf(exe, sizeof exe, GEN "/%s", name);
+    snprintf(out, sizeof out, GEN "/%s.out", name);
+    if (run_tcc(out, &r->ctime, &rss, "-o", exe, src, "-lm", NULL))
+        return -1;
+    argv[0] = exe, argv[1] = NULL;
+    r->name = name, r->time = 1e9, r->rss = 0;
+    for (i = 0; i < reps; i++) {
+        if (run(argv, out, &t, &rss))
+            return -1;
+        if (t < r->time)
+            r->time = t;
+        if (rss > r->rss)
+            r->rss = rss;
+    }
+    printf("%-10s %8.3f %8.3f %8ld %8s\n",
+           name, r->ctime, r->time, r->rss, vs_base(name, r->time));
+    return 0;
+}
+
+static void json_str(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', f);
+        if ((unsigned char)*s >= 32)
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+#define NB_CORPUS (sizeof corpus / sizeof *corpus)
+#define NB_KERNELS (sizeof kernels / sizeof *kernels)
+
+int main(int argc, char **argv)
+{
+    Result rc[NB_CORPUS], rk[NB_KERNELS];
+    const char *outfile = NULL, *basefile = NULL, *sep;
+    char version[256], *v, *vargv[3];
+    double t;
+    long rss;
+    FILE *f;
+    int i, ret = 0;
+
+    for (i = 1; i < argc && strcmp(argv[i], "--"); i++) {
+        if (i + 1 == argc)
+            goto usage;
+        if (!strcmp(argv[i], "-n"))
+            reps = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-s"))
+            srcdir = argv[++i];
+        else if (!strcmp(argv[i], "-o"))
+            outfile = argv[++i];
+        else if (!strcmp(argv[i], "-c"))
+            basefile = argv[++i];
+        else
+            goto usage;
+    }
+    tcc_argv = argv + i + 1;
+    tcc_argc = argc - i - 1;
+    if (tcc_argc < 1 || tcc_argc > 50 || reps < 1) {
+usage:
+        fprintf(stderr, "usage: tccbench [-n reps] [-s srcdir] [-o out.json]"
+                        " [-c base.json] -- tcc [options]\n");
+        return 1;
+    }
+    if (basefile && !(base = load_file(basefile)))
+        fprintf(stderr, "tccbench: cannot read '%s'\n", basefile);
+
+    mkdir(GEN, 0777);
+    version[0] = 0;
+    vargv[0] = tcc_argv[0], vargv[1] = "-v", vargv[2] = NULL;
+    if (run(vargv, GEN "/version.log", &t, &rss) == 0
+        && (v = load_file(GEN "/version.log"))) {
+        sscanf(v, "%255[^\n]", version);
+        free(v);
+    }
+    printf("%s, best of %d\n\n", version, reps);
+
+    printf("%-10s %9s %7s %8s %10s %8s %8s %8s\n",
+           "compile", "lines", "MB", "time", "lines/s", "MB/s", "RSS KB",
+           base ? "vs base" : "");
+    for (i = 0; i < NB_CORPUS; i++)
+        if (bench_compile(&rc[i], corpus[i].name, corpus[i].gen))
+            rc[i].name = NULL, ret = 1;
+
+    printf("\n%-10s %8s %8s %8s %8s\n",
+           "run", "compile", "time", "RSS KB", base ? "vs base" : "");
+    for (i = 0; i < NB_KERNELS; i++)
+        if (bench_run(&rk[i], kernels[i]))
+            rk[i].name = NULL, ret = 1;
+
+    if (outfile) {
+        f = fopen(outfile, "w");
+        if (!f) {
+            fprintf(stderr, "tccbench: cannot write '%s'\n", outfile);
+            return 1;
+        }
+        fprintf(f, "{\"tcc\": ");
+        json_str(f, version);
+        fprintf(f, ", \"reps\": %d,\n\"compile\": [", reps);
+        for (sep = "", i = 0; i < NB_CORPUS; i++)
+            if (rc[i].name)
+                fprintf(f, "%s\n{\"name\": \"%s\", \"lines\": %ld, "
+                    "\"bytes\": %ld, \"time\": %.6f, \"lines_per_s\": %.0f, "
+                    "\"mb_per_s\": %.3f, \"peak_rss_kb\": %ld}",
+                    sep, rc[i].name, rc[i].lines, rc[i].bytes,
+                    rc[i].time, rc[i].lines / rc[i].time,
+                    rc[i].bytes / 1e6 / rc[i].time, rc[i].rss), sep = ",";
+        fprintf(f, "\n],\n\"run\": [");
+        for (sep = "", i = 0; i < NB_KERNELS; i++)
+            if (rk[i].name)
+                fprintf(f, "%s\n{\"name\": \"%s\", \"compile_time\": %.6f, "
+                    "\"time\": %.6f, \"peak_rss_kb\": %ld}",
+                    sep, rk[i].name, rk[i].ctime, rk[i].time,
+                    rk[i].rss), sep = ",";
+        fprintf(f, "\n]}\n");
+        fclose(f);
+    }
+    free(base);
+    return ret;
+}
+#endif
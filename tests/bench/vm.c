@@ -0,0 +1,54 @@
+/* bytecode interpreter: a dense switch in a hot loop */
+#include <stdio.h>
+
+enum {
+    OP_PUSH, OP_LOAD, OP_STORE, OP_ADD, OP_SUB, OP_MUL, OP_AND, OP_XOR,
+    OP_SHL, OP_SHR, OP_DUP, OP_DROP, OP_SWAP, OP_LT, OP_JZ, OP_JMP,
+    OP_INC, OP_DEC, OP_HALT
+};
+
+static int run(const int *code, int *vars)
+{
+    int stack[64], sp = 0, pc = 0, t;
+    for (;;) {
+        switch (code[pc++]) {
+        case OP_PUSH: stack[sp++] = code[pc++]; break;
+        case OP_LOAD: stack[sp++] = vars[code[pc++]]; break;
+        case OP_STORE: vars[code[pc++]] = stack[--sp]; break;
+        case OP_ADD: sp--; stack[sp - 1] += stack[sp]; break;
+        case OP_SUB: sp--; stack[sp - 1] -= stack[sp]; break;
+        case OP_MUL: sp--; stack[sp - 1] *= stack[sp]; break;
+        case OP_AND: sp--; stack[sp - 1] &= stack[sp]; break;
+        case OP_XOR: sp--; stack[sp - 1] ^= stack[sp]; break;
+        case OP_SHL: sp--; stack[sp - 1] <<= stack[sp]; break;
+        case OP_SHR: sp--; stack[sp - 1] = (unsigned)stack[sp - 1] >> stack[sp]; break;
+        case OP_DUP: stack[sp] = stack[sp - 1]; sp++; break;
+        case OP_DROP: sp--; break;
+        case OP_SWAP: t = stack[sp - 1]; stack[sp - 1] = stack[sp - 2]; stack[sp - 2] = t; break;
+        case OP_LT: sp--; stack[sp - 1] = stack[sp - 1] < stack[sp]; break;
+        case OP_JZ: pc = stack[--sp] ? pc + 1 : code[pc]; break;
+        case OP_JMP: pc = code[pc]; break;
+        case OP_INC: vars[code[pc++]]++; break;
+        case OP_DEC: vars[code[pc++]]--; break;
+        case OP_HALT: return stack[sp - 1];
+        }
+    }
+}
+
+/* h = 0; for (i = 0; i < n; i++) h = (h * 31 ^ i) + (h >> 7); return h */
+static const int prog[] = {
+    OP_PUSH, 0, OP_STORE, 1,
+    OP_PUSH, 0, OP_STORE, 2,
+    /* 8: */ OP_LOAD, 2, OP_LOAD, 0, OP_LT, OP_JZ, 35,
+    OP_LOAD, 1, OP_PUSH, 31, OP_MUL, OP_LOAD, 2, OP_XOR,
+    OP_LOAD, 1, OP_PUSH, 7, OP_SHR, OP_ADD, OP_STORE, 1,
+    OP_INC, 2, OP_JMP, 8,
+    /* 35: */ OP_LOAD, 1, OP_HALT
+};
+
+int main(void)
+{
+    int vars[4] = { 8000000 };
+    printf("%08x\n", run(prog, vars));
+    return 0;
+}
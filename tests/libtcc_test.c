@@ -45,6 +45,16 @@ char my_program[] =
 "    return 0;\n"
 "}\n";
 
+/* added after tcc_relocate(), uses 'fib' from above */
+char my_program_2[] =
+"#include <tcclib.h>\n"
+"int fib(int n);\n"
+"int bar(int n)\n"
+"{\n"
+"    printf(\"fib(%d) + 1 = %d\\n\", n, fib(n) + 1);\n"
+"    return 0;\n"
+"}\n";
+
 int main(int argc, char **argv)
 {
     TCCState *s;
@@ -96,6 +106,16 @@ int main(int argc, char **argv)
     /* run the code */
     func(32);
 
+    /* add more code to the running program */
+    if (tcc_compile_string(s, my_program_2) == -1)
+        return 1;
+    if (tcc_relocate(s) < 0)
+        return 1;
+    func = tcc_get_symbol(s, "bar");
+    if (!func)
+        return 1;
+    func(20);
+
     /* delete the state */
     tcc_delete(s);
 
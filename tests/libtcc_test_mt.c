@@ -283,6 +283,84 @@ static unsigned getclock_ms(void)
 #endif
 }
 
+/* compile many small snippets in threads to measure throughput */
+#define NB_SNIPPETS 50 /* per thread */
+
+PROG(my_snippet)
+"int add(int a, int b);\n"
+"int sum(const int *p, int n)\n"
+"{\n"
+"    int i, s = 0;\n"
+"    for (i = 0; i < n; ++i)\n"
+"        s = add(s, p[i] * N_CRASH);\n"
+"    return s;\n"
+"}\n";
+
+TF_TYPE(thread_test_throughput, vn)
+{
+    TCCState *s;
+    int i, p[4] = { 1, 2, 3, 4 };
+    int (*func)(const int *, int);
+
+    for (i = 0; i < NB_SNIPPETS; ++i) {
+        s = new_state(0);
+        if (tcc_compile_string(s, my_snippet) == -1)
+            exit(1);
+        func = reloc_state(s, "sum");
+        if (!func || func(p, 4) != -10000)
+            exit(1);
+        tcc_delete(s);
+    }
+    return 0;
+}
+
+PROG(my_common)
+"#include <tcclib.h>\n"
+"int scale(int a) { return a * N_CRASH; }\n";
+
+TCCState *s_common;
+
+/* same with copies of a prepared state */
+TF_TYPE(thread_test_clone, vn)
+{
+    TCCState *s;
+    int i, p[4] = { 1, 2, 3, 4 };
+    int (*func)(const int *, int);
+
+    for (i = 0; i < NB_SNIPPETS; ++i) {
+        s = tcc_state_clone(s_common);
+        if (!s || tcc_compile_string(s, my_snippet) == -1)
+            exit(1);
+        func = reloc_state(s, "sum");
+        if (!func || func(p, 4) != -10000 || !tcc_get_symbol(s, "scale"))
+            exit(1);
+        tcc_delete(s);
+    }
+    return 0;
+}
+
+/* with CONFIG_TCC_TLS the rate should scale with the number of cores */
+void time_throughput(ThreadFunc *f)
+{
+    int n, nt;
+    unsigned t, t1 = 0;
+
+    for (nt = 1; nt <= M; nt *= 2) {
+        t = getclock_ms();
+        for (n = 0; n < nt; ++n)
+            create_thread(f, n);
+        wait_threads(n);
+        t = getclock_ms() - t;
+        if (t == 0)
+            t = 1;
+        if (nt == 1)
+            t1 = t;
+        printf(" %2d threads: %5u ms, %6u compiles/s (x%.1f)\n",
+            nt, t, nt * NB_SNIPPETS * 1000 / t, (double)t1 * nt / t);
+        fflush(stdout);
+    }
+}
+
 int main(int argc, char **argv)
 {
     int n;
@@ -326,6 +404,18 @@ int main(int argc, char **argv)
     wait_threads(n);
     printf("\n (%u ms)\n", getclock_ms() - t);
 #endif
+#if 1
+    printf("compiling snippets in threads\n"), fflush(stdout);
+    time_throughput(thread_test_throughput);
+#endif
+#if 1
+    printf("compiling snippets in cloned states\n"), fflush(stdout);
+    s_common = new_state(0);
+    if (tcc_compile_string(s_common, my_common) == -1)
+        return 1;
+    time_throughput(thread_test_clone);
+    tcc_delete(s_common);
+#endif
 #if 1
     printf("compiling tcc.c 10 times\n "), fflush(stdout);
     t = getclock_ms();
@@ -0,0 +1,89 @@
+/*
+ * Test for libtcc: states compiled one after the other at -O1
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "libtcc.h"
+
+void handle_error(void *opaque, const char *msg)
+{
+    fprintf(opaque, "%s\n", msg);
+}
+
+#define NOP "__asm__(\"nop\");"
+#define NOP10 NOP NOP NOP NOP NOP NOP NOP NOP NOP NOP
+
+/* a loop at about the same offset as the jumps of 'prog_f' */
+char prog_g[] =
+"int g(int x)\n"
+"{\n"
+"    " NOP10 NOP10 NOP10 "\n"
+"    while (x)\n"
+"        x--;\n"
+"    return x;\n"
+"}\n";
+
+char prog_f[] =
+"int f(int x)\n"
+"{\n"
+"    if (x)\n"
+"        return 1;\n"
+"    if (x > 2)\n"
+"        return 3;\n"
+"    return 2;\n"
+"}\n";
+
+int argc;
+char **argv;
+
+/* compile 'prog' at -O1 in a new state and return 'name'(arg) */
+int run(const char *prog, const char *name, int arg)
+{
+    TCCState *s;
+    int i, ret = -1;
+    int (*func)(int);
+
+    s = tcc_new();
+    if (!s)
+        return -1;
+    tcc_set_error_func(s, stderr, handle_error);
+    for (i = 1; i < argc; ++i) {
+        char *a = argv[i];
+        if (a[0] == '-') {
+            if (a[1] == 'B')
+                tcc_set_lib_path(s, a+2);
+            else if (a[1] == 'I')
+                tcc_add_include_path(s, a+2);
+            else if (a[1] == 'L')
+                tcc_add_library_path(s, a+2);
+        }
+    }
+    tcc_set_options(s, "-O1");
+    tcc_set_output_type(s, TCC_OUTPUT_MEMORY);
+    if (tcc_compile_string(s, prog) != -1
+        && tcc_relocate(s) >= 0
+        && (func = tcc_get_symbol(s, name)))
+        ret = func(arg);
+    tcc_delete(s);
+    return ret;
+}
+
+int main(int ac, char **av)
+{
+    static const int expect[3] = { 0, 2, 1 };
+    int i, r[6];
+
+    argc = ac, argv = av;
+    for (i = 0; i < 2; i++) {
+        r[i * 3] = run(prog_g, "g", 5);
+        r[i * 3 + 1] = run(prog_f, "f", 0);
+        r[i * 3 + 2] = run(prog_f, "f", 1);
+    }
+    printf("g(5) = %d, f(0) = %d, f(1) = %d\n", r[3], r[4], r[5]);
+    for (i = 0; i < 6; i++)
+        if (r[i] != expect[i % 3])
+            return 1;
+    return 0;
+}
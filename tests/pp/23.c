@@ -0,0 +1,17 @@
+/* plain arguments and object like macros inside expansions */
+#define N 4
+#define M (N + 1)
+#define K 3 * 2
+#define F f
+#define f(x) [x]
+#define G(a, b) a b | p ## b | #a
+#define H(x) G(x, K) G(x y, z)
+#define ID(x) x
+#define E() F
+H(1)
+H(N)
+H( M )
+ID(F(N)) F (K)
+ID(ID(  a  +  b  ) N M)
+ID(E()(2))
+G(( a , b ), c)
@@ -0,0 +1,71 @@
+/* local variables in registers (-O1) */
+#include <stdio.h>
+
+static int sum(int n, int step)
+{
+    int i, s = 0;
+    for (i = 0; i < n; i += step)
+        s += i;
+    return s;
+}
+
+static void inc(int *p)
+{
+    ++*p;
+}
+
+static long long mix(char c, short h, long long l, unsigned char *p)
+{
+    int k;
+    long long r = 0;
+    for (k = 0; k < 4; k++) {
+        r = r * 31 + c + h + l + *p++;
+        c++, h--, l ^= k;
+    }
+    return r;
+}
+
+static int addr_taken(int n)
+{
+    int a = 1, b = 0, i;
+    for (i = 0; i < n; i++) {
+        inc(&a);
+        b += a;
+    }
+    return a + b;
+}
+
+static int nested(int n)
+{
+    int t = 0, i;
+    for (i = 0; i < n; i++) {
+        int j, u = i;
+        for (j = 0; j < i; j++)
+            u += j * i;
+        t += u;
+    }
+    return t;
+}
+
+static int packed(void)
+{
+    int i, s = 0;
+#pragma pack(push, 1)
+    struct { char c; int i; } x;
+#pragma pack(pop)
+    struct { char c; int i; } y;
+    for (i = 0; i < 3; i++)
+        s += sizeof x + sizeof y;
+    return s;
+}
+
+int main(void)
+{
+    unsigned char buf[4] = { 1, 2, 3, 4 };
+    printf("%d %d\n", sum(100, 1), sum(100, 7));
+    printf("%lld\n", mix(3, -5, 1234567890123LL, buf));
+    printf("%d\n", addr_taken(5));
+    printf("%d\n", nested(10));
+    printf("%d\n", packed());
+    return 0;
+}
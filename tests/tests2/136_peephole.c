@@ -0,0 +1,79 @@
+/* -O1 peephole: reloads, jumps to jumps and to the next instruction */
+#include <stdio.h>
+
+static int f1(int a, int b)
+{
+    int x, y, z, u, v, w; /* more than fit in registers */
+    x = a + b;
+    y = x * 2;
+    z = y - x;
+    u = z;
+    v = u + y;
+    w = v;
+    return x + y + z + u + v + w;
+}
+
+static int f2(int n)
+{
+    int i, s = 0;
+    for (i = 0; i < n; i++) {
+        if (i & 1) {
+            if (i % 3)
+                continue;
+        } else if (i % 5 == 0) {
+            s += 100;
+        } else {
+            continue;
+        }
+        s += i;
+    }
+    return s;
+}
+
+static int f3(double a, double b)
+{
+    int r = 0;
+    if (a < b)
+        r |= 1;
+    if (a != b)
+        r |= 2;
+    if (!(a == b))
+        r |= 4;
+    if (a >= b) {
+    } else {
+        r |= 8;
+    }
+    return r;
+}
+
+static int f4(int n)
+{
+    volatile int v = n;
+    int *p = (int *)&v;
+    *p = n + 1;
+    return v;
+}
+
+static int f5(int n)
+{
+    switch (n) {
+    case 0: return 10;
+    case 1: n = 5;
+    case 2: break;
+    default: goto out;
+    }
+    return n;
+out:
+    return -1;
+}
+
+int main(void)
+{
+    double nan = 0.0 / 0.0;
+    printf("%d %d\n", f1(3, 4), f1(-1, 1));
+    printf("%d %d\n", f2(50), f2(0));
+    printf("%d %d %d\n", f3(1, 2), f3(2, 1), f3(nan, 1));
+    printf("%d\n", f4(41));
+    printf("%d %d %d %d\n", f5(0), f5(1), f5(2), f5(3));
+    return 0;
+}
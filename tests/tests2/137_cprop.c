@@ -0,0 +1,108 @@
+/* -O1 constant propagation and delayed stores of constants */
+#include <stdio.h>
+#include <string.h>
+
+static void set(int *p, int v) { *p = v; }
+static int get(int *p) { return *p; }
+
+static int alias(int n)
+{
+    int x = 1, *p = &x, r;
+    x = 2;
+    *p = 3;
+    r = x;
+    x = 4;
+    set(&x, n);
+    return r * 100 + x * 10 + get(&x);
+}
+
+static int loop(int n)
+{
+    int i, a = 1, b = 2, s = 0;
+    for (i = 0; i < n; i++) {
+        s += a * 10 + b;
+        a = 3;
+        if (i & 1)
+            b = 4;
+    }
+    return s;
+}
+
+static int jumps(int n)
+{
+    int x = 5, y = 6;
+    if (n > 1)
+        goto out;
+    x = 7;
+    switch (n) {
+    case 0:
+        y = 8;
+    case 1:
+        x = y + 1;
+        break;
+    default:
+        y = 0;
+    }
+out:
+    return x * 10 + y;
+}
+
+static int cond(int n)
+{
+    int x = 2, y = 3, z = 0;
+    if (n && (x = 4) > 3)
+        z = x;
+    if (n || (y = 5))
+        z += y;
+    z += sizeof(x = 9);
+    return z * 10 + x + y;
+}
+
+union u { int i; short s[2]; unsigned char c[4]; };
+struct st { char c; short s; int i; long long l; };
+
+static int aggr(void)
+{
+    union u u;
+    struct st a, b;
+    int r;
+    u.i = 0x01020304;
+    u.s[0] = 0x0506;
+    r = u.c[0] + u.c[3] * 10;
+    a.c = 1; a.s = 2; a.i = 3; a.l = 0x123456789LL;
+    b = a;
+    a.i = 4;
+    memset(&a, 0, sizeof a);
+    return r * 1000 + b.c + b.s + b.i + (int)(b.l >> 32) * 100 + a.i;
+}
+
+static long long sized(void)
+{
+    signed char c = -1;
+    unsigned short s = 0xffff;
+    unsigned u = 0xffffffff;
+    long long l = -2, m = 0x100000000LL;
+    c = c;
+    return c + s + u + l + m;
+}
+
+static int ret(int n)
+{
+    int x = 1;
+    if (n)
+        return x;
+    x = 2;
+    return x + 1;
+}
+
+int main(void)
+{
+    printf("%d %d\n", alias(5), alias(6));
+    printf("%d %d %d\n", loop(0), loop(1), loop(4));
+    printf("%d %d %d\n", jumps(0), jumps(1), jumps(2));
+    printf("%d %d\n", cond(0), cond(1));
+    printf("%d\n", aggr());
+    printf("%lld\n", sized());
+    printf("%d %d\n", ret(0), ret(1));
+    return 0;
+}
@@ -0,0 +1,73 @@
+/* -O2: floating point register variables, also across calls */
+#include <stdio.h>
+
+static double twice(double x) { return x * 2; }
+static float half(float x) { return x / 2; }
+static double sum(int n, ...);
+
+static double poly(double x, float y, int n)
+{
+    double s = 0, p = 1;
+    float q = y;
+    int i;
+    for (i = 0; i < n; i++) {
+        s += p * q;
+        p *= x;
+        q = half(q) + 1;
+        if (s > 1000)
+            s = twice(s) - 2000;
+    }
+    return s + q;
+}
+
+static double many(void)
+{
+    double a = 1, b = 2, c = 3, d = 4, e = 5, f = 6, g = 7, h = 8, k = 9, l = 10;
+    int i;
+    for (i = 0; i < 4; i++) {
+        a += b; b += c; c += d; d += e; e += f;
+        f += g; g += h; h += k; k += l; l += a;
+    }
+    return a + b + c + d + e + f + g + h + k + l;
+}
+
+#include <stdarg.h>
+static double sum(int n, ...)
+{
+    va_list ap;
+    double s = 0;
+    va_start(ap, n);
+    while (n--)
+        s += va_arg(ap, double);
+    va_end(ap);
+    return s;
+}
+
+static int cmp(float a, double b)
+{
+    float x = a;
+    double y = b;
+    int r = 0, i;
+    for (i = 0; i < 3; i++) {
+        r = r * 10 + (x < y) + (x == y) * 2 + (x > y) * 4;
+        x += 1;
+        y -= 0.5;
+    }
+    return r;
+}
+
+int main(void)
+{
+    double d = 0.25;
+    float f = 3;
+    int i;
+    printf("%.4f %.4f\n", poly(1.5, 2, 10), poly(0.5, 8, 30));
+    printf("%.1f\n", many());
+    for (i = 0; i < 3; i++) {
+        d = sum(3, d, (double)f, 1.0);
+        f = f * 2 - (float)d;
+    }
+    printf("%.4f %.4f\n", d, f);
+    printf("%d %d\n", cmp(1, 2), cmp(2.5f, 1));
+    return 0;
+}
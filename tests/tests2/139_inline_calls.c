@@ -0,0 +1,63 @@
+/* -O1: calls of small static functions expanded in place */
+#include <stdio.h>
+
+struct pt { int x, y; };
+
+static int add(int a, int b) { return a + b; }
+static int sq(int x) { return x * x; }
+static inline int max(int a, int b) { if (a > b) return a; return b; }
+static char low(int c) { return c; }
+static unsigned char uc(int a) { return a; }
+static _Bool bo(int a) { return a; }
+static long long big(long long a) { return a << 33; }
+static double avg(double a, float b) { return (a + b) / 2; }
+static struct pt mkpt(int x, int y) { struct pt p; p.x = x; p.y = y; return p; }
+static int sum(const struct pt *p) { return p->x + p->y; }
+static void inc(int *p) { ++*p; }
+static int fact(int n) { return n > 1 ? n * fact(n - 1) : 1; }
+static int odd(int n);
+static int even(int n) { return n == 0 ? 1 : odd(n - 1); }
+static int odd(int n) { return n == 0 ? 0 : even(n - 1); }
+static int first(int n) { int i; for (i = 0; i < n; i++) if (i * i > n) return i; return -1; }
+static int sel(int n) { switch (n) { case 0: return 10; case 1: break; default: return 30; } return 20; }
+static int brk(int n) { while (n > 10) { n -= 3; if (n & 1) break; } return n; }
+static int vsum(int n) { int v[n], i, s = 0; for (i = 0; i < n; i++) v[i] = i; for (i = 0; i < n; i++) s += v[i]; return s; }
+static const char *name(int k) { static const char *t[] = { "a", "b" }; return t[k]; }
+static int x = 100;
+static int getx(void) { return x; }
+static int nest(int a) { return add(sq(a), max(a, 3)); }
+static int g3(int a, int b, int c) { return a * 100 + b * 10 + c; }
+static int cnt;
+static int side(int v) { cnt++; return v; }
+
+int main(void)
+{
+    int i, s = 0, y = 2;
+    struct pt p;
+
+    for (i = 0; i < 10; i++)
+        s += add(i, sq(i)) + max(i, 4);
+    printf("%d %d %d\n", s, sq(add(2, 3)), nest(2));
+    printf("%d %d %d %d %lld\n", low(0x1ff), low(-1), uc(300), bo(4), big(3));
+    printf("%.2f\n", avg(1.5, 2));
+    p = mkpt(3, 4);
+    printf("%d %d\n", sum(&p), mkpt(5, 6).y);
+    inc(&y);
+    inc(&y);
+    printf("%d %d %d %d %d\n", y, fact(5), even(7), odd(7), first(10));
+    printf("%d %d %d %d\n", sel(0), sel(1), sel(2), brk(20));
+    for (i = 0, s = 0; i < 5; i++)
+        s += vsum(i + 1);
+    printf("%d %s %d\n", s, name(1), getx());
+    {
+        int x = 5; /* the body of getx() must not see it */
+        printf("%d %d\n", getx() + x, g3(max(1, 2), ({ int q = 3; q; }), g3(1, x, 3)));
+    }
+    i = add(side(1), side(2)) + (y ? sq(3) : max(side(7), 2));
+    printf("%d %d\n", i, cnt);
+    for (i = 0, s = 0; i < 4; i++)
+        if (i && max(i & 1, 0) > 0 || g3(0, 0, i) == 2)
+            s += i;
+    printf("%d %d\n", s, add(add(1, 2), add(add(3, 4), add(5, add(6, 7)))));
+    return 0;
+}
@@ -0,0 +1,172 @@
+/* dense switch statements are lowered to jump tables */
+#include <stdio.h>
+
+static int dense(int x)
+{
+    switch (x) {
+    case 0: return 10;
+    case 1: return 11;
+    case 2: return 12;
+    case 3: return 13;
+    case 4: return 14;
+    case 5: return 15;
+    case 6: return 16;
+    case 7: return 17;
+    case 8: return 18;
+    case 9: return 19;
+    case 10: return 20;
+    default: return -1;
+    }
+}
+
+/* holes, ranges, negative values, fall through and no default */
+static int holes(int x)
+{
+    int r = 0;
+    switch (x) {
+    case -5: r += 1;
+    case -4: r += 2; break;
+    case -2: r = 3; break;
+    case 0 ... 3: r = 4; break;
+    case 5: r = 5; break;
+    case 6: r = 6; break;
+    case 8: r = 7; break;
+    case 9: r = 8; break;
+    case 10: r = 9; break;
+    case 12: r = 10; break;
+    }
+    return r;
+}
+
+static int uns(unsigned x)
+{
+    switch (x) {
+    case 0xfffffffc: return 1;
+    case 0xfffffffd: return 2;
+    case 0xfffffffe: return 3;
+    case 0xffffffff: return 4;
+    case 0: return 5;
+    case 1: return 6;
+    case 2: return 7;
+    case 3: return 8;
+    case 4: return 9;
+    default: return 0;
+    }
+}
+
+static int big(unsigned x)
+{
+    switch (x) {
+    case 0xfffffff0: return 1;
+    case 0xfffffff1: return 2;
+    case 0xfffffff2: return 3;
+    case 0xfffffff3: return 4;
+    case 0xfffffff4: return 5;
+    case 0xfffffff5: return 6;
+    case 0xfffffff6: return 7;
+    case 0xfffffff7: return 8;
+    case 0xfffffff9: return 9;
+    default: return 0;
+    }
+}
+
+static int ll(long long x)
+{
+    switch (x) {
+    case 0x100000000LL: return 1;
+    case 0x100000001LL: return 2;
+    case 0x100000002LL: return 3;
+    case 0x100000003LL: return 4;
+    case 0x100000004LL: return 5;
+    case 0x100000005LL: return 6;
+    case 0x100000006LL: return 7;
+    case 0x100000007LL: return 8;
+    case 0x100000009LL: return 9;
+    default: return 0;
+    }
+}
+
+/* two dense clusters far apart and a nested switch */
+static int clusters(int x, int y)
+{
+    switch (x) {
+    case 1: case 2: case 3: case 4: case 5:
+    case 6: case 7: case 8: case 9: case 10:
+        switch (y) {
+        case 0: return x;
+        case 1: return x * 2;
+        case 2: return x * 3;
+        case 3: return x * 4;
+        case 4: return x * 5;
+        case 5: return x * 6;
+        case 6: return x * 7;
+        case 7: return x * 8;
+        case 8: return x * 9;
+        }
+        return -x;
+    case 1000: return 100;
+    case 1001: return 101;
+    case 1002: return 102;
+    case 1003: return 103;
+    case 1004: return 104;
+    case 1005: return 105;
+    case 1006: return 106;
+    case 1007: return 107;
+    case 1008: return 108;
+    case 1009: return 109;
+    case 1011: return 111;
+    }
+    return 0;
+}
+
+/* a small bytecode interpreter */
+static int run(const unsigned char *pc)
+{
+    int st[16], *sp = st;
+    for (;;) {
+        switch (*pc++) {
+        case 0: return sp[-1];
+        case 1: *sp++ = *pc++; break;
+        case 2: sp--; sp[-1] += *sp; break;
+        case 3: sp--; sp[-1] -= *sp; break;
+        case 4: sp--; sp[-1] *= *sp; break;
+        case 5: sp[0] = sp[-1]; sp++; break;
+        case 6: if (*--sp) pc += (signed char)*pc; else pc++; break;
+        case 7: sp--; break;
+        case 8: sp[-1] = -sp[-1]; break;
+        case 9: { int t = sp[-1]; sp[-1] = sp[-2]; sp[-2] = t; } break;
+        default: return -1;
+        }
+    }
+}
+
+int main(void)
+{
+    static const unsigned char prog[] = {
+        1, 6, 1, 7, 4, 5, 2, 1, 4, 3, 8, 1, 3, 9, 3,
+        1, 1, 6, 3, 1, 99, 0
+    };
+    int i;
+    for (i = -2; i <= 12; i++)
+        printf("%d ", dense(i));
+    printf("\n");
+    for (i = -7; i <= 14; i++)
+        printf("%d ", holes(i));
+    printf("\n");
+    for (i = -6; i <= 6; i++)
+        printf("%d ", uns(i));
+    printf("\n");
+    for (i = -17; i <= -5; i++)
+        printf("%d ", big(i));
+    printf("\n");
+    for (i = -1; i <= 11; i++)
+        printf("%d ", ll(0x100000000LL + i));
+    printf("%d\n", ll(9));
+    for (i = 0; i <= 11; i++)
+        printf("%d ", clusters(i, i % 10));
+    for (i = 998; i <= 1013; i++)
+        printf("%d ", clusters(i, 0));
+    printf("\n");
+    printf("%d %d\n", run(prog), run((const unsigned char *)"\1\2\12"));
+    return 0;
+}
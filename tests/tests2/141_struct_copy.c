@@ -0,0 +1,69 @@
+/* struct copies and zero initialization of all small sizes */
+#include <stdio.h>
+#include <string.h>
+
+#define S(n) \
+    struct c##n { char c[n]; }; \
+    struct l##n { long long l[(n + 7) / 8]; }; \
+    static struct c##n gc##n; \
+    static void t##n(void) \
+    { \
+        struct c##n a, b, *p = &a, *q = &b; \
+        struct l##n x, y; \
+        char z[n + 2] = { 1 }; \
+        int i, s = 0; \
+        for (i = 0; i < n; i++) \
+            a.c[i] = i + n; \
+        memset(&b, 0x55, sizeof b); \
+        b = a; \
+        gc##n = b; \
+        *q = *p; \
+        *p = *p; \
+        q[0] = gc##n; \
+        for (i = 0; i < sizeof x.l / sizeof x.l[0]; i++) \
+            x.l[i] = i * 0x0101010101010101LL; \
+        y = x; \
+        for (i = 0; i < n; i++) \
+            s += a.c[i] == b.c[i] && b.c[i] == gc##n.c[i] && a.c[i] == (char)(i + n); \
+        for (i = 0; i < sizeof x.l / sizeof x.l[0]; i++) \
+            s += x.l[i] == y.l[i]; \
+        for (i = 1; i < n + 2; i++) \
+            s -= z[i] != 0; \
+        printf(" %d", s - n - (int)(sizeof x.l / sizeof x.l[0]) + z[0]); \
+    }
+
+S(1) S(2) S(3) S(4) S(5) S(6) S(7) S(8) S(9) S(12) S(15) S(16) S(17)
+S(24) S(31) S(32) S(33) S(40) S(48) S(63) S(64) S(65) S(100) S(127)
+S(128) S(129) S(200)
+
+struct pt { int x, y; };
+struct rect { struct pt a, b; short tag; };
+struct big { struct rect r[3]; double d; };
+
+static struct big mk(int i)
+{
+    struct big b = { { { { i, i + 1 }, { i + 2, i + 3 }, 7 } }, 0.5 };
+    return b;
+}
+
+int main(void)
+{
+    struct big b[4], t;
+    struct rect r = { { 1, 2 } };
+    int i;
+
+    t1(); t2(); t3(); t4(); t5(); t6(); t7(); t8(); t9(); t12(); t15();
+    t16(); t17(); t24(); t31(); t32(); t33(); t40(); t48(); t63(); t64();
+    t65(); t100(); t127(); t128(); t129(); t200();
+    printf("\n");
+
+    for (i = 0; i < 4; i++)
+        b[i] = mk(i * 10);
+    t = b[3], b[3] = b[0], b[0] = t;
+    for (i = 0; i < 4; i++)
+        printf("%d %d %d %d %d %d %g\n", b[i].r[0].a.x, b[i].r[0].a.y,
+               b[i].r[0].b.y, b[i].r[0].tag, b[i].r[1].a.x, b[i].r[2].tag,
+               b[i].d);
+    printf("%d %d %d %d %d\n", r.a.x, r.a.y, r.b.x, r.b.y, r.tag);
+    return 0;
+}
@@ -0,0 +1,70 @@
+/* -b: bound checking with several threads working at the same time */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define NTHREADS 4
+#define LOOPS    2000
+
+static char *shared[NTHREADS];
+
+static int sum(int *a, int n)
+{
+    int i, s = 0;
+    for (i = 0; i < n; i++)
+        s += a[i];
+    return s;
+}
+
+static int work(int id)
+{
+    int local[32], i, j, r = 0;
+    char buf[64];
+
+    for (i = 0; i < LOOPS; i++) {
+        int n = 1 + (i + id) % 32;
+        int *p = malloc(n * sizeof *p);
+        for (j = 0; j < n; j++)
+            p[j] = local[j % 32] = i + j;
+        if (sum(p, n) != sum(local, n))
+            r = -1000000;
+        sprintf(buf, "%d-%d", id, i);
+        r += strlen(buf);
+        p = realloc(p, 2 * n * sizeof *p);
+        p[2 * n - 1] = n;
+        r += p[2 * n - 1];
+        free(p);
+    }
+    return r;
+}
+
+static void *thread(void *arg)
+{
+    int id = (int)(size_t)arg;
+    int *res = malloc(sizeof *res);
+    /* free memory allocated by another thread */
+    free(shared[id]);
+    *res = work(id);
+    return res;
+}
+
+int main(void)
+{
+    pthread_t th[NTHREADS];
+    int i;
+    void *res;
+
+    for (i = 0; i < NTHREADS; i++) {
+        shared[i] = malloc(100);
+        memset(shared[i], i, 100);
+    }
+    for (i = 0; i < NTHREADS; i++)
+        pthread_create(&th[i], NULL, thread, (void *)(size_t)i);
+    for (i = 0; i < NTHREADS; i++) {
+        pthread_join(th[i], &res);
+        printf("thread %d: %d\n", i, *(int *)res);
+        free(res);
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+/* -b: no checks for accesses known to stay within bounds, and none
+   for repeated accesses through the same pointer variable */
+#include <stdio.h>
+#include <stdlib.h>
+
+void __bound_never_fatal(int neverfatal);
+
+struct pt { int x, y; char name[8]; };
+
+int garr[10];
+struct pt gpt;
+static const char msg[] = "hello";
+
+int known(void)
+{
+    int arr[4];
+    struct pt p;
+    arr[0] = 1, arr[1] = 2, arr[2] = 3, arr[3] = 4;
+    p.x = 5, p.y = 6, p.name[7] = 7;
+    gpt.y = 8, garr[9] = 9;
+    return arr[0] + arr[1] + arr[2] + arr[3] + p.x + p.y + p.name[7]
+        + gpt.y + garr[9] + msg[4];
+}
+
+int repeated(struct pt *p, int *a)
+{
+    int s;
+    p->x = 1, p->y = 2;
+    s = p->x + p->y + p->name[3];
+    a[0] = s, a[1] = a[0] + 1, a[2] = a[1] + *a;
+    if (s)
+        a[3] = a[2] + a[1];
+    return s + a[2] + a[3];
+}
+
+int main(void)
+{
+    struct pt *p = calloc(1, sizeof *p);
+    int *a = malloc(4 * sizeof *a), i;
+    int arr[4];
+
+    printf("%d %d\n", known(), repeated(p, a));
+
+    /* still caught */
+    __bound_never_fatal(1);
+    i = 4;
+    arr[i] = 1;
+    garr[10] = 1;
+    p->name[8] = 1;
+    free(p);
+    p = malloc(sizeof(int));
+    p->x = 1, p->y = 2;
+    a[0] = 1, a[4] = 2;
+    free(a);
+    a[0] = 3;
+    return 0;
+}
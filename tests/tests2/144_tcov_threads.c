@@ -0,0 +1,35 @@
+/* -ftest-coverage=thread,atomic,binary: exact counts from several
+   threads, two runs merged into one .tcovb, report by tcc -tcov */
+#include <stdio.h>
+#include <pthread.h>
+
+#define NTHREADS 8
+
+static int work(int n)
+{
+    int i, s = 0;
+    for (i = 0; i < n; i++)
+        if (i % 3)
+            s += i;
+        else
+            s -= 1;
+    return s;
+}
+
+static void *run(void *arg)
+{
+    work(10000);
+    return arg;
+}
+
+int main(void)
+{
+    pthread_t t[NTHREADS];
+    int i;
+    for (i = 0; i < NTHREADS; i++)
+        pthread_create(&t[i], NULL, run, NULL);
+    for (i = 0; i < NTHREADS; i++)
+        pthread_join(t[i], NULL);
+    printf("%d\n", work(10));
+    return 0;
+}
@@ -0,0 +1,56 @@
+/* -O1: constant stores to cleanup variables are seen by the cleanup,
+   which takes their address without a '&' */
+extern int printf(const char *, ...);
+
+static int out[16], n;
+
+void show(int *p)
+{
+    out[n++] = *p;
+}
+
+int f(int a)
+{
+    int __attribute__((cleanup(show))) x = 1;
+    x = 5;
+    if (a)
+        return 1;
+    x = 7;
+    {
+        int __attribute__((cleanup(show))) y = 3;
+        y = 9;
+    }
+    return 0;
+}
+
+int g(int a)
+{
+    int i;
+    for (i = 0; i < 3; i++) {
+        int __attribute__((cleanup(show))) z = 10;
+        if (i == a)
+            break;
+        z = 20 + i;
+    }
+    {
+        int __attribute__((cleanup(show))) w = 30;
+        if (a)
+            goto out;
+        w = 40;
+    }
+out:
+    return i;
+}
+
+int main(void)
+{
+    int i;
+    f(1);
+    f(0);
+    g(1);
+    g(5);
+    for (i = 0; i < n; i++)
+        printf("%d ", out[i]);
+    printf("\n");
+    return 0;
+}
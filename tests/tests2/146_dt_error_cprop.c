@@ -0,0 +1,28 @@
+extern int printf(const char *, ...);
+
+#if defined test_error
+/* the stores of the constants are delayed, then the error */
+void f(void)
+{
+    int a = 2;
+    long b = 0x1111;
+    char c = 7;
+    int x[2];
+    x[0] = a + c;
+    int y = ;
+}
+
+#elif defined test_run
+/* whose parameters are where the variables of f() were */
+void g(long a, long b, long c, long d, long e, long f,
+       double u, double v, double w)
+{
+    printf("%ld %ld %ld %ld %ld %ld %g %g %g\n", a, b, c, d, e, f, u, v, w);
+}
+
+int main(void)
+{
+    g(1, 2, 3, 4, 5, 6, 7.5, 8.5, 9.5);
+    return 0;
+}
+#endif
@@ -0,0 +1,96 @@
+/*
+ * Identifier interning microbenchmark
+ *
+ * Collects the identifiers of the files given on the command line
+ * and measures how fast tok_alloc() interns them.
+ *
+ *   make -C tests tokbench [TOKBENCH_FILES="..."]
+ */
+#include "libtcc.c"
+#include <time.h>
+
+typedef struct { const char *p; int len; } Ident;
+
+static Ident *idents;
+static int nb_idents, nb_alloc;
+
+static void collect(const char *p, const char *e)
+{
+    const char *q;
+    while (p < e) {
+        if (isid(*p)) {
+            for (q = p + 1; q < e && (isid(*q) || isnum(*q)); q++)
+                ;
+            if (nb_idents == nb_alloc) {
+                nb_alloc = nb_alloc ? 2 * nb_alloc : 4096;
+                idents = realloc(idents, nb_alloc * sizeof *idents);
+            }
+            idents[nb_idents].p = p;
+            idents[nb_idents++].len = q - p;
+            p = q;
+        } else if (isnum(*p)) {
+            while (p < e && (isid(*p) || isnum(*p)))
+                p++;
+        } else
+            p++;
+    }
+}
+
+static char *load_file(const char *fn, long *size)
+{
+    FILE *f = fopen(fn, "rb");
+    char *buf;
+    if (!f)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    buf = malloc(*size + 1);
+    *size = fread(buf, 1, *size, f);
+    fclose(f);
+    return buf;
+}
+
+int main(int argc, char **argv)
+{
+    TCCState *s;
+    clock_t t0, t;
+    long size, bytes = 0;
+    int i, n, rep, nb_files = 0, uniq = 0;
+    char *buf;
+
+    for (i = 1; i < argc; i++) {
+        if (!(buf = load_file(argv[i], &size)))
+            continue;
+        collect(buf, buf + size);
+        bytes += size, nb_files++;
+    }
+    if (nb_idents == 0) {
+        fprintf(stderr, "usage: tokbench files...\n");
+        return 1;
+    }
+
+    /* repeat with fresh tables until about one second is spent */
+    t = 0, rep = 0;
+    do {
+        s = tcc_new();
+        tcc_enter_state(s);
+        tccpp_new(s);
+        n = tok_ident;
+        t0 = clock();
+        for (i = 0; i < nb_idents; i++)
+            tok_alloc(idents[i].p, idents[i].len);
+        t += clock() - t0;
+        uniq = tok_ident - n;
+        tccpp_delete(s);
+        tcc_exit_state(s);
+        tcc_delete(s);
+        rep++;
+    } while (t < CLOCKS_PER_SEC);
+
+    printf("%d files, %ld bytes, %d identifiers, %d unique\n",
+           nb_files, bytes, nb_idents, uniq);
+    printf("%.2f ns per identifier\n",
+           (double)t / CLOCKS_PER_SEC * 1e9 / rep / nb_idents);
+    return 0;
+}
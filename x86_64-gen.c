@@ -109,7 +109,15 @@ enum {
 #define PROMOTE_RET
 
 #define TCC_TARGET_NATIVE_STRUCT_COPY
-ST_FUNC void gen_struct_copy(int size);
+ST_FUNC int gen_struct_copy(int size, int align);
+ST_FUNC int gen_struct_clear(int size, int align);
+
+#ifndef TCC_TARGET_PE
+/* number of callee saved registers for local variables (-O1) */
+#define NB_REGVARS 5
+/* and of sse registers for floating point ones (-O2), saved around calls */
+#define NB_FREGVARS 8
+#endif
 
 /******************************************************/
 #else /* ! TARGET_DEFS_ONLY */
@@ -154,19 +162,150 @@ ST_DATA const int reg_classes[NB_REGS] = {
     /* st0 */ RC_ST0
 };
 
-static unsigned long func_sub_sp_offset;
-static int func_ret_sub;
+static ST_TLS unsigned long func_sub_sp_offset;
+static ST_TLS int func_ret_sub;
 
 #if defined(CONFIG_TCC_BCHECK)
-static addr_t func_bound_offset;
-static unsigned long func_bound_ind;
+static ST_TLS addr_t func_bound_offset;
+static ST_TLS unsigned long func_bound_ind;
 ST_DATA int func_bound_add_epilog;
 #endif
 
 #ifdef TCC_TARGET_PE
-static int func_scratch, func_alloca;
+static ST_TLS int func_scratch, func_alloca;
 #endif
 
+#ifdef NB_REGVARS
+/* rbx, r12-r15 */
+static const unsigned char regvar_regs[NB_REGVARS] = { 3, 12, 13, 14, 15 };
+static ST_TLS int regvar_loc[NB_REGVARS]; /* frame offset of the variables */
+static ST_TLS int regvar_ind[NB_REGVARS + 1]; /* code of the register saves */
+static ST_TLS int regvar_save, nb_regvars, max_regvars;
+/* xmm8 - xmm15, numbered so that REX_BASE() and REG_VALUE() work */
+#define TREG_XMM8 24
+static ST_TLS int fregvar_loc[NB_FREGVARS], fregvar_t[NB_FREGVARS];
+static ST_TLS int nb_fregvars;
+
+/* return the register which holds the local variable at 'c', or -1 */
+static int regvar_find(int c)
+{
+    int i;
+    for (i = 0; i < nb_regvars; i++)
+        if (regvar_loc[i] == c)
+            return regvar_regs[i];
+    for (i = 0; i < nb_fregvars; i++)
+        if (fregvar_loc[i] == c)
+            return TREG_XMM8 + i;
+    return -1;
+}
+
+#endif
+
+/* -O1 peephole: the last mov emitted, to drop reloads of the same value */
+static ST_TLS int peep_ind = -1; /* 'ind' after it */
+static ST_TLS int peep_r, peep_v, peep_c, peep_ll; /* mov peep_r <-> peep_v/c */
+/* the jumps to the label at 'peep_lbl', for jump threading */
+#define PEEP_MAX 16
+static ST_TLS int peep_jmp[PEEP_MAX], nb_peep_jmp;
+static ST_TLS int peep_lbl = -1, peep_fixed = -1;
+
+#define PEEP_ON (tcc_state->optimize >= 1 && !debug_modes)
+
+/* remember that register 'r' and register 'v' (or local 'c' if v is
+   VT_LOCAL) hold the same value */
+static void peep_mov(int r, int v, int c, int ll)
+{
+    if (PEEP_ON && !nocode_wanted) {
+        peep_ind = ind;
+        peep_r = r, peep_v = v, peep_c = c, peep_ll = ll;
+    }
+}
+
+/* return a register known to hold the value of 'v'/'c', or -1 */
+static int peep_find(int v, int c, int ll)
+{
+    if (ind != peep_ind || ll != peep_ll || c != peep_c)
+        return -1;
+    if (v == peep_v)
+        return peep_r;
+    if (v == peep_r && peep_v < VT_CONST)
+        return peep_v;
+    return -1;
+}
+
+/* forget the jumps and moves of the previous function or state,
+   whose offsets mean nothing in the new code */
+ST_FUNC void gen_peep_reset(void)
+{
+    peep_ind = peep_lbl = peep_fixed = -1;
+    nb_peep_jmp = 0;
+}
+
+/* a label at 'ind' that might be jumped to later */
+ST_FUNC void gen_label(void)
+{
+    peep_ind = -1;
+    peep_fixed = ind;
+}
+
+/* patch the jumps in 't' to 'ind', dropping a jump to the next
+   instruction and remembering the others for peep_thread() */
+static void peep_gsym(int t)
+{
+    unsigned char *p;
+    int i, n;
+
+    if (peep_lbl != ind)
+        nb_peep_jmp = 0;
+    for (; t; t = n) {
+        n = read32le(cur_text_section->data + t);
+        if (nb_peep_jmp < PEEP_MAX) {
+            peep_jmp[nb_peep_jmp++] = t;
+        } else {
+            write32le(cur_text_section->data + t, ind - t - 4);
+            peep_fixed = ind; /* not all jumps known */
+        }
+    }
+    while (peep_fixed != ind) {
+        for (i = 0; i < nb_peep_jmp && peep_jmp[i] != ind - 4; i++)
+            ;
+        if (i == nb_peep_jmp)
+            break;
+        p = cur_text_section->data + ind;
+        if (p[-5] == 0xe9) /* jmp */
+            n = 5;
+        else if (p[-6] == 0x0f && (p[-5] & 0xf0) == 0x80
+                 && !(p[-8] == 0x7a && p[-7] == 6)) /* jcc, not after jp +6 */
+            n = 6;
+        else
+            break;
+        peep_jmp[i] = peep_jmp[--nb_peep_jmp];
+        ind -= n;
+    }
+    for (i = 0; i < nb_peep_jmp; i++)
+        write32le(cur_text_section->data + peep_jmp[i], ind - peep_jmp[i] - 4);
+    peep_lbl = ind;
+    peep_ind = -1;
+}
+
+/* a jump is emitted at 'ind': let the jumps to here go to its
+   target 'a', or if a == -1 add them to the list 't' */
+static int peep_thread(int t, int a)
+{
+    int i, p;
+    if (peep_lbl == ind && !nocode_wanted) {
+        for (i = 0; i < nb_peep_jmp; i++) {
+            p = peep_jmp[i];
+            if (a == -1)
+                write32le(cur_text_section->data + p, t), t = p;
+            else
+                write32le(cur_text_section->data + p, a - p - 4);
+        }
+        nb_peep_jmp = 0;
+    }
+    return t;
+}
+
 /* XXX: make it faster ? */
 ST_FUNC void g(int c)
 {
@@ -228,6 +367,10 @@ static void orex(int ll, int r, int r2, int b)
 /* output a symbol and patch all calls to it */
 ST_FUNC void gsym_addr(int t, int a)
 {
+    if (a == ind && t && PEEP_ON) {
+        peep_gsym(t);
+        return;
+    }
     while (t) {
         unsigned char *ptr = cur_text_section->data + t;
         uint32_t n = read32le(ptr); /* next value */
@@ -243,6 +386,16 @@ static int is64_type(int t)
             (t & VT_BTYPE) == VT_LLONG);
 }
 
+/* mov s, d unless d holds the value of s already */
+static void gen_mov_rr(int ll, int s, int d)
+{
+    if (s != d && peep_find(s, 0, ll) != d) {
+        orex(ll, d, s, 0x89);
+        o(0xc0 + REG_VALUE(d) + REG_VALUE(s) * 8); /* mov s, d */
+        peep_mov(s, d, 0, ll);
+    }
+}
+
 /* instruction + 4 bytes data. Return the address of the data */
 static int oad(int c, int s)
 {
@@ -357,6 +510,15 @@ static void gen_modrm64(int opcode, int op_reg, int r, Sym *sym, int c)
     gen_modrm_impl(op_reg, r, sym, c, is_got);
 }
 
+#ifdef NB_REGVARS
+/* movss/movsd between the sse register variable 'i' and its slot */
+static void fregvar_move(int i, int store)
+{
+    o(fregvar_t[i] == VT_FLOAT ? 0xf3 : 0xf2);
+    orex(0, 0, TREG_XMM8 + i, store ? 0x110f : 0x100f);
+    gen_modrm(TREG_XMM8 + i, VT_LOCAL, NULL, fregvar_loc[i]);
+}
+#endif
 
 /* load 'r' from value 'sv' */
 void load(int r, SValue *sv)
@@ -464,11 +626,32 @@ void load(int r, SValue *sv)
             ll = is64_type(ft);
             b = 0x8b;
         }
-        if (ll) {
-            gen_modrm64(b, r, fr, sv->sym, fc);
+#ifdef NB_REGVARS
+        if (v == VT_LOCAL && (t = regvar_find(fc)) >= 0) {
+            if (b == 0x8b) {
+                gen_mov_rr(ll, t, r);
+            } else if (t >= TREG_XMM8) {
+                orex(0, t, r, 0x280f);
+                o(0xc0 + REG_VALUE(t) + REG_VALUE(r) * 8); /* movaps t, r */
+            } else {
+                orex(ll, t, r, b);
+                o(0xc0 + REG_VALUE(t) + REG_VALUE(r) * 8); /* mov t, r */
+            }
+        } else
+#endif
+        if (v == VT_LOCAL && b == 0x8b && !(sv->type.t & VT_VOLATILE)
+            && (t = peep_find(VT_LOCAL, fc, ll)) >= 0) {
+            /* just stored from or loaded into 't' */
+            gen_mov_rr(ll, t, r);
         } else {
-            orex(ll, fr, r, b);
-            gen_modrm(r, fr, sv->sym, fc);
+            if (ll) {
+                gen_modrm64(b, r, fr, sv->sym, fc);
+            } else {
+                orex(ll, fr, r, b);
+                gen_modrm(r, fr, sv->sym, fc);
+            }
+            if (v == VT_LOCAL && b == 0x8b && !(sv->type.t & VT_VOLATILE))
+                peep_mov(r, VT_LOCAL, fc, ll);
         }
     } else {
         if (v == VT_CONST) {
@@ -558,8 +741,7 @@ void load(int r, SValue *sv)
                 o(0xf024);
                 o(0xf02444dd); /* fldl -0x10(%rsp) */
             } else {
-                orex(is64_type(ft), r, v, 0x89);
-                o(0xc0 + REG_VALUE(r) + REG_VALUE(v) * 8); /* mov v, r */
+                gen_mov_rr(is64_type(ft), v, r);
             }
         }
     }
@@ -572,6 +754,9 @@ void store(int r, SValue *v)
     int op64 = 0;
     /* store the REX prefix in this variable when PIC is enabled */
     int pic = 0;
+#ifdef NB_REGVARS
+    int rv;
+#endif
 
 #ifdef TCC_TARGET_PE
     SValue v2;
@@ -586,6 +771,18 @@ void store(int r, SValue *v)
     ft &= ~(VT_VOLATILE | VT_CONSTANT);
     bt = ft & VT_BTYPE;
 
+#ifdef NB_REGVARS
+    if (fr == VT_LOCAL && (rv = regvar_find(fc)) >= 0) {
+        if (rv >= TREG_XMM8) {
+            orex(0, r, rv, 0x280f);
+            o(0xc0 + REG_VALUE(r) + REG_VALUE(rv) * 8); /* movaps r, rv */
+        } else {
+            gen_mov_rr(is64_type(bt), r, rv);
+        }
+        return;
+    }
+#endif
+
 #ifndef TCC_TARGET_PE
     /* we need to access the variable via got */
     if (fr == VT_CONST
@@ -644,6 +841,42 @@ void store(int r, SValue *v)
             o(0xc0 + fr + r * 8); /* mov r, fr */
         }
     }
+    if (fr == VT_LOCAL && !pic && (op64 || bt == VT_INT)
+        && !(v->type.t & VT_VOLATILE) && (v->r & VT_LVAL))
+        peep_mov(r, VT_LOCAL, fc, op64 != 0);
+}
+
+/* store the constant 'c' of type 't' to the local at 'fc', without
+   using registers or changing flags */
+ST_FUNC void gen_store_imm(int t, int fc, int c)
+{
+    int bt = t & VT_BTYPE;
+#ifdef NB_REGVARS
+    int r = regvar_find(fc);
+    if (r >= 0) {
+        if (is64_type(bt)) {
+            orex(1, r, 0, 0xc7);
+            o(0xc0 + REG_VALUE(r)); /* mov $c, r (sign extended) */
+        } else {
+            orex(0, r, 0, 0xb8 + REG_VALUE(r)); /* mov $c, r */
+        }
+        gen_le32(c);
+        return;
+    }
+#endif
+    if (bt == VT_BYTE || bt == VT_BOOL) {
+        o(0xc6);
+        gen_modrm(0, VT_LOCAL, NULL, fc);
+        g(c);
+    } else if (bt == VT_SHORT) {
+        o(0xc766);
+        gen_modrm(0, VT_LOCAL, NULL, fc);
+        gen_le16(c);
+    } else {
+        orex(is64_type(bt), 0, 0, 0xc7);
+        gen_modrm(0, VT_LOCAL, NULL, fc);
+        gen_le32(c);
+    }
 }
 
 /* 'is_jmp' is '1' if it is a jump */
@@ -953,6 +1186,7 @@ void gfunc_prolog(Sym *func_sym)
     func_scratch = 32;
     func_alloca = 0;
     loc = 0;
+    gen_peep_reset();
 
     addr = PTR_SIZE * 2;
     ind += FUNC_PROLOG_SIZE;
@@ -1008,6 +1242,7 @@ void gfunc_prolog(Sym *func_sym)
         }
         reg_param_index++;
     }
+    gen_label();
 #ifdef CONFIG_TCC_BCHECK
     if (tcc_state->do_bounds_check)
         gen_bounds_prolog();
@@ -1446,7 +1681,15 @@ void gfunc_call(int nb_args)
 
     if (vtop->type.ref->f.func_type != FUNC_NEW) /* implies FUNC_OLD or FUNC_ELLIPSIS */
         oad(0xb8, nb_sse_args < 8 ? nb_sse_args : 8); /* mov nb_sse_args, %eax */
+#ifdef NB_REGVARS
+    for (i = 0; i < nb_fregvars; i++)
+        fregvar_move(i, 1); /* the sse registers are not preserved */
     gcall_or_jmp(0);
+    for (i = 0; i < nb_fregvars; i++)
+        fregvar_move(i, 0);
+#else
+    gcall_or_jmp(0);
+#endif
     if (args_size)
         gadd_sp(args_size);
     vtop--;
@@ -1472,6 +1715,7 @@ void gfunc_prolog(Sym *func_sym)
     sym = func_type->ref;
     addr = PTR_SIZE * 2;
     loc = 0;
+    gen_peep_reset();
     ind += FUNC_PROLOG_SIZE;
     func_sub_sp_offset = ind;
     func_ret_sub = 0;
@@ -1607,21 +1851,68 @@ void gfunc_prolog(Sym *func_sym)
                  VT_LOCAL | VT_LVAL, param_addr);
     }
 
+    /* save the callee saved registers that might hold variables */
+    nb_regvars = nb_fregvars = 0;
+    max_regvars = func_regvars;
+    loc -= max_regvars * 8;
+    regvar_save = loc;
+    for (i = 0; i < max_regvars; i++) {
+        regvar_ind[i] = ind;
+        gen_modrm64(0x89, regvar_regs[i], VT_LOCAL, NULL, regvar_save + i*8);
+    }
+    regvar_ind[i] = ind;
+
+    gen_label();
 #ifdef CONFIG_TCC_BCHECK
     if (tcc_state->do_bounds_check)
         gen_bounds_prolog();
 #endif
 }
 
+/* put the local variable at frame offset 'c' of type 't' into a
+   register if one is left. With 'param', load its current value. */
+ST_FUNC int gen_regvar(int c, int t, int param)
+{
+    int r;
+    t &= VT_BTYPE;
+    if (t == VT_FLOAT || t == VT_DOUBLE) {
+        if (nb_fregvars >= NB_FREGVARS)
+            return 0;
+        fregvar_loc[nb_fregvars] = c;
+        fregvar_t[nb_fregvars] = t;
+        if (param)
+            fregvar_move(nb_fregvars, 0);
+        nb_fregvars++;
+        return 1;
+    }
+    if (nb_regvars >= max_regvars)
+        return 0;
+    r = regvar_regs[nb_regvars];
+    if (param)
+        gen_modrm64(0x8b, r, VT_LOCAL, NULL, c);
+    regvar_loc[nb_regvars++] = c;
+    return 1;
+}
+
 /* generate function epilog */
 void gfunc_epilog(void)
 {
-    int v, saved_ind;
+    int v, saved_ind, i;
 
 #ifdef CONFIG_TCC_BCHECK
     if (tcc_state->do_bounds_check)
         gen_bounds_epilog();
 #endif
+    for (i = 0; i < nb_regvars; i++)
+        gen_modrm64(0x8b, regvar_regs[i], VT_LOCAL, NULL, regvar_save + i*8);
+    if (nb_regvars < max_regvars) {
+        /* the saves of unused registers become nops */
+        saved_ind = ind;
+        ind = regvar_ind[nb_regvars];
+        gen_fill_nops(regvar_ind[max_regvars] - ind);
+        ind = saved_ind;
+    }
+    nb_regvars = max_regvars = nb_fregvars = 0;
     o(0xc9); /* leave */
     if (func_ret_sub == 0) {
         o(0xc3); /* ret */
@@ -1644,20 +1935,32 @@ void gfunc_epilog(void)
 
 ST_FUNC void gen_fill_nops(int bytes)
 {
-    while (bytes--)
-      g(0x90);
+    /* the recommended nops of 1 to 8 bytes */
+    static const unsigned char nops[8][8] = {
+        { 0x90 }, { 0x66, 0x90 }, { 0x0f, 0x1f, 0x00 },
+        { 0x0f, 0x1f, 0x40, 0x00 }, { 0x0f, 0x1f, 0x44, 0x00, 0x00 },
+        { 0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00 },
+        { 0x0f, 0x1f, 0x80, 0x00, 0x00, 0x00, 0x00 },
+        { 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 }
+    };
+    int i, n;
+
+    for (; bytes > 0; bytes -= n)
+        for (n = bytes < 8 ? bytes : 8, i = 0; i < n; i++)
+            g(nops[n - 1][i]);
 }
 
 /* generate a jump to a label */
 int gjmp(int t)
 {
-    return gjmp2(0xe9, t);
+    return gjmp2(0xe9, peep_thread(t, -1));
 }
 
 /* generate a jump to a fixed address */
 void gjmp_addr(int a)
 {
     int r;
+    peep_thread(0, a);
     r = a - ind - 2;
     if (r == (char)r) {
         g(0xeb);
@@ -1879,6 +2182,16 @@ void gen_opf(int op)
     }
     if ((vtop[0].r & (VT_VALMASK | VT_LVAL)) == VT_CONST)
         gv(float_type);
+#ifdef NB_REGVARS
+    /* and register variables to registers */
+    if (vtop[-1].r == (VT_LOCAL | VT_LVAL) && regvar_find(vtop[-1].c.i) >= 0) {
+        vswap();
+        gv(float_type);
+        vswap();
+    }
+    if (vtop[0].r == (VT_LOCAL | VT_LVAL) && regvar_find(vtop[0].c.i) >= 0)
+        gv(float_type);
+#endif
 
     /* must put at least one value in the floating point register */
     if ((vtop[-1].r & VT_LVAL) &&
@@ -2229,12 +2542,52 @@ ST_FUNC void gen_cvt_csti(int t)
 /* increment tcov counter */
 ST_FUNC void gen_increment_tcov (SValue *sv)
 {
+   if (tcc_state->test_coverage & TCOV_ATOMIC)
+       g(0xf0); /* lock */
    o(0x058348); /* addq $1, xxx(%rip) */
    greloca(cur_text_section, sv->sym, ind, R_X86_64_PC32, -5);
    gen_le32(0);
    o(1);
 }
 
+/* -ftest-coverage=thread: store the offset of the counters of this
+   thread, from a hash of the thread pointer, at loc(%rbp) */
+ST_FUNC void gen_tcov_shard(int loc)
+{
+#if defined TCC_TARGET_PE
+   o(0x048b4865); /* mov %gs:0x30, %rax */
+   o(0x25);
+   gen_le32(0x30);
+#elif defined TCC_TARGET_MACHO
+   o(0x048b4865); /* mov %gs:0, %rax */
+   o(0x25);
+   gen_le32(0);
+#else
+   o(0x048b4864); /* mov %fs:0, %rax */
+   o(0x25);
+   gen_le32(0);
+#endif
+   o(0x0ce8c148); /* shr $12, %rax */
+   o(0xc069); /* imul $0x9e3779b1, %eax, %eax */
+   gen_le32(0x9e3779b1);
+   o(0x16e8c1); /* shr $22, %eax */
+   o(0x25); /* and $(TCOV_SHARDS - 1) * 64, %eax */
+   gen_le32((TCOV_SHARDS - 1) * 64);
+   gen_modrm64(0x89, TREG_RAX, VT_LOCAL, NULL, loc);
+}
+
+/* increment the copy at loc(%rbp) of tcov counter */
+ST_FUNC void gen_increment_tcov_shard (SValue *sv, int loc)
+{
+   o(0x1d8d4c); /* lea xxx(%rip), %r11 */
+   greloca(cur_text_section, sv->sym, ind, R_X86_64_PC32, -4);
+   gen_le32(0);
+   gen_modrm64(0x03, TREG_R11, VT_LOCAL, NULL, loc); /* add loc(%rbp), %r11 */
+   if (tcc_state->test_coverage & TCOV_ATOMIC)
+       g(0xf0); /* lock */
+   o(0x01038349); /* addq $1, (%r11) */
+}
+
 /* computed goto support */
 ST_FUNC void ggoto(void)
 {
@@ -2290,13 +2643,56 @@ ST_FUNC void gen_vla_alloc(CType *type, int align) {
     }
 }
 
-/*
- * Assmuing the top part of the stack looks like below,
- *  src dest src
- */
-ST_FUNC void gen_struct_copy(int size)
+static int is_local_addr(SValue *sv)
+{
+    return (sv->r & (VT_VALMASK | VT_LVAL | VT_SYM)) == VT_LOCAL;
+}
+
+/* base for gen_modrm_impl() of the address 'sv': the frame pointer
+   for a local, else its register */
+static int struct_base(SValue *sv, int *c)
+{
+    if (is_local_addr(sv)) {
+        *c = sv->c.i;
+        return VT_LOCAL;
+    }
+    *c = 0;
+    return TREG_MEM | (sv->r & VT_VALMASK);
+}
+
+/* copy 'size' bytes from the address on top of the stack to the one
+   below and pop both.  Small sizes use sse and overlapping moves. */
+ST_FUNC int gen_struct_copy(int size, int align)
 {
-    int n = size / PTR_SIZE;
+    int n = size / PTR_SIZE, d, s, dc, sc, c, x, op;
+
+    if (size >= 4 && size <= 128) {
+        if (!is_local_addr(vtop - 1) && !is_local_addr(vtop))
+            gv2(RC_INT, RC_INT);
+        else if (!is_local_addr(vtop - 1)) {
+            vswap();
+            gv(RC_INT);
+            vswap();
+        } else if (!is_local_addr(vtop))
+            gv(RC_INT);
+        d = struct_base(vtop - 1, &dc);
+        s = struct_base(vtop, &sc);
+        n = size >= 16 ? 16 : size >= 8 ? 8 : 4;
+        x = TREG_R11, op = 0x8b;
+        if (n == 16)
+            x = get_reg(RC_FLOAT), op = 0x100f; /* movups */
+        for (c = 0; c < size; c += n) {
+            if (c + n > size)
+                c = size - n; /* overlaps the previous one */
+            orex(n == 8, s, x, op);
+            gen_modrm_impl(x, s, NULL, sc + c, 0);
+            orex(n == 8, d, x, op == 0x8b ? 0x89 : 0x110f);
+            gen_modrm_impl(x, d, NULL, dc + c, 0);
+        }
+        vpop();
+        vpop();
+        return 1;
+    }
 #ifdef TCC_TARGET_PE
     o(0x5756); /* push rsi, rdi */
 #endif
@@ -2321,6 +2717,47 @@ ST_FUNC void gen_struct_copy(int size)
 #endif
     vpop();
     vpop();
+    return 1;
+}
+
+/* zero 'size' bytes at the address on top of the stack and pop it,
+   or return 0 if memset() is better */
+ST_FUNC int gen_struct_clear(int size, int align)
+{
+    int d, dc, c, n, x;
+
+    if (size > 128)
+        return 0;
+    if (!is_local_addr(vtop))
+        gv(RC_INT);
+    d = struct_base(vtop, &dc);
+    if (size >= 16) {
+        x = get_reg(RC_FLOAT);
+        orex(0, x, x, 0x570f);
+        o(0xc0 + REG_VALUE(x) * 9); /* xorps x, x */
+        for (c = 0; c < size; c += 16) {
+            if (c + 16 > size)
+                c = size - 16;
+            orex(0, d, x, 0x110f); /* movups */
+            gen_modrm_impl(x, d, NULL, dc + c, 0);
+        }
+    } else {
+        for (c = 0; c < size; c += n) {
+            n = size - c >= 8 ? 8 : size - c >= 4 ? 4 : size - c >= 2 ? 2 : 1;
+            if (n == 2)
+                o(0x66);
+            orex(n == 8, d, 0, n == 1 ? 0xc6 : 0xc7);
+            gen_modrm_impl(0, d, NULL, dc + c, 0);
+            if (n == 1)
+                g(0);
+            else if (n == 2)
+                gen_le16(0);
+            else
+                gen_le32(0);
+        }
+    }
+    vpop();
+    return 1;
 }
 
 /* end of x86-64 code generator */